@@ -0,0 +1,78 @@
+#include "arena.h"
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define ARENA_CHUNK_SIZE 65536
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct ArenaChunk
+{
+    ArenaChunk *next;
+    size_t used;
+    size_t size;
+    alignas(max_align_t) unsigned char data[];
+};
+
+static ArenaChunk* arena_new_chunk(size_t size)
+{
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + size);
+    chunk->next = NULL;
+    chunk->used = 0;
+    chunk->size = size;
+    return chunk;
+}
+
+Arena* arena_create(void)
+{
+    Arena *arena = malloc(sizeof(Arena));
+    arena->first = arena_new_chunk(ARENA_CHUNK_SIZE);
+    arena->current = arena->first;
+    return arena;
+}
+
+void* arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    ArenaChunk *chunk = arena->current;
+    while (chunk->size - chunk->used < size)
+    {
+        // chunks kept from before a reset are reused in order, anything
+        // too small for this request gets a dedicated chunk in front of it
+        ArenaChunk *next = chunk->next;
+        if (!next || next->size < size)
+        {
+            ArenaChunk *fresh = arena_new_chunk(size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+            fresh->next = next;
+            chunk->next = fresh;
+            next = fresh;
+        }
+        next->used = 0;
+        chunk = next;
+    }
+
+    arena->current = chunk;
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+void arena_reset(Arena *arena)
+{
+    arena->current = arena->first;
+    arena->first->used = 0;
+}
+
+void arena_free(Arena *arena)
+{
+    if (!arena) return;
+
+    ArenaChunk *chunk = arena->first;
+    while (chunk)
+    {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
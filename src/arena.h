@@ -0,0 +1,21 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Region allocator: allocations are bumped out of large chunks and released
+// all at once. Reset keeps the chunks around for the next parse.
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct Arena
+{
+    ArenaChunk *first;
+    ArenaChunk *current;
+} Arena;
+
+Arena* arena_create(void);
+void* arena_alloc(Arena *arena, size_t size);
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+
+#endif //ARENA_H
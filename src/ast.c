@@ -3,98 +3,183 @@
 //
 
 #include "ast.h"
+#include "intern.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-ASTNode* ast_create(ASTNodeType type, int line, int column)
+ASTNode* ast_create(Arena *arena, ASTNodeType type, int line, int column)
 {
-    ASTNode *node = malloc(sizeof(ASTNode));
+    ASTNode *node = arena ? arena_alloc(arena, sizeof(ASTNode)) : malloc(sizeof(ASTNode));
     node->type = type;
     node->line = line;
     node->column = column;
+    node->in_arena = arena != NULL;
     node->string_value = NULL;
     node->number_value = 0;
-    node->op = NULL;
+    node->op = AST_OP_NONE;
     node->children = NULL;
     node->num_children = 0;
+    node->capacity = 0;
     node->left = NULL;
     node->right = NULL;
     return node;
 }
 
-ASTNode* ast_create_identifier(const char *name, int line, int column)
+ASTNode* ast_create_identifier(Arena *arena, const char *name, size_t length, int line, int column)
 {
-    ASTNode *node = ast_create(AST_IDENTIFIER, line, column);
-    node->string_value = strdup(name);
+    ASTNode *node = ast_create(arena, AST_IDENTIFIER, line, column);
+    node->string_value = intern(name, length);
     return node;
 }
 
-ASTNode* ast_create_number(double value, int line, int column)
+ASTNode* ast_create_number(Arena *arena, double value, int line, int column)
 {
-    ASTNode *node = ast_create(AST_NUMBER, line, column);
+    ASTNode *node = ast_create(arena, AST_NUMBER, line, column);
     node->number_value = value;
     return node;
 }
 
-ASTNode* ast_create_string(const char *value, int line, int column)
+ASTNode* ast_create_string(Arena *arena, const char *value, size_t length, int line, int column)
 {
-    ASTNode *node = ast_create(AST_STRING, line, column);
-    node->string_value = strdup(value);
+    ASTNode *node = ast_create(arena, AST_STRING, line, column);
+    node->string_value = intern(value, length);
     return node;
 }
 
-ASTNode* ast_create_binary(ASTNode *left, const char *op, ASTNode *right, int line, int column)
+ASTNode* ast_create_boolean(Arena *arena, bool value, int line, int column)
 {
-    ASTNode *node = ast_create(AST_BINARY_OP, line, column);
+    ASTNode *node = ast_create(arena, AST_BOOLEAN, line, column);
+    node->string_value = intern_cstr(value ? "true" : "false");
+    return node;
+}
+
+ASTNode* ast_create_binary(Arena *arena, ASTNode *left, ASTOperator op, ASTNode *right, int line, int column)
+{
+    ASTNode *node = ast_create(arena, AST_BINARY_OP, line, column);
     node->left = left;
     node->right = right;
-    node->op = op ? strdup(op) : NULL;
+    node->op = op;
     return node;
 }
 
-ASTNode* ast_create_call(ASTNode *callee, ASTNode  *args, int line, int column)
+ASTNode* ast_create_call(Arena *arena, ASTNode *callee, ASTNode *args, int line, int column)
 {
-    ASTNode *node = ast_create(AST_CALL, line, column);
+    ASTNode *node = ast_create(arena, AST_CALL, line, column);
     node->left = callee;
     node->right = args;
     return node;
 }
 
-ASTNode* ast_create_member(ASTNode *object, ASTNode *member, int line, int column)
+ASTNode* ast_create_member(Arena *arena, ASTNode *object, ASTNode *member, int line, int column)
 {
-    ASTNode *node = ast_create(AST_MEMBER_ACCESS, line, column);
+    ASTNode *node = ast_create(arena, AST_MEMBER_ACCESS, line, column);
     node->left = object;
     node->right = member;
     return node;
 }
-void ast_add_child(ASTNode *parent, ASTNode *child)
+void ast_add_child(Arena *arena, ASTNode *parent, ASTNode *child)
 {
     if (!child) return;
 
-    parent->children = realloc(parent->children, sizeof(ASTNode*) * (parent->num_children + 1));
+    // grow geometrically so a block of N statements costs O(N) copying and
+    // O(log N) allocations. Arena memory cannot be resized, there the old array
+    // is left behind, which keeps the waste within a factor of two.
+    if (parent->num_children == parent->capacity)
+    {
+        int capacity = parent->capacity ? parent->capacity * 2 : 4;
+        size_t size = sizeof(ASTNode*) * (size_t)capacity;
+        if (arena)
+        {
+            ASTNode **children = arena_alloc(arena, size);
+            if (parent->num_children)
+                memcpy(children, parent->children, sizeof(ASTNode*) * (size_t)parent->num_children);
+            parent->children = children;
+        } else
+        {
+            parent->children = realloc(parent->children, size);
+        }
+        parent->capacity = capacity;
+    }
     parent->children[parent->num_children++] = child;
 }
 
-void ast_free(ASTNode *node)
+typedef struct
+{
+    ASTNode *node;
+    int depth;
+    bool entered;
+} WalkFrame;
+
+void ast_walk(ASTNode *root, ASTVisitFn pre, ASTLeaveFn post, void *ctx)
 {
-    if (!node) return;
+    if (!root) return;
 
-    if (node->string_value) free(node->string_value);
-    if (node->op) free(node->op);
+    size_t capacity = 64;
+    size_t top = 0;
+    WalkFrame *stack = malloc(sizeof(WalkFrame) * capacity);
+    stack[top++] = (WalkFrame){ root, 0, false };
 
-    for (int i = 0; i < node->num_children; i++)
+    while (top > 0)
     {
-        ast_free(node->children[i]);
+        WalkFrame *frame = &stack[top - 1];
+        if (frame->entered)
+        {
+            ASTNode *node = frame->node;
+            int depth = frame->depth;
+            top--;
+            if (post) post(node, depth, ctx);
+            continue;
+        }
+
+        frame->entered = true;
+        ASTNode *node = frame->node;
+        int depth = frame->depth;
+        int edges = pre ? pre(node, depth, ctx) : AST_WALK_ALL;
+
+        // worst case every child plus left and right
+        size_t needed = top + (size_t)node->num_children + 2;
+        if (needed > capacity)
+        {
+            while (needed > capacity) capacity *= 2;
+            stack = realloc(stack, sizeof(WalkFrame) * capacity);
+        }
+
+        // pushed in reverse so they come off the stack as children, left, right
+        if (edges & AST_WALK_OPERANDS)
+        {
+            if (node->right) stack[top++] = (WalkFrame){ node->right, depth + 1, false };
+            if (node->left) stack[top++] = (WalkFrame){ node->left, depth + 1, false };
+        }
+        if (edges & AST_WALK_CHILDREN)
+        {
+            for (int i = node->num_children - 1; i >= 0; i--)
+            {
+                if (node->children[i]) stack[top++] = (WalkFrame){ node->children[i], depth + 1, false };
+            }
+        }
     }
-    if (node->children) free(node->children);
 
-    ast_free(node->left);
-    ast_free(node->right);
+    free(stack);
+}
+
+static void ast_free_node(ASTNode *node, int depth, void *ctx)
+{
+    (void)depth;
+    (void)ctx;
+    if (node->children) free(node->children);
     free(node);
 }
 
-static const char* node_type_name(ASTNodeType type)
+void ast_free(ASTNode *node)
+{
+    // arena trees are released with their arena in one go
+    if (!node || node->in_arena) return;
+
+    ast_walk(node, NULL, ast_free_node, NULL);
+}
+
+const char* ast_type_name(ASTNodeType type)
 {
     switch (type)
     {
@@ -109,6 +194,7 @@ static const char* node_type_name(ASTNodeType type)
         case AST_IDENTIFIER: return "IDENTIFIER";
         case AST_NUMBER: return "NUMBER";
         case AST_STRING: return "STRING";
+        case AST_BOOLEAN: return "BOOLEAN";
         case AST_BINARY_OP: return "BINARY_OP";
         case AST_UNARY_OP: return "UNARY_OP";
         case AST_CALL: return "CALL";
@@ -118,27 +204,63 @@ static const char* node_type_name(ASTNodeType type)
     }
 }
 
-void ast_print(ASTNode *node, int depth)
+const char* ast_op_name(ASTOperator op)
 {
-    if (!node) return;
+    switch (op)
+    {
+        case AST_OP_ASSIGN: return "=";
+        case AST_OP_EQ: return "==";
+        case AST_OP_NE: return "!=";
+        case AST_OP_LT: return "<";
+        case AST_OP_GT: return ">";
+        case AST_OP_LE: return "<=";
+        case AST_OP_GE: return ">=";
+        case AST_OP_ADD: return "+";
+        case AST_OP_SUB: return "-";
+        case AST_OP_MUL: return "*";
+        case AST_OP_DIV: return "/";
+        case AST_OP_MOD: return "%";
+        case AST_OP_AND: return "and";
+        case AST_OP_OR: return "or";
+        case AST_OP_NAND: return "nand";
+        case AST_OP_NOR: return "nor";
+        case AST_OP_XOR: return "xor";
+        case AST_OP_XNOR: return "xnor";
+        case AST_OP_NOT: return "not";
+        case AST_OP_NEG: return "-";
+        default: return NULL;
+    }
+}
 
+void ast_print_line(int depth, ASTNodeType type, int line, int column,
+    const char *string_value, ASTOperator op, double number_value)
+{
     for (int i = 0; i < depth; i++) printf(" ");
-    printf("[%d:%d] %s", node->line, node->column, node_type_name(node->type));
+    printf("[%d:%d] %s", line, column, ast_type_name(type));
 
-    if (node->string_value)
-        printf(" \"%s\"", node->string_value);
-    if (node->op)
-        printf(" op=%s", node->op);
-    if (node->type == AST_NUMBER)
-        printf(" %.2f", node->number_value);
+    if (string_value)
+        printf(" \"%s\"", string_value);
+    if (op != AST_OP_NONE)
+        printf(" op=%s", ast_op_name(op));
+    if (type == AST_NUMBER)
+        printf(" %.2f", number_value);
 
     printf("\n");
+}
+
+static int ast_print_node(ASTNode *node, int depth, void *ctx)
+{
+    int base = *(int *)ctx;
+    ast_print_line(base + depth, node->type, node->line, node->column,
+        node->string_value, node->op, node->number_value);
 
-    for (int i = 0; i < node->num_children; i++)
-        ast_print(node->children[i], depth + 1);
+    // operands of these are not shown
+    if (node->type == AST_BINARY_OP || node->type == AST_CALL || node->type == AST_MEMBER_ACCESS)
+        return AST_WALK_CHILDREN;
+    return AST_WALK_ALL;
+}
 
-    if (node->left && node->type != AST_BINARY_OP && node->type != AST_CALL && node->type != AST_MEMBER_ACCESS)
-        ast_print(node->left, depth + 1);
-    if (node->right && node->type != AST_BINARY_OP && node->type != AST_CALL && node->type != AST_MEMBER_ACCESS)
-        ast_print(node->right, depth + 1);
+void ast_print(ASTNode *node, int depth)
+{
+    ast_walk(node, ast_print_node, NULL, &depth);
 }
@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
 
 typedef enum
 {
@@ -24,6 +26,7 @@ typedef enum
     AST_IDENTIFIER,
     AST_NUMBER,
     AST_STRING,
+    AST_BOOLEAN,        // string_value "true" or "false", however the source spelled it
     AST_BINARY_OP,
     AST_UNARY_OP,
     AST_CALL,
@@ -31,37 +34,90 @@ typedef enum
     AST_ARGUMENTS,
 } ASTNodeType;
 
+typedef enum
+{
+    AST_OP_NONE,
+
+    // binary
+    AST_OP_ASSIGN,
+    AST_OP_EQ,
+    AST_OP_NE,
+    AST_OP_LT,
+    AST_OP_GT,
+    AST_OP_LE,
+    AST_OP_GE,
+    AST_OP_ADD,
+    AST_OP_SUB,
+    AST_OP_MUL,
+    AST_OP_DIV,
+    AST_OP_MOD,
+    AST_OP_AND,
+    AST_OP_OR,
+    AST_OP_NAND,
+    AST_OP_NOR,
+    AST_OP_XOR,
+    AST_OP_XNOR,
+
+    // unary
+    AST_OP_NOT,
+    AST_OP_NEG,
+} ASTOperator;
+
 typedef struct ASTNode
 {
     ASTNodeType type;
     int line;
     int column;
-
-    // Generic fields for nodes
-    char *string_value;
-    double number_value;
-    char *op;
+    ASTOperator op;
 
     // children
     struct ASTNode **children;
     int num_children;
+    int capacity;
+
+    // Generic fields for nodes, strings are interned (see intern.h)
+    const char *string_value;
+    double number_value;
 
     // Special node types
     struct ASTNode *left;
     struct ASTNode *right;
+
+    bool in_arena;
 } ASTNode;
 
-// constructors
-ASTNode* ast_create(ASTNodeType type, int line, int column);
-ASTNode* ast_create_identifier(const char *name, int line, int column);
-ASTNode* ast_create_number(double value, int line, int column);
-ASTNode* ast_create_string(const char *value, int line, int column);
-ASTNode* ast_create_binary(ASTNode *left, const char *op, ASTNode *right, int line, int column);
-ASTNode* ast_create_call(ASTNode *callee, ASTNode *args, int line, int column);
-ASTNode* ast_create_member(ASTNode *object, ASTNode *member, int line, int column);
+// constructors, nodes come out of the arena or off the heap when it is NULL.
+// A tree is either all arena or all heap.
+ASTNode* ast_create(Arena *arena, ASTNodeType type, int line, int column);
+ASTNode* ast_create_identifier(Arena *arena, const char *name, size_t length, int line, int column);
+ASTNode* ast_create_number(Arena *arena, double value, int line, int column);
+ASTNode* ast_create_string(Arena *arena, const char *value, size_t length, int line, int column);
+ASTNode* ast_create_boolean(Arena *arena, bool value, int line, int column);
+ASTNode* ast_create_binary(Arena *arena, ASTNode *left, ASTOperator op, ASTNode *right, int line, int column);
+ASTNode* ast_create_call(Arena *arena, ASTNode *callee, ASTNode *args, int line, int column);
+ASTNode* ast_create_member(Arena *arena, ASTNode *object, ASTNode *member, int line, int column);
+
+// Non-recursive depth-first traversal, so tree depth is only bounded by memory.
+// pre runs before a node's subtrees and returns which of them to descend into,
+// post runs after them. Order is children, then left, then right.
+#define AST_WALK_CHILDREN 1
+#define AST_WALK_OPERANDS 2
+#define AST_WALK_ALL (AST_WALK_CHILDREN | AST_WALK_OPERANDS)
+
+typedef int (*ASTVisitFn)(struct ASTNode *node, int depth, void *ctx);
+typedef void (*ASTLeaveFn)(struct ASTNode *node, int depth, void *ctx);
+
+void ast_walk(ASTNode *root, ASTVisitFn pre, ASTLeaveFn post, void *ctx);
 
 // utility
-void ast_add_child(ASTNode *parent, ASTNode *child);
+void ast_add_child(Arena *arena, ASTNode *parent, ASTNode *child);
+// frees a heap tree, arena trees go away with arena_reset/arena_free
 void ast_free(ASTNode *node);
 void ast_print(ASTNode *node, int depth);
+
+const char* ast_type_name(ASTNodeType type);
+const char* ast_op_name(ASTOperator op);
+// one line of ast_print output, shared with the pooled layout (ast_pool.h)
+void ast_print_line(int depth, ASTNodeType type, int line, int column,
+    const char *string_value, ASTOperator op, double number_value);
 #endif //AST_H
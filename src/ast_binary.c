@@ -0,0 +1,203 @@
+#include "ast_binary.h"
+#include "intern.h"
+#include <stdlib.h>
+#include <string.h>
+
+// section offsets, 64-bit so that no header can make them wrap
+typedef struct
+{
+    uint64_t numbers, line, column, value, lhs, rhs, lists, ends, type, op, strings;
+    uint64_t total;
+} ASTBinaryLayout;
+
+static uint64_t binary_pad(uint64_t size)
+{
+    return (size + 7) & ~(uint64_t)7;
+}
+
+static ASTBinaryLayout binary_layout(const ASTBinaryHeader *h)
+{
+    ASTBinaryLayout l;
+    uint64_t at = sizeof(ASTBinaryHeader);
+    uint64_t nodes = h->node_count;
+    l.numbers = at;  at += binary_pad(sizeof(double) * (uint64_t)h->number_count);
+    l.line = at;     at += binary_pad(sizeof(int32_t) * nodes);
+    l.column = at;   at += binary_pad(sizeof(int32_t) * nodes);
+    l.value = at;    at += binary_pad(sizeof(uint32_t) * nodes);
+    l.lhs = at;      at += binary_pad(sizeof(uint32_t) * nodes);
+    l.rhs = at;      at += binary_pad(sizeof(uint32_t) * nodes);
+    l.lists = at;    at += binary_pad(sizeof(ASTIndex) * (uint64_t)h->list_count);
+    l.ends = at;     at += binary_pad(sizeof(uint32_t) * (uint64_t)h->string_count);
+    l.type = at;     at += binary_pad(nodes);
+    l.op = at;       at += binary_pad(nodes);
+    l.strings = at;  at += binary_pad(h->string_bytes);
+    l.total = at;
+    return l;
+}
+
+// Anything a damaged or hostile file could do to ast_pool_to_tree: indices out
+// of range, shared or cyclic subtrees (children must come after their parent
+// and have exactly one), bad enums or side table references.
+static int binary_check_nodes(const ASTPool *pool)
+{
+    if (pool->count < 2 || pool->root == AST_NO_NODE || pool->root >= pool->count) return 0;
+
+    unsigned char *seen = calloc(pool->count, 1);
+    int ok = 1;
+    for (ASTIndex i = 1; i < pool->count && ok; i++)
+    {
+        ASTNodeType type = (ASTNodeType)pool->type[i];
+        ok = type <= AST_ARGUMENTS && pool->op[i] <= AST_OP_NEG
+            && pool->value[i] <= (type == AST_NUMBER ? pool->number_count : pool->string_count);
+
+        uint32_t first = ast_pool_has_children(type) ? pool->lhs[i] : 0;
+        uint32_t count = ast_pool_has_children(type) ? pool->rhs[i] : 2;
+        if (ast_pool_has_children(type) && (uint64_t)first + count > pool->list_count) ok = 0;
+
+        for (uint32_t c = 0; c < count && ok; c++)
+        {
+            ASTIndex child = ast_pool_has_children(type) ? pool->lists[first + c] : (c ? pool->rhs[i] : pool->lhs[i]);
+            if (child == AST_NO_NODE && !ast_pool_has_children(type)) continue;
+            ok = child > i && child < pool->count && !seen[child] && child != pool->root;
+            if (ok) seen[child] = 1;
+        }
+    }
+    free(seen);
+    return ok;
+}
+
+// every string non-empty (it holds its NUL at least), in order, terminated
+static int binary_check_strings(const uint32_t *ends, uint32_t count, const char *bytes, uint32_t size)
+{
+    uint32_t start = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (ends[i] <= start || ends[i] > size || bytes[ends[i] - 1] != '\0') return 0;
+        start = ends[i];
+    }
+    return start == size;
+}
+
+int ast_view_decode(const void *data, size_t size, ASTPool *pool)
+{
+    ASTBinaryHeader h;
+    if (size < sizeof(h)) return -1;
+    memcpy(&h, data, sizeof(h));
+    if (h.magic != AST_BINARY_MAGIC || h.version != AST_BINARY_VERSION) return -1;
+
+    ASTBinaryLayout l = binary_layout(&h);
+    if (l.total != size) return -1;
+
+    const char *base = data;
+    const uint32_t *ends = (const uint32_t *)(base + l.ends);
+    const char *bytes = base + l.strings;
+    if (!binary_check_strings(ends, h.string_count, bytes, h.string_bytes)) return -1;
+
+    *pool = (ASTPool){ 0 };
+    pool->count = pool->capacity = h.node_count;
+    pool->root = h.root;
+    pool->type = (uint8_t *)(base + l.type);
+    pool->op = (uint8_t *)(base + l.op);
+    pool->line = (int32_t *)(base + l.line);
+    pool->column = (int32_t *)(base + l.column);
+    pool->value = (uint32_t *)(base + l.value);
+    pool->lhs = (uint32_t *)(base + l.lhs);
+    pool->rhs = (uint32_t *)(base + l.rhs);
+    pool->lists = (ASTIndex *)(base + l.lists);
+    pool->list_count = h.list_count;
+    pool->numbers = (double *)(base + l.numbers);
+    pool->number_count = h.number_count;
+    pool->string_count = h.string_count;
+    pool->string_bytes = bytes;
+    pool->string_ends = ends;
+    return binary_check_nodes(pool) ? 0 : -1;
+}
+
+int ast_view_open(const char *path, ASTView *view)
+{
+    view->map = filemap_open(path);
+    if (view->map && ast_view_decode(view->map->data, view->map->size, &view->pool) == 0)
+        return 0;
+    ast_view_close(view);
+    return -1;
+}
+
+void ast_view_close(ASTView *view)
+{
+    filemap_close(view->map);
+    view->map = NULL;
+}
+
+ASTNode* ast_decode(const void *data, size_t size, Arena *arena)
+{
+    ASTPool pool;
+    if (ast_view_decode(data, size, &pool) != 0) return NULL;
+
+    // the tree's strings compare by pointer downstream, so they are interned
+    pool.strings = malloc(sizeof(const char *) * (pool.string_count + 1));
+    uint32_t start = 0;
+    for (uint32_t i = 0; i < pool.string_count; i++)
+    {
+        pool.strings[i] = intern(pool.string_bytes + start, pool.string_ends[i] - start - 1);
+        start = pool.string_ends[i];
+    }
+
+    ASTNode *tree = ast_pool_to_tree(&pool, pool.root, arena);
+    free(pool.strings);
+    return tree;
+}
+
+ASTNode* ast_load(const char *path, Arena *arena)
+{
+    FileMap *map = filemap_open(path);
+    if (!map) return NULL;
+    ASTNode *tree = ast_decode(map->data, map->size, arena);
+    filemap_close(map);
+    return tree;
+}
+
+static void binary_write_padding(FILE *out, uint64_t size)
+{
+    static const char zeros[8] = { 0 };
+    fwrite(zeros, 1, (size_t)(binary_pad(size) - size), out);
+}
+
+static void binary_write(FILE *out, const void *data, size_t size)
+{
+    if (size) fwrite(data, 1, size, out);
+    binary_write_padding(out, size);
+}
+
+int ast_serialize(ASTNode *program, FILE *out)
+{
+    ASTPool *pool = ast_pool_from_tree(program);
+    uint32_t *ends = malloc(sizeof(uint32_t) * (pool->string_count + 1));
+    uint32_t bytes = 0;
+    for (uint32_t i = 0; i < pool->string_count; i++)
+    {
+        bytes += (uint32_t)intern_length(pool->strings[i]) + 1;
+        ends[i] = bytes;
+    }
+
+    ASTBinaryHeader h = { AST_BINARY_MAGIC, AST_BINARY_VERSION, pool->count, pool->root,
+        pool->list_count, pool->string_count, pool->number_count, bytes };
+
+    binary_write(out, &h, sizeof(h));
+    binary_write(out, pool->numbers, sizeof(double) * pool->number_count);
+    binary_write(out, pool->line, sizeof(int32_t) * pool->count);
+    binary_write(out, pool->column, sizeof(int32_t) * pool->count);
+    binary_write(out, pool->value, sizeof(uint32_t) * pool->count);
+    binary_write(out, pool->lhs, sizeof(uint32_t) * pool->count);
+    binary_write(out, pool->rhs, sizeof(uint32_t) * pool->count);
+    binary_write(out, pool->lists, sizeof(ASTIndex) * pool->list_count);
+    binary_write(out, ends, sizeof(uint32_t) * pool->string_count);
+    binary_write(out, pool->type, pool->count);
+    binary_write(out, pool->op, pool->count);
+    for (uint32_t i = 0; i < pool->string_count; i++)
+        fwrite(pool->strings[i], 1, intern_length(pool->strings[i]) + 1, out);  // interned strings end in NUL
+    binary_write_padding(out, bytes);
+
+    free(ends);
+    ast_pool_free(pool);
+    return ferror(out) ? -1 : 0;
+}
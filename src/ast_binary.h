@@ -0,0 +1,74 @@
+#ifndef AST_BINARY_H
+#define AST_BINARY_H
+
+#include "ast.h"
+#include "ast_pool.h"
+#include "filemap.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Binary form of a parsed program, the pooled layout of ast_pool.h written
+// out as is: nodes are indices, never pointers, and every string is stored
+// once, so a mapped file is read as a pool in place. A file is a header
+// followed by these sections, each starting on an 8-byte boundary:
+//
+//   numbers     double[number_count]
+//   line        int32[node_count]
+//   column      int32[node_count]
+//   value       uint32[node_count]      strings/numbers index + 1, 0 for none
+//   lhs         uint32[node_count]      left operand, or first entry in lists
+//   rhs         uint32[node_count]      right operand, or number of children
+//   lists       uint32[list_count]      children of list nodes, contiguous
+//   ends        uint32[string_count]    string i ends at ends[i], NUL included
+//   type        uint8[node_count]       ASTNodeType
+//   op          uint8[node_count]       ASTOperator
+//   strings     char[string_bytes]      NUL-terminated, back to back
+//
+// Node 0 is unused; children always come after their parent. Values are in
+// the byte order of the machine that wrote them, a reader of the other order
+// sees a bad magic.
+#define AST_BINARY_MAGIC 0x00414B51u    // "QKA\0"
+
+// Bump whenever the layout or the meaning of a field changes
+#define AST_BINARY_VERSION 2
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t node_count;
+    uint32_t root;
+    uint32_t list_count;
+    uint32_t string_count;
+    uint32_t number_count;
+    uint32_t string_bytes;
+} ASTBinaryHeader;
+
+// Writes program to out, 0 on success
+int ast_serialize(ASTNode *program, FILE *out);
+
+// Checks size bytes at data (8-byte aligned) and points pool at the sections
+// where they are: nothing is copied or relocated, strings are offsets into
+// the string section and are not interned. The pool is only valid while data
+// is and is never given to ast_pool_free. 0 on success, -1 when the bytes are
+// not a complete, consistent program of this version.
+int ast_view_decode(const void *data, size_t size, ASTPool *pool);
+
+// A file mapped and checked in place, see ast_view_decode
+typedef struct
+{
+    ASTPool pool;
+    FileMap *map;
+} ASTView;
+
+int ast_view_open(const char *path, ASTView *view);
+void ast_view_close(ASTView *view);
+
+// For callers that need the pointer tree: ast_view_decode, then the tree is
+// built in arena with its strings interned. NULL when the bytes do not check.
+ASTNode* ast_decode(const void *data, size_t size, Arena *arena);
+
+// ast_decode of a whole file, mapped
+ASTNode* ast_load(const char *path, Arena *arena);
+
+#endif //AST_BINARY_H
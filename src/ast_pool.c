@@ -0,0 +1,296 @@
+#include "ast_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    ASTNode *node;
+    ASTIndex index;
+    uint32_t next_child;
+} PoolFrame;
+
+typedef struct
+{
+    ASTPool *pool;
+
+    // interned pointer -> strings[] index + 1, so each string is stored once
+    const char **keys;
+    uint32_t *ids;
+    uint32_t map_capacity;
+
+    // nodes entered and not yet left, innermost last
+    PoolFrame *stack;
+    uint32_t depth;
+    uint32_t stack_capacity;
+} PoolBuilder;
+
+#define GROW(array, count, capacity, initial) \
+    do { \
+        if ((count) == (capacity)) \
+        { \
+            (capacity) = (capacity) ? (capacity) * 2 : (initial); \
+            (array) = realloc((array), sizeof(*(array)) * (capacity)); \
+        } \
+    } while (0)
+
+static ASTIndex pool_new_node(ASTPool *pool)
+{
+    if (pool->count == pool->capacity)
+    {
+        pool->capacity = pool->capacity ? pool->capacity * 2 : 256;
+        pool->type = realloc(pool->type, pool->capacity);
+        pool->op = realloc(pool->op, pool->capacity);
+        pool->line = realloc(pool->line, sizeof(int32_t) * pool->capacity);
+        pool->column = realloc(pool->column, sizeof(int32_t) * pool->capacity);
+        pool->value = realloc(pool->value, sizeof(uint32_t) * pool->capacity);
+        pool->lhs = realloc(pool->lhs, sizeof(uint32_t) * pool->capacity);
+        pool->rhs = realloc(pool->rhs, sizeof(uint32_t) * pool->capacity);
+    }
+    return pool->count++;
+}
+
+static uint32_t pool_string(PoolBuilder *b, const char *str)
+{
+    ASTPool *pool = b->pool;
+
+    if ((pool->string_count + 1) * 2 > b->map_capacity)
+    {
+        uint32_t capacity = b->map_capacity ? b->map_capacity * 2 : 256;
+        const char **keys = calloc(capacity, sizeof(const char *));
+        uint32_t *ids = malloc(sizeof(uint32_t) * capacity);
+        for (uint32_t i = 0; i < b->map_capacity; i++)
+        {
+            if (!b->keys[i]) continue;
+            uint32_t slot = (uint32_t)(((uintptr_t)b->keys[i] >> 3) * 2654435761u) & (capacity - 1);
+            while (keys[slot]) slot = (slot + 1) & (capacity - 1);
+            keys[slot] = b->keys[i];
+            ids[slot] = b->ids[i];
+        }
+        free(b->keys);
+        free(b->ids);
+        b->keys = keys;
+        b->ids = ids;
+        b->map_capacity = capacity;
+    }
+
+    uint32_t slot = (uint32_t)(((uintptr_t)str >> 3) * 2654435761u) & (b->map_capacity - 1);
+    while (b->keys[slot])
+    {
+        if (b->keys[slot] == str) return b->ids[slot];
+        slot = (slot + 1) & (b->map_capacity - 1);
+    }
+
+    GROW(pool->strings, pool->string_count, pool->string_capacity, 64);
+    pool->strings[pool->string_count++] = str;
+    b->keys[slot] = str;
+    b->ids[slot] = pool->string_count;
+    return pool->string_count;
+}
+
+// Nodes are numbered in the order ast_walk enters them, which is pre-order:
+// children, then left, then right. Each one is linked into its parent's slot.
+static int pool_enter(ASTNode *node, int depth, void *ctx)
+{
+    (void)depth;
+    PoolBuilder *b = ctx;
+    ASTPool *pool = b->pool;
+    ASTIndex index = pool_new_node(pool);
+    pool->type[index] = (uint8_t)node->type;
+    pool->op[index] = (uint8_t)node->op;
+    pool->line[index] = node->line;
+    pool->column[index] = node->column;
+    pool->value[index] = 0;
+    pool->lhs[index] = AST_NO_NODE;
+    pool->rhs[index] = AST_NO_NODE;
+
+    if (node->type == AST_NUMBER)
+    {
+        GROW(pool->numbers, pool->number_count, pool->number_capacity, 64);
+        pool->numbers[pool->number_count++] = node->number_value;
+        pool->value[index] = pool->number_count;
+    } else if (node->string_value)
+    {
+        pool->value[index] = pool_string(b, node->string_value);
+    }
+
+    bool children = ast_pool_has_children(node->type);
+    if (children)
+    {
+        // reserve the list first so the children stay contiguous
+        uint32_t first = pool->list_count;
+        for (int i = 0; i < node->num_children; i++)
+        {
+            GROW(pool->lists, pool->list_count, pool->list_capacity, 256);
+            pool->list_count++;
+        }
+        pool->lhs[index] = first;
+        pool->rhs[index] = (uint32_t)node->num_children;
+    }
+
+    if (b->depth == 0)
+    {
+        pool->root = index;
+    } else
+    {
+        PoolFrame *parent = &b->stack[b->depth - 1];
+        if (ast_pool_has_children(parent->node->type))
+            pool->lists[pool->lhs[parent->index] + parent->next_child++] = index;
+        else if (node == parent->node->left)
+            pool->lhs[parent->index] = index;
+        else
+            pool->rhs[parent->index] = index;
+    }
+
+    GROW(b->stack, b->depth, b->stack_capacity, 64);
+    b->stack[b->depth++] = (PoolFrame){ node, index, 0 };
+    return children ? AST_WALK_CHILDREN : AST_WALK_OPERANDS;
+}
+
+static void pool_leave(ASTNode *node, int depth, void *ctx)
+{
+    (void)node;
+    (void)depth;
+    PoolBuilder *b = ctx;
+    b->depth--;
+}
+
+ASTPool* ast_pool_from_tree(ASTNode *root)
+{
+    ASTPool *pool = calloc(1, sizeof(ASTPool));
+    pool_new_node(pool);    // reserved AST_NO_NODE slot
+    pool->type[0] = 0;
+    pool->op[0] = AST_OP_NONE;
+    pool->line[0] = pool->column[0] = 0;
+    pool->value[0] = pool->lhs[0] = pool->rhs[0] = 0;
+
+    PoolBuilder b = { pool, NULL, NULL, 0, NULL, 0, 0 };
+    pool->root = AST_NO_NODE;
+    ast_walk(root, pool_enter, pool_leave, &b);
+    free(b.keys);
+    free(b.ids);
+    free(b.stack);
+    return pool;
+}
+
+ASTNode* ast_pool_to_tree(const ASTPool *pool, ASTIndex index, Arena *arena)
+{
+    // each pending node goes into its parent's child list, or into a slot
+    typedef struct
+    {
+        ASTIndex index;
+        ASTNode *parent;
+        ASTNode **slot;
+    } Pending;
+
+    ASTNode *root = NULL;
+    if (index == AST_NO_NODE) return root;
+
+    size_t count = 0, capacity = 64;
+    Pending *stack = malloc(sizeof(Pending) * capacity);
+    stack[count++] = (Pending){ index, NULL, &root };
+    while (count > 0)
+    {
+        Pending top = stack[--count];
+        ASTIndex i = top.index;
+        ASTNode *node = ast_create(arena, (ASTNodeType)pool->type[i], pool->line[i], pool->column[i]);
+        node->op = (ASTOperator)pool->op[i];
+        node->string_value = ast_pool_string(pool, i);
+        node->number_value = ast_pool_number(pool, i);
+        if (top.parent)
+            ast_add_child(arena, top.parent, node);
+        else
+            *top.slot = node;
+
+        uint32_t pushes = ast_pool_has_children(node->type) ? pool->rhs[i] : 2;
+        if (count + pushes > capacity)
+        {
+            while (count + pushes > capacity) capacity *= 2;
+            stack = realloc(stack, sizeof(Pending) * capacity);
+        }
+
+        if (ast_pool_has_children(node->type))
+        {
+            // reversed, so they come off the stack in order
+            for (uint32_t c = pool->rhs[i]; c > 0; c--)
+                stack[count++] = (Pending){ pool->lists[pool->lhs[i] + c - 1], node, NULL };
+        } else
+        {
+            if (pool->rhs[i] != AST_NO_NODE) stack[count++] = (Pending){ pool->rhs[i], NULL, &node->right };
+            if (pool->lhs[i] != AST_NO_NODE) stack[count++] = (Pending){ pool->lhs[i], NULL, &node->left };
+        }
+    }
+    free(stack);
+    return root;
+}
+
+void ast_pool_print(const ASTPool *pool, ASTIndex index, int depth)
+{
+    typedef struct
+    {
+        ASTIndex index;
+        int depth;
+    } Pending;
+
+    if (index == AST_NO_NODE) return;
+
+    // an explicit stack, so deep trees print like shallow ones (see ast_walk)
+    size_t count = 0, capacity = 64;
+    Pending *stack = malloc(sizeof(Pending) * capacity);
+    stack[count++] = (Pending){ index, depth };
+    while (count > 0)
+    {
+        Pending top = stack[--count];
+        ASTIndex i = top.index;
+        ASTNodeType type = (ASTNodeType)pool->type[i];
+        ast_print_line(top.depth, type, pool->line[i], pool->column[i],
+            ast_pool_string(pool, i), (ASTOperator)pool->op[i], ast_pool_number(pool, i));
+
+        uint32_t pushes = ast_pool_has_children(type) ? pool->rhs[i] : 2;
+        if (count + pushes > capacity)
+        {
+            while (count + pushes > capacity) capacity *= 2;
+            stack = realloc(stack, sizeof(Pending) * capacity);
+        }
+
+        if (ast_pool_has_children(type))
+        {
+            // reversed, so they come off the stack in order
+            for (uint32_t c = pool->rhs[i]; c > 0; c--)
+                stack[count++] = (Pending){ pool->lists[pool->lhs[i] + c - 1], top.depth + 1 };
+        }
+        else if (type != AST_BINARY_OP && type != AST_CALL && type != AST_MEMBER_ACCESS)
+        {
+            // same as ast_print, operands of these three are not shown
+            if (pool->rhs[i] != AST_NO_NODE) stack[count++] = (Pending){ pool->rhs[i], top.depth + 1 };
+            if (pool->lhs[i] != AST_NO_NODE) stack[count++] = (Pending){ pool->lhs[i], top.depth + 1 };
+        }
+    }
+    free(stack);
+}
+
+size_t ast_pool_bytes(const ASTPool *pool)
+{
+    size_t per_node = sizeof(uint8_t) * 2 + sizeof(int32_t) * 2 + sizeof(uint32_t) * 3;
+    return sizeof(ASTPool)
+        + per_node * pool->count
+        + sizeof(ASTIndex) * pool->list_count
+        + sizeof(const char *) * pool->string_count
+        + sizeof(double) * pool->number_count;
+}
+
+void ast_pool_free(ASTPool *pool)
+{
+    if (!pool) return;
+
+    free(pool->type);
+    free(pool->op);
+    free(pool->line);
+    free(pool->column);
+    free(pool->value);
+    free(pool->lhs);
+    free(pool->rhs);
+    free(pool->lists);
+    free(pool->strings);
+    free(pool->numbers);
+    free(pool);
+}
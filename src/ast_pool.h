@@ -0,0 +1,80 @@
+#ifndef AST_POOL_H
+#define AST_POOL_H
+
+#include "ast.h"
+#include <stdint.h>
+
+// Compact layout of an AST: every node is one slot across parallel arrays,
+// addressed by a 32-bit index, stored in pre-order. Operators are enums and
+// literals live in side tables, so a node costs 22 bytes plus 4 per child.
+typedef uint32_t ASTIndex;
+
+// slot 0 is reserved so that 0 can mean "no node"
+#define AST_NO_NODE 0
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t capacity;
+    ASTIndex root;
+
+    uint8_t *type;          // ASTNodeType
+    uint8_t *op;            // ASTOperator
+    int32_t *line;
+    int32_t *column;
+    uint32_t *value;        // strings[] or numbers[] index + 1, 0 for none
+    uint32_t *lhs;          // left operand, or first entry in lists[]
+    uint32_t *rhs;          // right operand, or number of children
+
+    ASTIndex *lists;        // each node's children, contiguous
+    uint32_t list_count;
+    uint32_t list_capacity;
+
+    const char **strings;   // interned, each distinct string once
+    uint32_t string_count;
+    uint32_t string_capacity;
+
+    // Without strings, string i starts at string_bytes + string_ends[i - 1]
+    // (0 for the first) instead: a pool read in place (ast_binary.h)
+    const char *string_bytes;
+    const uint32_t *string_ends;
+
+    double *numbers;
+    uint32_t number_count;
+    uint32_t number_capacity;
+} ASTPool;
+
+// Node types that keep a list of children, the rest use lhs/rhs as left/right
+static inline bool ast_pool_has_children(ASTNodeType type)
+{
+    switch (type)
+    {
+        case AST_PROGRAM: case AST_IMPORT: case AST_DECLARATION: case AST_IF_STMT:
+        case AST_BLOCK: case AST_FUNCTION_DEF: case AST_ARGUMENTS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+ASTPool* ast_pool_from_tree(ASTNode *root);
+ASTNode* ast_pool_to_tree(const ASTPool *pool, ASTIndex index, Arena *arena);
+void ast_pool_print(const ASTPool *pool, ASTIndex index, int depth);
+size_t ast_pool_bytes(const ASTPool *pool);
+void ast_pool_free(ASTPool *pool);
+
+static inline const char* ast_pool_string(const ASTPool *pool, ASTIndex index)
+{
+    uint32_t value = pool->value[index];
+    if (!value || pool->type[index] == AST_NUMBER) return NULL;
+    if (pool->strings) return pool->strings[value - 1];
+    return pool->string_bytes + (value > 1 ? pool->string_ends[value - 2] : 0);
+}
+
+static inline double ast_pool_number(const ASTPool *pool, ASTIndex index)
+{
+    uint32_t value = pool->value[index];
+    return value && pool->type[index] == AST_NUMBER ? pool->numbers[value - 1] : 0;
+}
+
+#endif //AST_POOL_H
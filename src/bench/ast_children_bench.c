@@ -0,0 +1,49 @@
+// Building a PROGRAM of N statements: the old realloc-per-child scheme against
+// ast_add_child's capacity doubling, on the heap and in an arena. Statements
+// are created between appends the way the parser does, so realloc cannot just
+// keep extending the children array in place.
+
+#include "../ast.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// what ast_add_child used to do
+static void legacy_add_child(ASTNode *parent, ASTNode *child)
+{
+    parent->children = realloc(parent->children, sizeof(ASTNode*) * (parent->num_children + 1));
+    parent->children[parent->num_children++] = child;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    double start = bench_now();
+    ASTNode *program = ast_create(NULL, AST_PROGRAM, 1, 0);
+    for (int i = 0; i < count; i++)
+        legacy_add_child(program, ast_create(NULL, AST_EXPR, i + 1, 0));
+    double legacy = bench_now() - start;
+    ast_free(program);
+
+    start = bench_now();
+    program = ast_create(NULL, AST_PROGRAM, 1, 0);
+    for (int i = 0; i < count; i++)
+        ast_add_child(NULL, program, ast_create(NULL, AST_EXPR, i + 1, 0));
+    double heap = bench_now() - start;
+    ast_free(program);
+
+    start = bench_now();
+    Arena *arena = arena_create();
+    program = ast_create(arena, AST_PROGRAM, 1, 0);
+    for (int i = 0; i < count; i++)
+        ast_add_child(arena, program, ast_create(arena, AST_EXPR, i + 1, 0));
+    double in_arena = bench_now() - start;
+    arena_free(arena);
+
+    printf("%d statements appended to one PROGRAM\n", count);
+    printf("realloc per child:         %8.2f ms\n", legacy * 1e3);
+    printf("capacity doubling, heap:   %8.2f ms\n", heap * 1e3);
+    printf("capacity doubling, arena:  %8.2f ms\n", in_arena * 1e3);
+    return 0;
+}
@@ -0,0 +1,141 @@
+// Pointer-based ASTNode trees against the index-based ASTPool layout: bytes
+// per node and full-tree traversal speed over the same parsed program.
+
+#include "../parser.h"
+#include "../ast_pool.h"
+#include "../intern.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *script_body =
+    "new device USB%d as Mouse;\n"
+    "USB%d.connect();\n"
+    "if (USB%d.status() == \"connected\") then {\n"
+    "    USB%d.write(header=\"KEY-UP\", payload=\"LEFT\");\n"
+    "    USB%d.write(header=\"KEY-DOWN\", payload=\"LEFT\");\n"
+    "} else {\n"
+    "    log(\"MOUSE not detected, aborting.\");\n"
+    "};\n";
+
+static char* make_script(int copies, size_t *length)
+{
+    size_t capacity = (strlen(script_body) + 64) * (size_t)copies + 1;
+    char *source = malloc(capacity);
+    size_t used = 0;
+    for (int i = 0; i < copies; i++)
+    {
+        int n = i % 8;
+        used += (size_t)snprintf(source + used, capacity - used, script_body, n, n, n, n, n);
+    }
+    *length = used;
+    return source;
+}
+
+static size_t tree_bytes(ASTNode *node, size_t *nodes)
+{
+    if (!node) return 0;
+
+    (*nodes)++;
+    size_t bytes = sizeof(ASTNode) + sizeof(ASTNode*) * (size_t)node->capacity;
+    for (int i = 0; i < node->num_children; i++)
+        bytes += tree_bytes(node->children[i], nodes);
+    return bytes + tree_bytes(node->left, nodes) + tree_bytes(node->right, nodes);
+}
+
+static unsigned long tree_walk(ASTNode *node)
+{
+    if (!node) return 0;
+
+    unsigned long sum = (unsigned long)node->line + node->type;
+    for (int i = 0; i < node->num_children; i++)
+        sum += tree_walk(node->children[i]);
+    return sum + tree_walk(node->left) + tree_walk(node->right);
+}
+
+static unsigned long pool_walk(const ASTPool *pool, ASTIndex index)
+{
+    if (index == AST_NO_NODE) return 0;
+
+    unsigned long sum = (unsigned long)pool->line[index] + pool->type[index];
+    if (ast_pool_has_children((ASTNodeType)pool->type[index]))
+    {
+        const ASTIndex *children = pool->lists + pool->lhs[index];
+        for (uint32_t i = 0; i < pool->rhs[index]; i++)
+            sum += pool_walk(pool, children[i]);
+        return sum;
+    }
+    return sum + pool_walk(pool, pool->lhs[index]) + pool_walk(pool, pool->rhs[index]);
+}
+
+// nodes are in pre-order, so visiting all of them is a plain scan
+static unsigned long pool_scan(const ASTPool *pool)
+{
+    unsigned long sum = 0;
+    for (uint32_t i = 1; i < pool->count; i++)
+        sum += (unsigned long)pool->line[i] + pool->type[i];
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    int copies = argc > 1 ? atoi(argv[1]) : 50000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+    size_t length;
+    char *source = make_script(copies, &length);
+    Lexer *lx = lexerInitBuffer(source, length);
+    Parser *p = parser_init(lx);
+    ASTNode *program = parser_parse(p);
+
+    ASTPool *pool = ast_pool_from_tree(program);
+
+    size_t nodes = 0;
+    size_t bytes = tree_bytes(program, &nodes);
+    if (nodes != pool->count - 1)
+    {
+        fprintf(stderr, "node count mismatch: %zu vs %u\n", nodes, pool->count - 1);
+        return 1;
+    }
+
+    double start = bench_now();
+    unsigned long tree_sum = 0;
+    for (int r = 0; r < rounds; r++)
+        tree_sum += tree_walk(program);
+    double tree_time = bench_now() - start;
+
+    start = bench_now();
+    unsigned long walk_sum = 0;
+    for (int r = 0; r < rounds; r++)
+        walk_sum += pool_walk(pool, pool->root);
+    double walk_time = bench_now() - start;
+
+    start = bench_now();
+    unsigned long scan_sum = 0;
+    for (int r = 0; r < rounds; r++)
+        scan_sum += pool_scan(pool);
+    double scan_time = bench_now() - start;
+
+    if (tree_sum != walk_sum || tree_sum != scan_sum)
+    {
+        fprintf(stderr, "traversal mismatch\n");
+        return 1;
+    }
+    bench_sink = tree_sum;
+
+    double visits = (double)nodes * rounds;
+    printf("%zu nodes\n", nodes);
+    printf("ASTNode tree: %6.1f bytes/node  %6.2f ns/node\n",
+        (double)bytes / nodes, tree_time * 1e9 / visits);
+    printf("ASTPool walk: %6.1f bytes/node  %6.2f ns/node\n",
+        (double)ast_pool_bytes(pool) / nodes, walk_time * 1e9 / visits);
+    printf("ASTPool scan: %6s            %6.2f ns/node\n", "", scan_time * 1e9 / visits);
+
+    ast_pool_free(pool);
+    parser_free(p);
+    lexerFree(lx);
+    free(source);
+    intern_clear();
+    return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <time.h>
+
+// CPU seconds, good enough for the relative numbers these benchmarks report
+static inline double bench_now(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+// keeps the optimizer from discarding results the benchmark never reads
+static volatile unsigned long bench_sink;
+
+#endif //BENCH_H
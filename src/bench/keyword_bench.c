@@ -0,0 +1,113 @@
+// Keyword classification: generated perfect hash (lexerKeyword) against the
+// linear strcasecmp scan the lexer used to do, both over the full vocabulary.
+
+#include "../lexer.h"
+#include "../keywords.h"
+#include "../compat.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    const char *name;
+    TokenType type;
+} Keyword;
+
+#define KEYWORD_ENTRY(name, type) { name, type },
+static const Keyword keywords[] = {
+    QK_KEYWORDS(KEYWORD_ENTRY)
+    { NULL, TOK_UNKNOWN }
+};
+#undef KEYWORD_ENTRY
+
+// the old lexerIdentifier lookup, scaled up to every keyword
+static TokenType linear_lookup(const char *text, size_t length)
+{
+    char buf[256];
+    memcpy(buf, text, length);
+    buf[length] = '\0';
+
+    for (int i = 0; keywords[i].name; i++)
+    {
+        if (strcasecmp(buf, keywords[i].name) == 0)
+            return keywords[i].type;
+    }
+    return TOK_IDENTIFIER;
+}
+
+// identifiers that show up in device scripts next to the keywords
+static const char *identifiers[] = {
+    "USB1", "USB2", "Mouse", "Keyboard", "payload", "KEY_UP", "firmware_blob",
+    "retries", "x", "deviceName", "port_a", "Headers", "statuses", "connected",
+    "logger", "i", "counter", "LEFT", "RIGHT", "blink_led",
+};
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 20000;
+
+    // every keyword in two spellings plus as many plain identifiers
+    size_t num_keywords = sizeof(keywords) / sizeof(keywords[0]) - 1;
+    size_t num_identifiers = sizeof(identifiers) / sizeof(identifiers[0]);
+    size_t num_words = num_keywords * 2 + num_identifiers * 8;
+    char **words = malloc(num_words * sizeof(char *));
+    size_t *lengths = malloc(num_words * sizeof(size_t));
+
+    size_t n = 0;
+    for (size_t i = 0; i < num_keywords; i++)
+    {
+        words[n++] = strdup(keywords[i].name);
+        char *upper = strdup(keywords[i].name);
+        upper[0] = (char)(upper[0] & ~0x20);
+        words[n++] = upper;
+    }
+    for (size_t r = 0; r < 8; r++)
+    {
+        for (size_t i = 0; i < num_identifiers; i++)
+            words[n++] = strdup(identifiers[i]);
+    }
+    for (size_t i = 0; i < n; i++)
+        lengths[i] = strlen(words[i]);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (lexerKeyword(words[i], lengths[i]) != linear_lookup(words[i], lengths[i]))
+        {
+            fprintf(stderr, "mismatch on '%s'\n", words[i]);
+            return 1;
+        }
+    }
+
+    unsigned long sum = 0;
+    double start = bench_now();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < n; i++)
+            sum += (unsigned long)linear_lookup(words[i], lengths[i]);
+    }
+    double linear = bench_now() - start;
+
+    start = bench_now();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < n; i++)
+            sum += (unsigned long)lexerKeyword(words[i], lengths[i]);
+    }
+    double hashed = bench_now() - start;
+    bench_sink = sum;
+
+    double lookups = (double)rounds * (double)n;
+    printf("%zu keywords, %.0f lookups\n", num_keywords, lookups);
+    printf("linear strcasecmp: %8.2f ns/lookup\n", linear * 1e9 / lookups);
+    printf("perfect hash:      %8.2f ns/lookup\n", hashed * 1e9 / lookups);
+    if (hashed > 0)
+        printf("speedup:           %8.1fx\n", linear / hashed);
+
+    for (size_t i = 0; i < n; i++)
+        free(words[i]);
+    free(words);
+    free(lengths);
+    return 0;
+}
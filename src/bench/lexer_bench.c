@@ -0,0 +1,89 @@
+// Lexer throughput over a generated script with the shapes that dominate our
+// generated code: long string payloads, long // comment blocks and indented
+// member calls.
+
+#include "../lexer.h"
+#include "../thread.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *script_body =
+    "// ----------------------------------------------------------------------------\n"
+    "// Replay block %d generated from capture, do not edit by hand. Timing taken\n"
+    "// from the recorded session, payloads are the raw HID reports as strings.\n"
+    "// ----------------------------------------------------------------------------\n"
+    "new device USB%d as Keyboard;\n"
+    "if (USB%d.status() == \"connected\") then {\n"
+    "        USB%d.write(header=\"KEY-DOWN\", payload=\"0x00,0x00,0x04,0x00,0x00,0x00,0x00,0x00 0x00,0x00,0x05,0x00,0x00,0x00,0x00,0x00\");\n"
+    "        USB%d.write(header=\"KEY-UP\", payload=\"0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00 \\\"released\\\" after 12.5 ms\");\n"
+    "} else {\n"
+    "        log(\"device USB%d not detected, skipping replay block %d\");\n"
+    "};\n";
+
+int main(int argc, char **argv)
+{
+    int copies = argc > 1 ? atoi(argv[1]) : 20000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+    size_t capacity = (strlen(script_body) + 128) * (size_t)copies + 1;
+    char *source = malloc(capacity);
+    size_t length = 0;
+    for (int i = 0; i < copies; i++)
+    {
+        int n = i % 8;
+        length += (size_t)snprintf(source + length, capacity - length, script_body, i, n, n, n, n, n, i);
+    }
+
+    unsigned long tokens = 0;
+    double start = bench_now();
+    for (int r = 0; r < rounds; r++)
+    {
+        Lexer *lx = lexerInitBuffer(source, length);
+        for (;;)
+        {
+            Token tok = lexerNextToken(lx);
+            tokens += tok.type;
+            if (tok.type == TOK_EOF) break;
+        }
+        lexerFree(lx);
+    }
+    double elapsed = bench_now() - start;
+
+    start = bench_now();
+    for (int r = 0; r < rounds; r++)
+    {
+        Lexer *lx = lexerInitBuffer(source, length);
+        TokenStream *ts = lexerTokenizeAll(lx);
+        tokens += ts->count;
+        lexerFreeTokens(ts);
+        lexerFree(lx);
+    }
+    double batch = bench_now() - start;
+
+    // wall clock here, CPU time would add up across the threads
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+    struct timespec t0, t1;
+    timespec_get(&t0, TIME_UTC);
+    for (int r = 0; r < rounds; r++)
+    {
+        TokenStream *ts = lexerTokenizeParallel(source, length, threads);
+        tokens += ts->count;
+        lexerFreeTokens(ts);
+    }
+    timespec_get(&t1, TIME_UTC);
+    double parallel = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    bench_sink = tokens;
+
+    double bytes = (double)length * rounds;
+    printf("%zu bytes x %d rounds\n", length, rounds);
+    printf("lexerNextToken:   %8.1f MB/s\n", bytes / elapsed / 1e6);
+    printf("lexerTokenizeAll: %8.1f MB/s\n", bytes / batch / 1e6);
+    printf("lexerTokenizeParallel (%d threads): %8.1f MB/s\n",
+        threads > 0 ? threads : thread_hardware_count(), bytes / parallel / 1e6);
+
+    free(source);
+    return 0;
+}
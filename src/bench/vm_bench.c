@@ -0,0 +1,131 @@
+// Bytecode interpreter throughput over a generated script: arithmetic on
+// globals, conditionals and device calls. First against a backend that does
+// nothing, so the numbers are the VM's own dispatch and operand handling, then
+// against the device simulator with method calls resolved by name on every
+// call and through the call sites' inline caches.
+
+#include "../compiler.h"
+#include "../device_sim.h"
+#include "../intern.h"
+#include "../parser.h"
+#include "../vm.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *script_body =
+    "x = x + %d * 2 - y / 4;\n"
+    "y = (x %% 7 + 3) * (y - 1) / 2;\n"
+    "if (x > y and not (y == 0)) then {\n"
+    "    USB%d.write(header=\"KEY-DOWN\", payload=\"A\");\n"
+    "    count = count + 1;\n"
+    "} else {\n"
+    "    y = y + 1;\n"
+    "};\n"
+    "if (USB%d.status() == \"connected\") then {\n"
+    "    total = total + x - y;\n"
+    "};\n";
+
+static int null_open(void *ctx, const char *type, const char *name, const char *alias)
+{
+    (void)ctx; (void)type; (void)name; (void)alias;
+    return 0;
+}
+
+static int null_call(void *ctx, int device, const char *method, const Value *args, const char *const *names,
+    int argc, Value *result)
+{
+    (void)ctx; (void)device; (void)args; (void)names; (void)argc;
+    if (method[0] == 's')
+        *result = (Value){ VALUE_STRING, { .string = intern_cstr("connected") } };
+    return 0;
+}
+
+// seconds for rounds runs of code on a fresh VM over backend
+static double time_runs(const DeviceBackend *backend, ASTNode *program, int rounds, uint64_t *instructions,
+    size_t *count)
+{
+    VM *vm = vm_create(backend);
+    Diagnostics errors;
+    diagnostics_init(&errors);
+    Bytecode *code = compiler_compile(program, vm, &errors);
+    if (!code)
+    {
+        diagnostics_print(&errors, stderr, "Compile error");
+        exit(1);
+    }
+
+    double start = bench_now();
+    for (int r = 0; r < rounds; r++)
+    {
+        if (vm_run(vm, code) != 0)
+        {
+            fprintf(stderr, "Runtime error: %s\n", vm_error(vm)->message);
+            exit(1);
+        }
+    }
+    double elapsed = bench_now() - start;
+    bench_sink = (unsigned long)vm_global(vm, intern_cstr("count")).as.number;
+
+    *instructions = vm_instructions(vm);
+    *count = code->count;
+    bytecode_free(code);
+    diagnostics_free(&errors);
+    vm_free(vm);
+    return elapsed;
+}
+
+static void report(const char *what, double elapsed, uint64_t instructions)
+{
+    printf("%-24s %8.1f M instructions/s (%.1f ns each)\n", what, (double)instructions / elapsed / 1e6,
+        elapsed / (double)instructions * 1e9);
+}
+
+int main(int argc, char **argv)
+{
+    int copies = argc > 1 ? atoi(argv[1]) : 5000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+
+    size_t capacity = (strlen(script_body) + 64) * (size_t)copies + 256;
+    char *source = malloc(capacity);
+    size_t length = (size_t)snprintf(source, capacity, "x = 1;\ny = 2;\ncount = 0;\ntotal = 0;\n");
+    for (int i = 0; i < 8; i++)
+    {
+        length += (size_t)snprintf(source + length, capacity - length,
+            "new device USB%d as %s;\nUSB%d.connect();\n", i, i % 2 ? "Keyboard" : "Mouse", i);
+    }
+    for (int i = 0; i < copies; i++)
+        length += (size_t)snprintf(source + length, capacity - length, script_body, i % 100, i % 8, i % 8);
+
+    Lexer *lx = lexerInitBuffer(source, length);
+    Parser *p = parser_init(lx);
+    ASTNode *program = parser_parse(p);
+    if (p->error_count > 0)
+    {
+        diagnostics_print(&p->diagnostics, stderr, "Parse error");
+        return 1;
+    }
+
+    uint64_t instructions;
+    size_t count;
+    DeviceBackend null_backend = { NULL, null_open, null_call, NULL, NULL, NULL, NULL };
+    double elapsed = time_runs(&null_backend, program, rounds, &instructions, &count);
+    printf("%zu instructions x %d rounds\n", count, rounds);
+    report("vm_run:", elapsed, instructions);
+
+    DeviceSim *sim = device_sim_create(NULL);
+    DeviceBackend cached = device_sim_backend(sim);
+    DeviceBackend by_name = cached;
+    by_name.bind = NULL;
+    elapsed = time_runs(&by_name, program, rounds, &instructions, &count);
+    report("simulator, by name:", elapsed, instructions);
+    elapsed = time_runs(&cached, program, rounds, &instructions, &count);
+    report("simulator, cached:", elapsed, instructions);
+    device_sim_free(sim);
+
+    parser_free(p);
+    lexerFree(lx);
+    free(source);
+    return 0;
+}
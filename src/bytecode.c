@@ -0,0 +1,14 @@
+#include "bytecode.h"
+#include <stdlib.h>
+
+void bytecode_free(Bytecode *code)
+{
+    if (!code) return;
+    free(code->code);
+    free(code->lines);
+    free(code->constants);
+    free(code->calls);
+    free(code->arg_names);
+    free(code->declarations);
+    free(code);
+}
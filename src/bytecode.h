@@ -0,0 +1,144 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+    VALUE_NIL,
+    VALUE_BOOL,
+    VALUE_NUMBER,
+    VALUE_STRING,
+    VALUE_DEVICE,
+} ValueType;
+
+typedef struct
+{
+    ValueType type;
+    union
+    {
+        bool boolean;
+        double number;
+        const char *string;     // interned
+        int device;             // handle from the device backend
+    } as;
+} Value;
+
+// A method as a device backend implements it, what call sites cache (vm.h)
+typedef int (*DeviceMethod)(void *ctx, int device, const Value *args, const char *const *names, int argc,
+    Value *result);
+
+// Register machine: every instruction is 32 bits, the opcode in the low byte
+// and then either A, B, C one byte each, A and a 16-bit Bx, or a signed
+// 24-bit sAx. Operands too wide for that follow in the next word (the X
+// forms, jumps on a condition, calls).
+//
+//  LOADNIL A           R[A] = nil
+//  LOADBOOL A B        R[A] = B != 0
+//  LOADK A Bx          R[A] = K[Bx]            LOADKX A, w: K[w]
+//  MOVE A B            R[A] = R[B]
+//  GETG A Bx           R[A] = G[Bx]            GETGX A, w: G[w]
+//  SETG A Bx           G[Bx] = R[A]            SETGX A, w: G[w]
+//  ADD..GE A B C       R[A] = R[B] op R[C]
+//  XOR, XNOR A B C     on truthiness
+//  NOT A B, NEG A B, TRUTH A B (R[A] = truthiness of R[B])
+//  JMP sAx             pc += sAx, from the next instruction
+//  JMPF A, w           if not R[A]: pc += (int32)w, from after w
+//  JMPT A, w           if R[A]: likewise
+//  NEW A, w            R[A] = backend open of declaration w
+//  CALL A, w           R[A] = R[A].method(R[A+1] ... R[A+argc]), call site w
+//  CALLF A, w          R[A] = function(R[A+1] ... R[A+argc]), call site w
+//  HALT
+#define BYTECODE_OPS(X) \
+    X(LOADNIL) X(LOADBOOL) X(LOADK) X(LOADKX) X(MOVE) \
+    X(GETG) X(GETGX) X(SETG) X(SETGX) \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(MOD) \
+    X(EQ) X(NE) X(LT) X(GT) X(LE) X(GE) X(XOR) X(XNOR) \
+    X(NOT) X(NEG) X(TRUTH) \
+    X(JMP) X(JMPF) X(JMPT) \
+    X(NEW) X(CALL) X(CALLF) X(HALT)
+
+typedef enum
+{
+#define BYTECODE_ENUM(name) OP_##name,
+    BYTECODE_OPS(BYTECODE_ENUM)
+#undef BYTECODE_ENUM
+    OP_COUNT
+} Opcode;
+
+typedef uint32_t Instruction;
+
+#define BC_OP(i) ((Opcode)((i) & 0xFF))
+#define BC_A(i) (((i) >> 8) & 0xFF)
+#define BC_B(i) (((i) >> 16) & 0xFF)
+#define BC_C(i) ((i) >> 24)
+#define BC_BX(i) ((i) >> 16)
+#define BC_SAX(i) ((int32_t)(i) >> 8)
+
+#define BC_ABC(op, a, b, c) ((Instruction)(op) | (Instruction)(a) << 8 | (Instruction)(b) << 16 | (Instruction)(c) << 24)
+#define BC_ABX(op, a, bx) ((Instruction)(op) | (Instruction)(a) << 8 | (Instruction)(bx) << 16)
+#define BC_SAX_MAX 0x7FFFFF
+
+// Device types a method call site remembers the bound method for. A site
+// that meets more types than this stops caching and binds on every call.
+#define CALL_CACHE_WAYS 4
+
+typedef struct
+{
+    int type;
+    DeviceMethod method;
+} CallCacheEntry;
+
+// A device or function call: the names of its arguments, NULL for the
+// positional ones, sit at arg_names[first_name ...]. Method calls keep an
+// inline cache of what name bound to on the device types seen so far, valid
+// for one binding epoch of the backend.
+typedef struct
+{
+    const char *name;       // method or function, interned
+    uint32_t first_name;
+    uint8_t argc;
+    uint8_t cached;         // entries in cache, CALL_CACHE_WAYS + 1 once megamorphic
+    uint32_t epoch;
+    CallCacheEntry cache[CALL_CACHE_WAYS];
+} CallSite;
+
+typedef struct
+{
+    const char *type;
+    const char *name;
+    const char *alias;
+} DeclarationSite;
+
+// A compiled script. Globals are slots of the VM it was compiled for.
+typedef struct
+{
+    Instruction *code;
+    int *lines;             // source line of each word of code
+    size_t count;
+    size_t capacity;
+
+    Value *constants;
+    uint32_t constant_count;
+    uint32_t constant_capacity;
+
+    CallSite *calls;
+    uint32_t call_count;
+    uint32_t call_capacity;
+
+    const char **arg_names;
+    uint32_t arg_name_count;
+    uint32_t arg_name_capacity;
+
+    DeclarationSite *declarations;
+    uint32_t declaration_count;
+    uint32_t declaration_capacity;
+
+    int registers;          // highest register used + 1
+} Bytecode;
+
+void bytecode_free(Bytecode *code);
+
+#endif //BYTECODE_H
@@ -6,10 +6,30 @@
 #define COMPAT_H
 
 #ifdef _WIN32
+    #include <stdlib.h>
     #include <string.h>
+    #include <direct.h>
+    #include <io.h>
     #define strcasecmp _stricmp
+    #define compat_mkdir(path) _mkdir(path)
+    #define compat_rmdir(path) _rmdir(path)
+    #define compat_dup(fd) _dup(fd)
+    #define compat_dup2(fd, to) _dup2((fd), (to))
+    #define compat_close(fd) _close(fd)
+    #define compat_realpath(path) _fullpath(NULL, (path), 0)
+    #define COMPAT_NULL_DEVICE "NUL"
 #else
+    #include <stdlib.h>
     #include <strings.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define compat_mkdir(path) mkdir((path), 0777)
+    #define compat_rmdir(path) rmdir(path)
+    #define compat_dup(fd) dup(fd)
+    #define compat_dup2(fd, to) dup2((fd), (to))
+    #define compat_close(fd) close(fd)
+    #define compat_realpath(path) realpath((path), NULL)
+    #define COMPAT_NULL_DEVICE "/dev/null"
 #endif
 
 #endif //COMPAT_H
@@ -0,0 +1,517 @@
+#include "compiler.h"
+#include "intern.h"
+#include <stdlib.h>
+#include <string.h>
+
+// recursion left once operator chains are flattened: nested blocks, member chains
+#define COMPILER_MAX_DEPTH 1000
+
+typedef struct
+{
+    uint64_t bits;
+    ValueType type;
+    uint32_t index;     // + 1, 0 for an empty slot
+} ConstantSlot;
+
+typedef struct
+{
+    Bytecode *code;
+    VM *vm;
+    Diagnostics *errors;
+    int error_count;
+    int top;            // first free register
+    int depth;
+    int line;           // of the node being compiled
+    const char *true_name;     // value of a true AST_BOOLEAN
+
+    ConstantSlot *constants;    // deduplication, open addressing on the value
+    uint32_t constant_capacity;
+} Compiler;
+
+static void compiler_error(Compiler *c, const ASTNode *node, const char *msg)
+{
+    diagnostics_add(c->errors, node->line, node->column, msg);
+    c->error_count++;
+}
+
+static size_t compiler_emit(Compiler *c, Instruction instruction)
+{
+    Bytecode *code = c->code;
+    if (code->count == code->capacity)
+    {
+        code->capacity = code->capacity ? code->capacity * 2 : 256;
+        code->code = realloc(code->code, sizeof(Instruction) * code->capacity);
+        code->lines = realloc(code->lines, sizeof(int) * code->capacity);
+    }
+    code->code[code->count] = instruction;
+    code->lines[code->count] = c->line;
+    return code->count++;
+}
+
+// an instruction taking a register and a 16-bit operand, or the next word when wider
+static void compiler_emit_wide(Compiler *c, Opcode op, Opcode wide, int a, uint32_t operand)
+{
+    if (operand <= 0xFFFF)
+    {
+        compiler_emit(c, BC_ABX(op, a, operand));
+        return;
+    }
+    compiler_emit(c, BC_ABX(wide, a, 0));
+    compiler_emit(c, operand);
+}
+
+static uint64_t compiler_value_bits(Value value)
+{
+    uint64_t bits = 0;
+    if (value.type == VALUE_NUMBER)
+        memcpy(&bits, &value.as.number, sizeof(bits));
+    else if (value.type == VALUE_STRING)
+        bits = (uint64_t)(uintptr_t)value.as.string;
+    return bits;
+}
+
+static uint32_t compiler_constant(Compiler *c, Value value)
+{
+    Bytecode *code = c->code;
+    if ((code->constant_count + 1) * 4 > c->constant_capacity * 3)
+    {
+        ConstantSlot *old = c->constants;
+        uint32_t old_capacity = c->constant_capacity;
+        c->constant_capacity = old_capacity ? old_capacity * 2 : 64;
+        c->constants = calloc(c->constant_capacity, sizeof(ConstantSlot));
+        for (uint32_t i = 0; i < old_capacity; i++)
+        {
+            if (!old[i].index) continue;
+            uint32_t slot = (uint32_t)((old[i].bits * 0x9E3779B97F4A7C15ull) >> 32) & (c->constant_capacity - 1);
+            while (c->constants[slot].index)
+                slot = (slot + 1) & (c->constant_capacity - 1);
+            c->constants[slot] = old[i];
+        }
+        free(old);
+    }
+
+    uint64_t bits = compiler_value_bits(value);
+    uint32_t slot = (uint32_t)((bits * 0x9E3779B97F4A7C15ull) >> 32) & (c->constant_capacity - 1);
+    while (c->constants[slot].index)
+    {
+        if (c->constants[slot].bits == bits && c->constants[slot].type == value.type)
+            return c->constants[slot].index - 1;
+        slot = (slot + 1) & (c->constant_capacity - 1);
+    }
+
+    if (code->constant_count == code->constant_capacity)
+    {
+        code->constant_capacity = code->constant_capacity ? code->constant_capacity * 2 : 64;
+        code->constants = realloc(code->constants, sizeof(Value) * code->constant_capacity);
+    }
+    code->constants[code->constant_count] = value;
+    c->constants[slot] = (ConstantSlot){ bits, value.type, code->constant_count + 1 };
+    return code->constant_count++;
+}
+
+// -1 when out of registers
+static int compiler_reserve(Compiler *c, const ASTNode *node)
+{
+    if (c->top >= VM_REGISTERS)
+    {
+        compiler_error(c, node, "Expression needs too many registers");
+        return -1;
+    }
+    if (c->top + 1 > c->code->registers)
+        c->code->registers = c->top + 1;
+    return c->top++;
+}
+
+// jumps only ever go forward, from the end of the jump
+static void compiler_jump_to(Compiler *c, const ASTNode *node, size_t from, size_t to)
+{
+    Instruction *at = &c->code->code[from];
+    if (BC_OP(*at) == OP_JMP)
+    {
+        if (to - from - 1 > BC_SAX_MAX)
+            compiler_error(c, node, "Branch too long to compile");
+        *at = BC_ABX(OP_JMP, 0, 0) | (Instruction)(to - from - 1) << 8;
+    } else
+    {
+        at[1] = (Instruction)(to - from - 2);
+    }
+}
+
+static size_t compiler_emit_branch(Compiler *c, Opcode op, int a)
+{
+    size_t at = compiler_emit(c, BC_ABX(op, a, 0));
+    compiler_emit(c, 0);
+    return at;
+}
+
+static void compiler_expression(Compiler *c, ASTNode *node, int dst);
+
+static Opcode compiler_binary_op(ASTOperator op)
+{
+    switch (op)
+    {
+        case AST_OP_ADD: return OP_ADD;
+        case AST_OP_SUB: return OP_SUB;
+        case AST_OP_MUL: return OP_MUL;
+        case AST_OP_DIV: return OP_DIV;
+        case AST_OP_MOD: return OP_MOD;
+        case AST_OP_EQ: return OP_EQ;
+        case AST_OP_NE: return OP_NE;
+        case AST_OP_LT: return OP_LT;
+        case AST_OP_GT: return OP_GT;
+        case AST_OP_LE: return OP_LE;
+        case AST_OP_GE: return OP_GE;
+        case AST_OP_XOR: return OP_XOR;
+        case AST_OP_XNOR: return OP_XNOR;
+        default: return OP_COUNT;
+    }
+}
+
+// Right operand of an operator whose left one is already in dst. and/or (and
+// their negations) only look at the right one when the left does not decide.
+static void compiler_apply_binary(Compiler *c, ASTNode *node, int dst)
+{
+    c->line = node->line;
+    ASTOperator op = node->op;
+    if (op == AST_OP_AND || op == AST_OP_NAND || op == AST_OP_OR || op == AST_OP_NOR)
+    {
+        compiler_emit(c, BC_ABC(OP_TRUTH, dst, dst, 0));
+        int both = op == AST_OP_AND || op == AST_OP_NAND;
+        size_t skip = compiler_emit_branch(c, both ? OP_JMPF : OP_JMPT, dst);
+        compiler_expression(c, node->right, dst);
+        compiler_emit(c, BC_ABC(OP_TRUTH, dst, dst, 0));
+        compiler_jump_to(c, node, skip, c->code->count);
+        if (op == AST_OP_NAND || op == AST_OP_NOR)
+            compiler_emit(c, BC_ABC(OP_NOT, dst, dst, 0));
+        return;
+    }
+
+    int right = compiler_reserve(c, node);
+    if (right < 0) return;
+    compiler_expression(c, node->right, right);
+    c->line = node->line;
+    compiler_emit(c, BC_ABC(compiler_binary_op(op), dst, dst, right));
+    c->top--;
+}
+
+// Chains like a - b - c nest to the left as deep as they are long, so the
+// left spine is walked with a loop and applied from the innermost operator out
+static void compiler_binary(Compiler *c, ASTNode *node, int dst)
+{
+    size_t count = 0, capacity = 16;
+    ASTNode *small[16];
+    ASTNode **spine = small;
+    while (node->type == AST_BINARY_OP && node->op != AST_OP_ASSIGN && node->left && node->right)
+    {
+        if (count == capacity)
+        {
+            capacity *= 2;
+            spine = spine == small ? memcpy(malloc(sizeof(ASTNode *) * capacity), small, sizeof(small))
+                : realloc(spine, sizeof(ASTNode *) * capacity);
+        }
+        spine[count++] = node;
+        node = node->left;
+    }
+
+    compiler_expression(c, node, dst);
+    while (count > 0 && c->error_count == 0)
+        compiler_apply_binary(c, spine[--count], dst);
+    if (spine != small) free(spine);
+}
+
+static void compiler_unary(Compiler *c, ASTNode *node, int dst)
+{
+    // not not not ... is flattened the same way
+    size_t count = 0;
+    ASTNode *chain = node;
+    while (chain->type == AST_UNARY_OP && chain->left)
+    {
+        count++;
+        chain = chain->left;
+    }
+    compiler_expression(c, chain, dst);
+
+    ASTNode **ops = malloc(sizeof(ASTNode *) * count);
+    size_t i = 0;
+    for (chain = node; chain->type == AST_UNARY_OP && chain->left; chain = chain->left)
+        ops[i++] = chain;
+    while (i > 0)
+    {
+        ASTNode *op = ops[--i];
+        c->line = op->line;
+        compiler_emit(c, BC_ABC(op->op == AST_OP_NEG ? OP_NEG : OP_NOT, dst, dst, 0));
+    }
+    free(ops);
+}
+
+static void compiler_set_global(Compiler *c, const char *name, int reg)
+{
+    compiler_emit_wide(c, OP_SETG, OP_SETGX, reg, vm_global_slot(c->vm, name));
+}
+
+static void compiler_assign(Compiler *c, ASTNode *node, int dst)
+{
+    if (!node->left || node->left->type != AST_IDENTIFIER || !node->right)
+    {
+        compiler_error(c, node, "Can only assign to a name");
+        return;
+    }
+    compiler_expression(c, node->right, dst);
+    c->line = node->line;
+    compiler_set_global(c, node->left->string_value, dst);
+}
+
+static uint32_t compiler_call_site(Compiler *c, const char *name, ASTNode *args)
+{
+    Bytecode *code = c->code;
+    if (code->call_count == code->call_capacity)
+    {
+        code->call_capacity = code->call_capacity ? code->call_capacity * 2 : 64;
+        code->calls = realloc(code->calls, sizeof(CallSite) * code->call_capacity);
+    }
+
+    int argc = args ? args->num_children : 0;
+    CallSite *site = &code->calls[code->call_count];
+    memset(site, 0, sizeof(CallSite));
+    site->name = name;
+    site->first_name = code->arg_name_count;
+    site->argc = (uint8_t)argc;
+
+    if (code->arg_name_count + (uint32_t)argc > code->arg_name_capacity)
+    {
+        while (code->arg_name_count + (uint32_t)argc > code->arg_name_capacity)
+            code->arg_name_capacity = code->arg_name_capacity ? code->arg_name_capacity * 2 : 64;
+        code->arg_names = realloc(code->arg_names, sizeof(const char *) * code->arg_name_capacity);
+    }
+    for (int i = 0; i < argc; i++)
+    {
+        ASTNode *arg = args->children[i];
+        int named = arg->type == AST_BINARY_OP && arg->op == AST_OP_ASSIGN && arg->left;
+        code->arg_names[code->arg_name_count++] = named ? arg->left->string_value : NULL;
+    }
+    return code->call_count++;
+}
+
+// Receiver (for methods) at base, arguments above it, result back in base.
+// A member read without parentheses is a call without arguments.
+static void compiler_call(Compiler *c, ASTNode *node, int dst)
+{
+    ASTNode *callee = node->type == AST_CALL ? node->left : node;
+    ASTNode *args = node->type == AST_CALL ? node->right : NULL;
+    int method = callee && callee->type == AST_MEMBER_ACCESS;
+    if (!callee || (!method && callee->type != AST_IDENTIFIER)
+        || (method && (!callee->left || !callee->right || !callee->right->string_value)))
+    {
+        compiler_error(c, node, "Only devices and functions can be called");
+        return;
+    }
+    int argc = args ? args->num_children : 0;
+    if (argc > 255)
+    {
+        compiler_error(c, node, "Too many arguments");
+        return;
+    }
+
+    // dst can be the base when nothing is live above it
+    int base = dst + 1 == c->top ? dst : compiler_reserve(c, node);
+    if (base < 0) return;
+    int saved_top = c->top;
+
+    if (method)
+        compiler_expression(c, callee->left, base);
+    for (int i = 0; i < argc && c->error_count == 0; i++)
+    {
+        ASTNode *arg = args->children[i];
+        int reg = compiler_reserve(c, arg);
+        if (reg < 0) return;
+        int named = arg->type == AST_BINARY_OP && arg->op == AST_OP_ASSIGN && arg->left;
+        compiler_expression(c, named ? arg->right : arg, reg);
+    }
+
+    c->line = node->line;
+    const char *name = method ? callee->right->string_value : callee->string_value;
+    compiler_emit(c, BC_ABX(method ? OP_CALL : OP_CALLF, base, 0));
+    compiler_emit(c, compiler_call_site(c, name, args));
+
+    c->top = saved_top;
+    if (base != dst)
+    {
+        compiler_emit(c, BC_ABC(OP_MOVE, dst, base, 0));
+        c->top--;
+    }
+}
+
+static void compiler_load_constant(Compiler *c, Value value, int dst)
+{
+    compiler_emit_wide(c, OP_LOADK, OP_LOADKX, dst, compiler_constant(c, value));
+}
+
+static void compiler_expression(Compiler *c, ASTNode *node, int dst)
+{
+    if (!node || c->error_count > 0) return;
+    if (++c->depth > COMPILER_MAX_DEPTH)
+    {
+        compiler_error(c, node, "Expression nested too deeply");
+        c->depth--;
+        return;
+    }
+    c->line = node->line;
+
+    switch (node->type)
+    {
+        case AST_NUMBER:
+            compiler_load_constant(c, (Value){ VALUE_NUMBER, { .number = node->number_value } }, dst);
+            break;
+        case AST_STRING:
+            compiler_load_constant(c, (Value){ VALUE_STRING, { .string = node->string_value } }, dst);
+            break;
+        case AST_BOOLEAN:
+            compiler_emit(c, BC_ABC(OP_LOADBOOL, dst, node->string_value == c->true_name, 0));
+            break;
+        case AST_IDENTIFIER:
+            if (node->string_value)
+                compiler_emit_wide(c, OP_GETG, OP_GETGX, dst, vm_global_slot(c->vm, node->string_value));
+            else
+                compiler_emit(c, BC_ABC(OP_LOADNIL, dst, 0, 0));
+            break;
+        case AST_BINARY_OP:
+            if (node->op == AST_OP_ASSIGN)
+                compiler_assign(c, node, dst);
+            else
+                compiler_binary(c, node, dst);
+            break;
+        case AST_UNARY_OP:
+            compiler_unary(c, node, dst);
+            break;
+        case AST_CALL:
+        case AST_MEMBER_ACCESS:
+            compiler_call(c, node, dst);
+            break;
+        default:
+            compiler_error(c, node, "Not an expression");
+            break;
+    }
+    c->depth--;
+}
+
+static void compiler_statement(Compiler *c, ASTNode *node);
+
+static void compiler_block(Compiler *c, ASTNode *block)
+{
+    for (int i = 0; block && i < block->num_children && c->error_count == 0; i++)
+        compiler_statement(c, block->children[i]);
+}
+
+static void compiler_declaration(Compiler *c, ASTNode *node)
+{
+    Bytecode *code = c->code;
+    if (node->num_children < 2 || !node->string_value)
+    {
+        compiler_error(c, node, "Incomplete declaration");
+        return;
+    }
+    if (code->declaration_count == code->declaration_capacity)
+    {
+        code->declaration_capacity = code->declaration_capacity ? code->declaration_capacity * 2 : 16;
+        code->declarations = realloc(code->declarations, sizeof(DeclarationSite) * code->declaration_capacity);
+    }
+    const char *alias = node->children[1]->string_value;
+    code->declarations[code->declaration_count] = (DeclarationSite){ node->children[0]->string_value,
+        node->string_value, alias };
+
+    int reg = compiler_reserve(c, node);
+    if (reg < 0) return;
+    compiler_emit(c, BC_ABX(OP_NEW, reg, 0));
+    compiler_emit(c, code->declaration_count++);
+    compiler_set_global(c, node->string_value, reg);
+    if (alias)
+        compiler_set_global(c, alias, reg);
+    c->top--;
+}
+
+static void compiler_if(Compiler *c, ASTNode *node)
+{
+    if (node->num_children < 2)
+    {
+        compiler_error(c, node, "Incomplete if statement");
+        return;
+    }
+    int cond = compiler_reserve(c, node);
+    if (cond < 0) return;
+    compiler_expression(c, node->children[0], cond);
+    c->line = node->line;
+    size_t to_else = compiler_emit_branch(c, OP_JMPF, cond);
+    c->top--;
+
+    compiler_block(c, node->children[1]);
+    if (node->num_children > 2)
+    {
+        size_t to_end = compiler_emit(c, BC_ABX(OP_JMP, 0, 0));
+        compiler_jump_to(c, node, to_else, c->code->count);
+        compiler_block(c, node->children[2]);
+        compiler_jump_to(c, node, to_end, c->code->count);
+    } else
+    {
+        compiler_jump_to(c, node, to_else, c->code->count);
+    }
+}
+
+static void compiler_statement(Compiler *c, ASTNode *node)
+{
+    if (!node) return;
+    if (++c->depth > COMPILER_MAX_DEPTH)
+    {
+        compiler_error(c, node, "Blocks nested too deeply");
+        c->depth--;
+        return;
+    }
+    c->line = node->line;
+
+    switch (node->type)
+    {
+        case AST_IMPORT:
+            break;
+        case AST_DECLARATION:
+            compiler_declaration(c, node);
+            break;
+        case AST_IF_STMT:
+            compiler_if(c, node);
+            break;
+        case AST_BLOCK:
+            compiler_block(c, node);
+            break;
+        case AST_EXPR:
+        {
+            int reg = compiler_reserve(c, node);
+            if (reg < 0) break;
+            compiler_expression(c, node->left, reg);
+            c->top--;
+            break;
+        }
+        default:
+            compiler_error(c, node, "Statement cannot be compiled");
+            break;
+    }
+    c->depth--;
+}
+
+Bytecode* compiler_compile(ASTNode *program, VM *vm, Diagnostics *errors)
+{
+    Compiler c = { 0 };
+    c.code = calloc(1, sizeof(Bytecode));
+    c.vm = vm;
+    c.errors = errors;
+    c.true_name = intern_cstr("true");
+
+    for (int i = 0; program && i < program->num_children && c.error_count == 0; i++)
+        compiler_statement(&c, program->children[i]);
+
+    compiler_emit(&c, BC_ABC(OP_HALT, 0, 0, 0));
+    free(c.constants);
+    if (c.error_count > 0)
+    {
+        bytecode_free(c.code);
+        return NULL;
+    }
+    return c.code;
+}
@@ -0,0 +1,14 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "ast.h"
+#include "bytecode.h"
+#include "diagnostics.h"
+#include "vm.h"
+
+// Compiles a validated program for vm. Imports compile to nothing, the caller
+// runs the imported modules first. NULL when something has no bytecode form
+// (reported to errors).
+Bytecode* compiler_compile(ASTNode *program, VM *vm, Diagnostics *errors);
+
+#endif //COMPILER_H
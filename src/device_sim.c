@@ -0,0 +1,301 @@
+#include "device_sim.h"
+#include "intern.h"
+#include <stdlib.h>
+
+#define SIM_METHODS 16
+
+typedef struct
+{
+    const char *name;
+    DeviceMethod method;
+} SimBinding;
+
+// What the devices of one kind can do. Driver 0 is where detached devices go
+// and binds nothing.
+typedef struct
+{
+    const char *kind;
+    SimBinding methods[SIM_METHODS];
+    int count;
+} SimDriver;
+
+typedef struct
+{
+    const char *name;
+    const char *alias;
+    int driver;
+    bool connected;
+    Value last_write;   // payload of the last write, what read() gives back
+} SimDevice;
+
+struct DeviceSim
+{
+    FILE *trace;
+    SimDevice *devices;
+    int count;
+    int capacity;
+    SimDriver *drivers;
+    int driver_count;
+    int driver_capacity;
+    uint32_t epoch;
+
+    // Interned once: the names that reach the simulator are interned too, so
+    // every lookup compares pointers
+    const char *natives[SIM_METHODS];
+    const char *payload;
+    const char *connected;
+    const char *disconnected;
+    const char *log;
+    const char *reroute;
+    const char *detach;
+};
+
+static void device_sim_trace_args(DeviceSim *sim, const Value *args, const char *const *names, int argc)
+{
+    fputc('(', sim->trace);
+    for (int i = 0; i < argc; i++)
+    {
+        if (i > 0) fputs(", ", sim->trace);
+        if (names && names[i]) fprintf(sim->trace, "%s=", names[i]);
+        if (args[i].type == VALUE_DEVICE && args[i].as.device >= 0 && args[i].as.device < sim->count)
+            fputs(sim->devices[args[i].as.device].name, sim->trace);
+        else
+            value_print(args[i], sim->trace);
+    }
+    fputs(")\n", sim->trace);
+}
+
+static void device_sim_trace(DeviceSim *sim, const SimDevice *d, const char *method, const Value *args,
+    const char *const *names, int argc)
+{
+    if (!sim->trace) return;
+    if (d->alias)
+        fprintf(sim->trace, "%s (%s) %s", d->name, d->alias, method);
+    else
+        fprintf(sim->trace, "%s %s", d->name, method);
+    device_sim_trace_args(sim, args, names, argc);
+}
+
+// an argument by (interned) name, or the position it would take when not named
+static const Value* device_sim_arg(const Value *args, const char *const *names, int argc, const char *name, int position)
+{
+    for (int i = 0; i < argc; i++)
+    {
+        if (names[i] == name)
+            return &args[i];
+    }
+    return position >= 0 && position < argc && !names[position] ? &args[position] : NULL;
+}
+
+static int device_sim_connect(void *ctx, int device, const Value *args, const char *const *names, int argc,
+    Value *result)
+{
+    DeviceSim *sim = ctx;
+    (void)result;
+    device_sim_trace(sim, &sim->devices[device], "connect", args, names, argc);
+    sim->devices[device].connected = true;
+    return 0;
+}
+
+static int device_sim_disconnect(void *ctx, int device, const Value *args, const char *const *names, int argc,
+    Value *result)
+{
+    DeviceSim *sim = ctx;
+    (void)result;
+    device_sim_trace(sim, &sim->devices[device], "disconnect", args, names, argc);
+    sim->devices[device].connected = false;
+    return 0;
+}
+
+static int device_sim_status(void *ctx, int device, const Value *args, const char *const *names, int argc,
+    Value *result)
+{
+    DeviceSim *sim = ctx;
+    device_sim_trace(sim, &sim->devices[device], "status", args, names, argc);
+    *result = (Value){ VALUE_STRING, { .string = sim->devices[device].connected ? sim->connected : sim->disconnected } };
+    return 0;
+}
+
+static int device_sim_write(void *ctx, int device, const Value *args, const char *const *names, int argc,
+    Value *result)
+{
+    DeviceSim *sim = ctx;
+    SimDevice *d = &sim->devices[device];
+    (void)result;
+    device_sim_trace(sim, d, "write", args, names, argc);
+    if (!d->connected) return 1;
+    const Value *payload = device_sim_arg(args, names, argc, sim->payload, argc - 1);
+    if (payload) d->last_write = *payload;
+    return 0;
+}
+
+static int device_sim_read(void *ctx, int device, const Value *args, const char *const *names, int argc,
+    Value *result)
+{
+    DeviceSim *sim = ctx;
+    SimDevice *d = &sim->devices[device];
+    device_sim_trace(sim, d, "read", args, names, argc);
+    if (!d->connected) return 1;
+    *result = d->last_write;
+    return 0;
+}
+
+static const SimBinding device_sim_natives[] = {
+    { "connect", device_sim_connect },
+    { "disconnect", device_sim_disconnect },
+    { "status", device_sim_status },
+    { "write", device_sim_write },
+    { "read", device_sim_read },
+};
+
+#define SIM_NATIVE_COUNT (int)(sizeof(device_sim_natives) / sizeof(device_sim_natives[0]))
+
+static DeviceMethod device_sim_native(const DeviceSim *sim, const char *name)
+{
+    for (int i = 0; i < SIM_NATIVE_COUNT; i++)
+    {
+        if (sim->natives[i] == name)
+            return device_sim_natives[i].method;
+    }
+    return NULL;
+}
+
+static int device_sim_driver(DeviceSim *sim, const char *kind)
+{
+    for (int i = 1; i < sim->driver_count; i++)
+    {
+        if (sim->drivers[i].kind == kind)
+            return i;
+    }
+
+    if (sim->driver_count == sim->driver_capacity)
+    {
+        sim->driver_capacity *= 2;
+        sim->drivers = realloc(sim->drivers, sizeof(SimDriver) * (size_t)sim->driver_capacity);
+    }
+    SimDriver *driver = &sim->drivers[sim->driver_count];
+    driver->kind = kind;
+    driver->count = SIM_NATIVE_COUNT;
+    for (int i = 0; i < SIM_NATIVE_COUNT; i++)
+        driver->methods[i] = (SimBinding){ sim->natives[i], device_sim_natives[i].method };
+    return sim->driver_count++;
+}
+
+DeviceSim* device_sim_create(FILE *trace)
+{
+    DeviceSim *sim = calloc(1, sizeof(DeviceSim));
+    sim->trace = trace;
+    sim->driver_capacity = 8;
+    sim->drivers = calloc((size_t)sim->driver_capacity, sizeof(SimDriver));
+    sim->driver_count = 1;
+
+    for (int i = 0; i < SIM_NATIVE_COUNT; i++)
+        sim->natives[i] = intern_cstr(device_sim_natives[i].name);
+    sim->payload = intern_cstr("payload");
+    sim->connected = intern_cstr("connected");
+    sim->disconnected = intern_cstr("disconnected");
+    sim->log = intern_cstr("log");
+    sim->reroute = intern_cstr("reroute");
+    sim->detach = intern_cstr("detach");
+    return sim;
+}
+
+void device_sim_free(DeviceSim *sim)
+{
+    if (!sim) return;
+    free(sim->devices);
+    free(sim->drivers);
+    free(sim);
+}
+
+static int device_sim_open(void *ctx, const char *type, const char *name, const char *alias)
+{
+    DeviceSim *sim = ctx;
+    if (sim->count == sim->capacity)
+    {
+        sim->capacity = sim->capacity ? sim->capacity * 2 : 8;
+        sim->devices = realloc(sim->devices, sizeof(SimDevice) * (size_t)sim->capacity);
+    }
+    int driver = device_sim_driver(sim, alias ? alias : type);
+    sim->devices[sim->count] = (SimDevice){ name, alias, driver, false, { VALUE_NIL, { .number = 0 } } };
+    return sim->count++;
+}
+
+static int device_sim_type(void *ctx, int device)
+{
+    DeviceSim *sim = ctx;
+    return device >= 0 && device < sim->count ? sim->devices[device].driver : 0;
+}
+
+static DeviceMethod device_sim_bind(void *ctx, int type, const char *method)
+{
+    DeviceSim *sim = ctx;
+    const SimDriver *driver = &sim->drivers[type];
+    for (int i = 0; i < driver->count; i++)
+    {
+        if (driver->methods[i].name == method)
+            return driver->methods[i].method;
+    }
+    return NULL;
+}
+
+// by name on every call, for callers without a cache
+static int device_sim_call(void *ctx, int device, const char *method, const Value *args, const char *const *names,
+    int argc, Value *result)
+{
+    DeviceMethod bound = device_sim_bind(ctx, device_sim_type(ctx, device), method);
+    return bound ? bound(ctx, device, args, names, argc, result) : 1;
+}
+
+static int device_sim_reroute(DeviceSim *sim, const Value *args, int argc)
+{
+    if (argc != 3 || args[0].type != VALUE_DEVICE || args[1].type != VALUE_STRING
+        || args[2].type != VALUE_STRING)
+        return 1;
+    DeviceMethod native = device_sim_native(sim, args[2].as.string);
+    int type = device_sim_type(sim, args[0].as.device);
+    if (!native || type == 0) return 1;
+
+    SimDriver *driver = &sim->drivers[type];
+    int i = 0;
+    while (i < driver->count && driver->methods[i].name != args[1].as.string)
+        i++;
+    if (i == SIM_METHODS) return 1;
+    if (i == driver->count) driver->count++;
+    driver->methods[i] = (SimBinding){ args[1].as.string, native };
+    // cached bindings of this driver are stale now
+    sim->epoch++;
+    return 0;
+}
+
+static int device_sim_function(void *ctx, const char *name, const Value *args, const char *const *names,
+    int argc, Value *result)
+{
+    DeviceSim *sim = ctx;
+    (void)result;
+    if (sim->trace)
+    {
+        fputs(name, sim->trace);
+        device_sim_trace_args(sim, args, names, argc);
+    }
+
+    if (name == sim->log)
+        return 0;
+    if (name == sim->reroute)
+        return device_sim_reroute(sim, args, argc);
+    if (name == sim->detach)
+    {
+        // a device changing drivers changes its type, no cache entry matches it
+        if (argc != 1 || args[0].type != VALUE_DEVICE || device_sim_type(sim, args[0].as.device) == 0)
+            return 1;
+        sim->devices[args[0].as.device].driver = 0;
+        return 0;
+    }
+    return 1;
+}
+
+DeviceBackend device_sim_backend(DeviceSim *sim)
+{
+    return (DeviceBackend){ sim, device_sim_open, device_sim_call, device_sim_function,
+        device_sim_type, device_sim_bind, &sim->epoch };
+}
@@ -0,0 +1,26 @@
+#ifndef DEVICE_SIM_H
+#define DEVICE_SIM_H
+
+#include "vm.h"
+#include <stdio.h>
+
+// A device backend with no hardware behind it. Devices start disconnected and
+// understand connect(), disconnect(), status(), read() and write(...). Every
+// device of one kind (its alias, Keyboard, Mouse...) shares a driver that
+// binds those names to native methods, so method calls can be cached per kind.
+//
+// Functions: log(...); reroute(device, "method", "native") binds method to
+// another native on the device's whole driver; detach(device) takes the
+// device off its driver, every method call on it fails from then on. Every
+// call is traced as the script wrote it.
+//
+// Names are only ever compared by pointer: the simulator interns its own once
+// and expects interned ones, so it must not outlive intern_clear.
+typedef struct DeviceSim DeviceSim;
+
+// trace: where calls are written, NULL for nowhere
+DeviceSim* device_sim_create(FILE *trace);
+void device_sim_free(DeviceSim *sim);
+DeviceBackend device_sim_backend(DeviceSim *sim);
+
+#endif //DEVICE_SIM_H
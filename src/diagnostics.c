@@ -0,0 +1,42 @@
+#include "diagnostics.h"
+#include <stdlib.h>
+
+void diagnostics_init(Diagnostics *d)
+{
+    d->items = NULL;
+    d->count = 0;
+    d->capacity = 0;
+}
+
+void diagnostics_add(Diagnostics *d, int line, int column, const char *message)
+{
+    diagnostics_add_detail(d, line, column, message, NULL);
+}
+
+void diagnostics_add_detail(Diagnostics *d, int line, int column, const char *message, const char *detail)
+{
+    if (d->count == d->capacity)
+    {
+        d->capacity = d->capacity ? d->capacity * 2 : 16;
+        d->items = realloc(d->items, sizeof(Diagnostic) * d->capacity);
+    }
+    d->items[d->count++] = (Diagnostic){ line, column, message, detail };
+}
+
+void diagnostics_print(const Diagnostics *d, FILE *out, const char *kind)
+{
+    for (size_t i = 0; i < d->count; i++)
+    {
+        const Diagnostic *diag = &d->items[i];
+        if (diag->detail)
+            fprintf(out, "[%d:%d] %s: %s \"%s\"\n", diag->line, diag->column, kind, diag->message, diag->detail);
+        else
+            fprintf(out, "[%d:%d] %s: %s\n", diag->line, diag->column, kind, diag->message);
+    }
+}
+
+void diagnostics_free(Diagnostics *d)
+{
+    free(d->items);
+    diagnostics_init(d);
+}
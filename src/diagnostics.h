@@ -0,0 +1,32 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Messages are collected while a pass runs and printed once it is over.
+// Text is not copied, it has to outlive the buffer (string literals, interned
+// strings).
+typedef struct
+{
+    int line;
+    int column;
+    const char *message;
+    const char *detail;     // what the message is about (a path, a name), or NULL
+} Diagnostic;
+
+typedef struct
+{
+    Diagnostic *items;
+    size_t count;
+    size_t capacity;
+} Diagnostics;
+
+void diagnostics_init(Diagnostics *d);
+void diagnostics_add(Diagnostics *d, int line, int column, const char *message);
+void diagnostics_add_detail(Diagnostics *d, int line, int column, const char *message, const char *detail);
+// one "[line:column] <kind>: message" line per diagnostic, detail quoted after it
+void diagnostics_print(const Diagnostics *d, FILE *out, const char *kind);
+void diagnostics_free(Diagnostics *d);
+
+#endif //DIAGNOSTICS_H
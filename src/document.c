@@ -0,0 +1,286 @@
+#include "document.h"
+#include "parser.h"
+#include <stdlib.h>
+#include <string.h>
+
+static TokenStream* document_tokens_alloc(size_t count)
+{
+    TokenStream *ts = calloc(1, sizeof(TokenStream));
+    ts->capacity = count ? count : 1;
+    ts->type = malloc(ts->capacity);
+    ts->offset = malloc(sizeof(size_t) * ts->capacity);
+    ts->length = malloc(sizeof(size_t) * ts->capacity);
+    ts->line = malloc(sizeof(int) * ts->capacity);
+    ts->column = malloc(sizeof(int) * ts->capacity);
+    return ts;
+}
+
+static void document_tokens_push(TokenStream *ts, const Token *tok)
+{
+    if (ts->count == ts->capacity)
+    {
+        ts->capacity *= 2;
+        ts->type = realloc(ts->type, ts->capacity);
+        ts->offset = realloc(ts->offset, sizeof(size_t) * ts->capacity);
+        ts->length = realloc(ts->length, sizeof(size_t) * ts->capacity);
+        ts->line = realloc(ts->line, sizeof(int) * ts->capacity);
+        ts->column = realloc(ts->column, sizeof(int) * ts->capacity);
+    }
+    size_t i = ts->count++;
+    ts->type[i] = (uint8_t)tok->type;
+    ts->offset[i] = tok->offset;
+    ts->length[i] = tok->length;
+    ts->line[i] = tok->line;
+    ts->column[i] = tok->column;
+}
+
+static size_t document_count_lines(const char *text, size_t length)
+{
+    size_t lines = 0;
+    for (size_t i = 0; i < length; i++)
+        lines += text[i] == '\n';
+    return lines;
+}
+
+// string tokens leave out their quotes
+static size_t document_token_start(const TokenStream *ts, size_t i)
+{
+    return ts->offset[i] - (ts->type[i] == TOK_STRING);
+}
+
+static size_t document_token_end(const TokenStream *ts, size_t i)
+{
+    return ts->offset[i] + ts->length[i] + (ts->type[i] == TOK_STRING);
+}
+
+static void document_add_statement(Document *doc, ASTNode *stmt, size_t first, size_t end, int errors)
+{
+    ASTNode *program = doc->program;
+    ast_add_child(NULL, program, stmt);
+    if (doc->statement_capacity < (size_t)program->capacity)
+    {
+        doc->statement_capacity = (size_t)program->capacity;
+        doc->statements = realloc(doc->statements, sizeof(DocumentStatement) * doc->statement_capacity);
+    }
+    doc->statements[program->num_children - 1] = (DocumentStatement){ first, end, errors };
+    doc->error_count += errors;
+}
+
+Document* document_open(const char *text, size_t length)
+{
+    Document *doc = calloc(1, sizeof(Document));
+    doc->text = malloc(length + 1);
+    memcpy(doc->text, text, length);
+    doc->text[length] = '\0';
+    doc->length = length;
+
+    Lexer *lx = lexerInitBuffer(doc->text, length);
+    doc->tokens = lexerTokenizeAll(lx);
+    lexerFree(lx);
+
+    TokenStream *ts = doc->tokens;
+    doc->program = ast_create(NULL, AST_PROGRAM, ts->line[0], ts->column[0]);
+
+    Parser *p = parser_init_tokens(ts, NULL);
+    for (;;)
+    {
+        size_t first = p->index;
+        int errors = p->error_count;
+        ASTNode *stmt = parser_next_statement(p);
+        if (!stmt) break;
+        document_add_statement(doc, stmt, first, p->index, p->error_count - errors);
+    }
+    parser_free(p);
+
+    doc->relexed_tokens = ts->count;
+    doc->reparsed_statements = (size_t)doc->program->num_children;
+    return doc;
+}
+
+static int document_shift_line(ASTNode *node, int depth, void *ctx)
+{
+    (void)depth;
+    node->line += *(int *)ctx;
+    return AST_WALK_ALL;
+}
+
+int document_edit(Document *doc, size_t offset, size_t deleted, const char *inserted, size_t inserted_length)
+{
+    if (offset > doc->length || deleted > doc->length - offset) return -1;
+
+    TokenStream *old = doc->tokens;
+    size_t length = doc->length - deleted + inserted_length;
+    char *text = malloc(length + 1);
+    memcpy(text, doc->text, offset);
+    memcpy(text + offset, inserted, inserted_length);
+    memcpy(text + offset + inserted_length, doc->text + offset + deleted, doc->length - offset - deleted);
+    text[length] = '\0';
+
+    size_t edit_end = offset + inserted_length;   // in the new text
+    ptrdiff_t delta = (ptrdiff_t)inserted_length - (ptrdiff_t)deleted;
+    int line_delta = (int)document_count_lines(inserted, inserted_length)
+        - (int)document_count_lines(doc->text + offset, deleted);
+
+    // The first token reaching the edit can change, and so can the one before
+    // it (appending to a name, '=' becoming '=='). Tokens start in a clean
+    // lexer state, so re-lexing from there is exact.
+    size_t lo = 0, hi = old->count - 1;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (document_token_end(old, mid) < offset) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t damage = lo > 0 ? lo - 1 : 0;
+
+    Lexer *lx = lexerInitBuffer(text, length);
+    if (lo > 0)
+    {
+        // a string token's line is where it ends
+        int line = old->line[damage];
+        if (old->type[damage] == TOK_STRING)
+            line -= (int)document_count_lines(doc->text + old->offset[damage], old->length[damage]);
+        lexerSeek(lx, document_token_start(old, damage), line, old->column[damage]);
+    }
+
+    // re-lex until a token past the edit lines up with an old one: same
+    // shifted offset, line and column, same type and length
+    TokenStream *fresh = document_tokens_alloc(64);
+    size_t resync = lo;
+    for (;;)
+    {
+        Token tok = lexerNextToken(lx);
+        if (tok.type == TOK_EOF)
+        {
+            document_tokens_push(fresh, &tok);
+            resync = old->count;
+            break;
+        }
+
+        if (tok.offset - (tok.type == TOK_STRING) >= edit_end)
+        {
+            size_t was = (size_t)((ptrdiff_t)tok.offset - delta);
+            while (resync < old->count - 1 && old->offset[resync] < was) resync++;
+            if (resync < old->count - 1 && old->offset[resync] == was
+                && old->type[resync] == tok.type && old->length[resync] == tok.length
+                && old->line[resync] + line_delta == tok.line && old->column[resync] == tok.column)
+                break;
+        }
+        document_tokens_push(fresh, &tok);
+    }
+    lexerFree(lx);
+
+    // splice: old tokens before the damage, the re-lexed ones, the shifted tail
+    size_t tail = old->count - resync;
+    TokenStream *ts = document_tokens_alloc(damage + fresh->count + tail);
+    ts->count = damage + fresh->count + tail;
+    ts->base = text;
+    ts->base_offset = 0;
+
+    memcpy(ts->type, old->type, damage);
+    memcpy(ts->offset, old->offset, sizeof(size_t) * damage);
+    memcpy(ts->length, old->length, sizeof(size_t) * damage);
+    memcpy(ts->line, old->line, sizeof(int) * damage);
+    memcpy(ts->column, old->column, sizeof(int) * damage);
+
+    size_t at = damage;
+    memcpy(ts->type + at, fresh->type, fresh->count);
+    memcpy(ts->offset + at, fresh->offset, sizeof(size_t) * fresh->count);
+    memcpy(ts->length + at, fresh->length, sizeof(size_t) * fresh->count);
+    memcpy(ts->line + at, fresh->line, sizeof(int) * fresh->count);
+    memcpy(ts->column + at, fresh->column, sizeof(int) * fresh->count);
+
+    at += fresh->count;
+    memcpy(ts->type + at, old->type + resync, tail);
+    memcpy(ts->length + at, old->length + resync, sizeof(size_t) * tail);
+    memcpy(ts->column + at, old->column + resync, sizeof(int) * tail);
+    for (size_t i = 0; i < tail; i++)
+    {
+        ts->offset[at + i] = (size_t)((ptrdiff_t)old->offset[resync + i] + delta);
+        ts->line[at + i] = old->line[resync + i] + line_delta;
+    }
+
+    // old token index -> new token index, for everything from resync on
+    ptrdiff_t shift = (ptrdiff_t)fresh->count - (ptrdiff_t)(resync - damage);
+    doc->relexed_tokens = fresh->count;
+    lexerFreeTokens(fresh);
+
+    // Re-parse from the first statement that reaches the damage (statement
+    // ends are compared inclusively, parsing one may peek at the next token)
+    // until the parser arrives at the shifted start of an undamaged one.
+    ASTNode *program = doc->program;
+    size_t count = (size_t)program->num_children;
+    DocumentStatement *old_statements = doc->statements;
+    ASTNode **old_children = program->children;
+
+    size_t first = 0;
+    while (first < count && old_statements[first].end < damage) first++;
+    size_t reuse = first;
+    while (reuse < count && old_statements[reuse].first < resync) reuse++;
+
+    program->children = NULL;
+    program->num_children = 0;
+    program->capacity = 0;
+    doc->statements = NULL;
+    doc->statement_capacity = 0;
+    doc->error_count = 0;
+
+    for (size_t i = 0; i < first; i++)
+        document_add_statement(doc, old_children[i], old_statements[i].first, old_statements[i].end,
+            old_statements[i].errors);
+
+    Parser *p = parser_init_tokens(ts, NULL);
+    parser_seek(p, first < count ? old_statements[first].first : (count ? old_statements[count - 1].end : 0));
+    size_t reparsed = 0;
+    for (;;)
+    {
+        while (reuse < count && (ptrdiff_t)old_statements[reuse].first + shift < (ptrdiff_t)p->index)
+            reuse++;
+        if (reuse < count && (ptrdiff_t)old_statements[reuse].first + shift == (ptrdiff_t)p->index)
+            break;
+
+        size_t start = p->index;
+        int errors = p->error_count;
+        ASTNode *stmt = parser_next_statement(p);
+        if (!stmt) break;
+        document_add_statement(doc, stmt, start, p->index, p->error_count - errors);
+        reparsed++;
+    }
+    parser_free(p);
+
+    // statements between the first damaged one and the first reused one are gone
+    for (size_t i = first; i < reuse; i++)
+        ast_free(old_children[i]);
+
+    for (size_t i = reuse; i < count; i++)
+    {
+        if (line_delta) ast_walk(old_children[i], document_shift_line, NULL, &line_delta);
+        document_add_statement(doc, old_children[i],
+            (size_t)((ptrdiff_t)old_statements[i].first + shift),
+            (size_t)((ptrdiff_t)old_statements[i].end + shift), old_statements[i].errors);
+    }
+    free(old_children);
+    free(old_statements);
+
+    program->line = ts->line[0];
+    program->column = ts->column[0];
+
+    lexerFreeTokens(old);
+    free(doc->text);
+    doc->text = text;
+    doc->length = length;
+    doc->tokens = ts;
+    doc->reparsed_statements = reparsed;
+    return doc->error_count;
+}
+
+void document_free(Document *doc)
+{
+    if (!doc) return;
+
+    ast_free(doc->program);
+    lexerFreeTokens(doc->tokens);
+    free(doc->statements);
+    free(doc->text);
+    free(doc);
+}
@@ -0,0 +1,39 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include "lexer.h"
+#include "ast.h"
+
+// An editable script, kept lexed and parsed. Edits re-lex only the damaged
+// tokens and re-parse only the top-level statements they touch; every other
+// statement's subtree is kept as it is. Nodes are on the heap so replaced
+// statements can be freed one at a time.
+typedef struct
+{
+    size_t first;       // token range of the statement
+    size_t end;
+    int errors;         // parse errors reported inside it
+} DocumentStatement;
+
+typedef struct
+{
+    char *text;
+    size_t length;
+    TokenStream *tokens;
+    ASTNode *program;   // children[i] spans statements[i]
+    DocumentStatement *statements;
+    size_t statement_capacity;
+    int error_count;
+
+    // work done by the last edit
+    size_t relexed_tokens;
+    size_t reparsed_statements;
+} Document;
+
+Document* document_open(const char *text, size_t length);
+// Replaces deleted bytes at offset with inserted. Returns -1 when the range is
+// outside the text, else the document's parse error count.
+int document_edit(Document *doc, size_t offset, size_t deleted, const char *inserted, size_t inserted_length);
+void document_free(Document *doc);
+
+#endif //DOCUMENT_H
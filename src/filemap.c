@@ -0,0 +1,108 @@
+#include "filemap.h"
+#include <stdlib.h>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+FileMap* filemap_open(const char *path)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER size;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    FileMap *map = malloc(sizeof(FileMap));
+    map->data = "";
+    map->size = (size_t)size.QuadPart;
+    map->handle = NULL;
+
+    // empty files cannot be mapped, an empty view is all we need anyway
+    if (map->size > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        const char *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (mapping) CloseHandle(mapping);
+        if (!view)
+        {
+            CloseHandle(file);
+            free(map);
+            return NULL;
+        }
+        map->data = view;
+        map->handle = (void *)view;
+    }
+
+    CloseHandle(file);
+    return map;
+}
+
+void filemap_close(FileMap *map)
+{
+    if (!map) return;
+    if (map->handle) UnmapViewOfFile(map->handle);
+    free(map);
+}
+
+#else
+
+FileMap* filemap_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    FileMap *map = malloc(sizeof(FileMap));
+    map->data = "";
+    map->size = (size_t)st.st_size;
+    map->handle = NULL;
+
+    // empty files cannot be mapped, an empty view is all we need anyway
+    if (map->size > 0)
+    {
+        void *view = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED)
+        {
+            close(fd);
+            free(map);
+            return NULL;
+        }
+#ifdef MADV_SEQUENTIAL
+        madvise(view, map->size, MADV_SEQUENTIAL);
+#endif
+        map->data = view;
+        map->handle = view;
+    }
+
+    close(fd);
+    return map;
+}
+
+void filemap_close(FileMap *map)
+{
+    if (!map) return;
+    if (map->handle) munmap(map->handle, map->size);
+    free(map);
+}
+
+#endif
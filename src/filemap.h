@@ -0,0 +1,18 @@
+#ifndef FILEMAP_H
+#define FILEMAP_H
+
+#include <stddef.h>
+
+// Read-only view of a whole file, memory-mapped where the platform allows it
+typedef struct FileMap
+{
+    const char *data;
+    size_t size;
+    void *handle;
+} FileMap;
+
+// Returns NULL for anything that is not a regular file (pipes, FIFOs, ttys)
+FileMap* filemap_open(const char *path);
+void filemap_close(FileMap *map);
+
+#endif //FILEMAP_H
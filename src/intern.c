@@ -0,0 +1,222 @@
+#include "intern.h"
+#include "thread.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_BLOCK_SIZE 65536
+
+// Strings are packed back to back in large blocks, each one preceded by its
+// length: [uint32 length][bytes][NUL]
+typedef struct InternBlock
+{
+    struct InternBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+} InternBlock;
+
+typedef struct
+{
+    uint32_t hash;
+    const char *str;
+} InternEntry;
+
+static InternEntry *table;
+static size_t capacity;
+static size_t count;
+static InternBlock *blocks;
+static Mutex *shared_lock;
+
+static uint32_t intern_hash(const char *text, size_t length)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        h ^= (unsigned char)text[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// bytes a string takes in a block, rounded up so the next length prefix stays aligned
+static size_t intern_stored_size(size_t length)
+{
+    return (sizeof(uint32_t) + length + 1 + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+}
+
+static const char* intern_store(const char *text, size_t length)
+{
+    size_t need = intern_stored_size(length);
+    if (!blocks || blocks->size - blocks->used < need)
+    {
+        size_t size = need > INTERN_BLOCK_SIZE ? need : INTERN_BLOCK_SIZE;
+        InternBlock *block = malloc(sizeof(InternBlock) + size);
+        block->next = blocks;
+        block->used = 0;
+        block->size = size;
+        blocks = block;
+    }
+
+    char *at = blocks->data + blocks->used;
+    uint32_t len32 = (uint32_t)length;
+    memcpy(at, &len32, sizeof(len32));
+    memcpy(at + sizeof(len32), text, length);
+    at[sizeof(len32) + length] = '\0';
+
+    blocks->used += need;
+    return at + sizeof(len32);
+}
+
+static void intern_grow(void)
+{
+    size_t new_capacity = capacity ? capacity * 2 : 1024;
+    InternEntry *new_table = calloc(new_capacity, sizeof(InternEntry));
+
+    for (size_t i = 0; i < capacity; i++)
+    {
+        if (!table[i].str) continue;
+        size_t slot = table[i].hash & (new_capacity - 1);
+        while (new_table[slot].str)
+            slot = (slot + 1) & (new_capacity - 1);
+        new_table[slot] = table[i];
+    }
+
+    free(table);
+    table = new_table;
+    capacity = new_capacity;
+}
+
+static const char* intern_lookup(const char *text, size_t length)
+{
+    // keep the load factor under 3/4
+    if ((count + 1) * 4 > capacity * 3)
+        intern_grow();
+
+    uint32_t hash = intern_hash(text, length);
+    size_t slot = hash & (capacity - 1);
+    while (table[slot].str)
+    {
+        if (table[slot].hash == hash && intern_length(table[slot].str) == length
+            && memcmp(table[slot].str, text, length) == 0)
+        {
+            return table[slot].str;
+        }
+        slot = (slot + 1) & (capacity - 1);
+    }
+
+    table[slot].hash = hash;
+    table[slot].str = intern_store(text, length);
+    count++;
+    return table[slot].str;
+}
+
+const char* intern(const char *text, size_t length)
+{
+    if (!shared_lock) return intern_lookup(text, length);
+
+    mutex_lock(shared_lock);
+    const char *str = intern_lookup(text, length);
+    mutex_unlock(shared_lock);
+    return str;
+}
+
+const char* intern_cstr(const char *text)
+{
+    return intern(text, strlen(text));
+}
+
+size_t intern_length(const char *interned)
+{
+    uint32_t length;
+    memcpy(&length, interned - sizeof(length), sizeof(length));
+    return length;
+}
+
+size_t intern_count(void)
+{
+    return count;
+}
+
+void intern_clear(void)
+{
+    while (blocks)
+    {
+        InternBlock *next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+    free(table);
+    table = NULL;
+    capacity = 0;
+    count = 0;
+}
+
+// Deletes the entry for str. Entries further along its probe run move back
+// into the hole when that is still on their way from their home slot, so
+// lookups never stop short.
+static void intern_remove(const char *str)
+{
+    size_t mask = capacity - 1;
+    size_t hole = intern_hash(str, intern_length(str)) & mask;
+    while (table[hole].str != str)
+        hole = (hole + 1) & mask;
+
+    for (size_t next = (hole + 1) & mask; table[next].str; next = (next + 1) & mask)
+    {
+        size_t home = table[next].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            table[hole] = table[next];
+            hole = next;
+        }
+    }
+    table[hole].str = NULL;
+    table[hole].hash = 0;
+    count--;
+}
+
+// removes the strings stored in block from offset start on
+static void intern_remove_block(InternBlock *block, size_t start)
+{
+    for (size_t at = start; at < block->used;)
+    {
+        const char *str = block->data + at + sizeof(uint32_t);
+        size_t length = intern_length(str);
+        intern_remove(str);
+        at += intern_stored_size(length);
+    }
+    block->used = start;
+}
+
+InternMark intern_mark(void)
+{
+    InternMark mark = { blocks, blocks ? blocks->used : 0 };
+    return mark;
+}
+
+void intern_release(InternMark mark)
+{
+    // blocks are newest first, everything in front of the mark's is newer
+    while (blocks && blocks != mark.block)
+    {
+        InternBlock *next = blocks->next;
+        intern_remove_block(blocks, 0);
+        free(blocks);
+        blocks = next;
+    }
+    if (blocks)
+        intern_remove_block(blocks, mark.used);
+}
+
+void intern_set_shared(int shared)
+{
+    if (shared && !shared_lock)
+    {
+        shared_lock = mutex_create();
+    } else if (!shared && shared_lock)
+    {
+        mutex_free(shared_lock);
+        shared_lock = NULL;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+// Process-wide string table. Equal text always interns to the same pointer,
+// so identifiers, device names and literals compare with == downstream.
+// Interned strings are NUL-terminated and stay valid until intern_clear.
+const char* intern(const char *text, size_t length);
+const char* intern_cstr(const char *text);
+size_t intern_length(const char *interned);
+size_t intern_count(void);
+void intern_clear(void);
+// Serializes intern with a lock while shared is set, for parsing on several
+// threads at once. Only switch it while no other thread is interning.
+void intern_set_shared(int shared);
+
+// A point in the table's history. intern_release forgets every string first
+// interned after the mark, older ones stay as they are, so memory can be given
+// back between independent pieces of work (see parser_stream). Not while
+// shared, and a mark does not survive intern_clear.
+typedef struct
+{
+    void *block;
+    size_t used;
+} InternMark;
+
+InternMark intern_mark(void);
+void intern_release(InternMark mark);
+
+#endif //INTERN_H
@@ -0,0 +1,212 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Every keyword of the language, in TokenType order. Shared by the lexer
+ * and tools/keyword_gen.c, which turns it into a perfect-hash table at build
+ * time. '@' (TOK_AT) is punctuation and has no spelling here. */
+#define QK_KEYWORDS(X) \
+    /* Literals */ \
+    X("true",          TOK_TRUE) \
+    X("false",         TOK_FALSE) \
+    X("null",          TOK_NULL) \
+    X("nil",           TOK_NIL) \
+    X("none",          TOK_NONE) \
+    /* Declarations / Structure */ \
+    X("new",           TOK_NEW) \
+    X("class",         TOK_CLASS) \
+    X("object",        TOK_OBJECT) \
+    X("funct",         TOK_FUNCT) \
+    X("enum",          TOK_ENUM) \
+    X("template",      TOK_TEMPLATE) \
+    X("generic",       TOK_GENERIC) \
+    /* Control Flow */ \
+    X("if",            TOK_IF) \
+    X("then",          TOK_THEN) \
+    X("else",          TOK_ELSE) \
+    X("elif",          TOK_ELIF) \
+    X("for",           TOK_FOR) \
+    X("while",         TOK_WHILE) \
+    X("do",            TOK_DO) \
+    X("until",         TOK_UNTIL) \
+    X("foreach",       TOK_FOREACH) \
+    X("break",         TOK_BREAK) \
+    X("continue",      TOK_CONTINUE) \
+    X("exit",          TOK_EXIT) \
+    X("pass",          TOK_PASS) \
+    X("yield",         TOK_YIELD) \
+    X("resume",        TOK_RESUME) \
+    /* Exception / Error Handling */ \
+    X("try",           TOK_TRY) \
+    X("except",        TOK_EXCEPT) \
+    X("catch",         TOK_CATCH) \
+    X("finally",       TOK_FINALLY) \
+    X("raise",         TOK_RAISE) \
+    X("throw",         TOK_THROW) \
+    /* Logic */ \
+    X("and",           TOK_AND) \
+    X("or",            TOK_OR) \
+    X("not",           TOK_NOT) \
+    X("nand",          TOK_NAND) \
+    X("nor",           TOK_NOR) \
+    X("xor",           TOK_XOR) \
+    X("xnor",          TOK_XNOR) \
+    /* I/O */ \
+    X("read",          TOK_READ) \
+    X("write",         TOK_WRITE) \
+    X("log",           TOK_LOG) \
+    X("input",         TOK_INPUT) \
+    /* Scope & Storage */ \
+    X("global",        TOK_GLOBAL) \
+    X("local",         TOK_LOCAL) \
+    X("static",        TOK_STATIC) \
+    X("persistent",    TOK_PERSISTENT) \
+    X("volatile",      TOK_VOLATILE) \
+    /* Types */ \
+    X("void",          TOK_VOID) \
+    X("str",           TOK_STR) \
+    X("int",           TOK_INT) \
+    X("float",         TOK_FLOAT) \
+    X("double",        TOK_DOUBLE) \
+    X("byte",          TOK_BYTE) \
+    X("bool",          TOK_BOOL) \
+    X("char",          TOK_CHAR) \
+    X("array",         TOK_ARRAY) \
+    X("list",          TOK_LIST) \
+    X("dict",          TOK_DICT) \
+    X("map",           TOK_MAP) \
+    X("set",           TOK_SET) \
+    /* Type Operations */ \
+    X("cast",          TOK_CAST) \
+    X("typeof",        TOK_TYPEOF) \
+    X("sizeof",        TOK_SIZEOF) \
+    X("length",        TOK_LENGTH) \
+    X("count",         TOK_COUNT) \
+    /* Import / Export / Interop */ \
+    X("import",        TOK_IMPORT) \
+    X("export",        TOK_EXPORT) \
+    X("as",            TOK_AS) \
+    /* File / Language Identifiers */ \
+    X("joey",          TOK_JOEY) \
+    X("qk",            TOK_QK) \
+    X("quokka",        TOK_QUOKKA) \
+    /* USB / Device */ \
+    X("usbin",         TOK_USBIN) \
+    X("usbout",        TOK_USBOUT) \
+    X("send",          TOK_SEND) \
+    X("receive",       TOK_RECEIVE) \
+    X("transmit",      TOK_TRANSMIT) \
+    X("device",        TOK_DEVICE) \
+    X("connect",       TOK_CONNECT) \
+    X("disconnect",    TOK_DISCONNECT) \
+    X("timeout",       TOK_TIMEOUT) \
+    X("status",        TOK_STATUS) \
+    X("attach",        TOK_ATTACH) \
+    X("detach",        TOK_DETACH) \
+    X("route",         TOK_ROUTE) \
+    X("reroute",       TOK_REROUTE) \
+    /* Transmission Integrity */ \
+    X("checksum",      TOK_CHECKSUM) \
+    X("hash",          TOK_HASH) \
+    X("sign",          TOK_SIGN) \
+    X("verify",        TOK_VERIFY) \
+    /* Sync / Concurrency */ \
+    X("sync",          TOK_SYNC) \
+    X("async",         TOK_ASYNC) \
+    X("await",         TOK_AWAIT) \
+    X("daemon",        TOK_DAEMON) \
+    X("thread",        TOK_THREAD) \
+    X("task",          TOK_TASK) \
+    X("lock",          TOK_LOCK) \
+    X("unlock",        TOK_UNLOCK) \
+    X("mutex",         TOK_MUTEX) \
+    X("priority",      TOK_PRIORITY) \
+    /* Memory */ \
+    X("allocate",      TOK_ALLOCATE) \
+    X("free",          TOK_FREE) \
+    X("malloc",        TOK_MALLOC) \
+    X("dispose",       TOK_DISPOSE) \
+    /* Buffers / Queues */ \
+    X("queue",         TOK_QUEUE) \
+    X("buffer",        TOK_BUFFER) \
+    X("push",          TOK_PUSH) \
+    X("pop",           TOK_POP) \
+    X("shift",         TOK_SHIFT) \
+    X("unshift",       TOK_UNSHIFT) \
+    /* Lifecycle */ \
+    X("finalize",      TOK_FINALIZE) \
+    X("close",         TOK_CLOSE) \
+    X("reset",         TOK_RESET) \
+    X("restart",       TOK_RESTART) \
+    X("watchdog",      TOK_WATCHDOG) \
+    /* Compression / Encoding */ \
+    X("compress",      TOK_COMPRESS) \
+    X("decompress",    TOK_DECOMPRESS) \
+    X("encode",        TOK_ENCODE) \
+    X("decode",        TOK_DECODE) \
+    /* Security */ \
+    X("authorize",     TOK_AUTHORIZE) \
+    X("authenticate",  TOK_AUTHENTICATE) \
+    /* Observability */ \
+    X("debug",         TOK_DEBUG) \
+    X("trace",         TOK_TRACE) \
+    X("observe",       TOK_OBSERVE) \
+    X("emit",          TOK_EMIT) \
+    X("profile",       TOK_PROFILE) \
+    X("stats",         TOK_STATS) \
+    /* Configuration */ \
+    X("configure",     TOK_CONFIGURE) \
+    X("setup",         TOK_SETUP) \
+    X("mode",          TOK_MODE) \
+    X("profile_mode",  TOK_PROFILE_MODE) \
+    /* Validation */ \
+    X("schema",        TOK_SCHEMA) \
+    X("contract",      TOK_CONTRACT) \
+    X("validate",      TOK_VALIDATE) \
+    /* References */ \
+    X("alias",         TOK_ALIAS) \
+    X("ref",           TOK_REF) \
+    X("pointer",       TOK_POINTER) \
+    /* Execution */ \
+    X("exec",          TOK_EXEC) \
+    X("eval",          TOK_EVAL) \
+    /* Events */ \
+    X("onconnect",     TOK_ONCONNECT) \
+    X("onreceive",     TOK_ONRECEIVE) \
+    X("onerror",       TOK_ONERROR) \
+    X("ondisconnect",  TOK_ONDISCONNECT) \
+    /* Metadata */ \
+    X("header",        TOK_HEADER) \
+    X("footer",        TOK_FOOTER) \
+    /* Iteration Helpers */ \
+    X("range",         TOK_RANGE) \
+    X("step",          TOK_STEP)
+
+#define KEYWORD_MAX_LENGTH 16
+
+static inline int keyword_fold(int c)
+{
+    /* keywords are plain ASCII, setting 0x20 lowercases letters and leaves
+     * digits alone; '_' maps to 0x7f which no other identifier byte can */
+    return c | 0x20;
+}
+
+/* FNV-1a over the case-folded bytes, finished with a murmur3 style mix so
+ * that the seed search in keyword_gen converges quickly */
+static inline uint32_t keyword_hash(uint32_t seed, const char *s, size_t len)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (uint32_t)keyword_fold((unsigned char)s[i]);
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+#endif //KEYWORDS_H
@@ -3,229 +3,714 @@
 //
 
 #include "lexer.h"
-#include "compat.h"
+#include "filemap.h"
+#include "keywords.h"
+#include "keyword_table.h"
+#include "scan.h"
+#include "thread.h"
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <stdint.h>
+
+#define LEXER_CHUNK 65536
+
+static size_t lexerOffset(const Lexer *lx)
+{
+    return lx->buffer_offset + (size_t)(lx->pos - lx->buffer);
+}
+
+/* Streaming path only: slide everything from the oldest token that may still
+ * be in use to the front of the window and top it up from the file. Returns 0
+ * once the input is exhausted. */
+static int lexerFill(Lexer *lx)
+{
+    if (!lx->file) return 0;
+
+    size_t keep = lx->keep[0];
+    size_t retained = lx->buffer_offset + (size_t)(lx->end - lx->buffer) - keep;
+    size_t pos = lexerOffset(lx) - keep;
+    size_t from = keep - lx->buffer_offset;
+
+    // a token longer than the window keeps everything from its start alive.
+    // Doubling keeps the copying for an N byte token at O(N) overall.
+    if (lx->window_size - retained < LEXER_CHUNK / 4)
+    {
+        size_t size = lx->window_size * 2;
+        if (size < retained + LEXER_CHUNK) size = retained + LEXER_CHUNK;
+        lx->window_size = size;
+        lx->window = realloc(lx->window, lx->window_size);
+    }
+    if (from > 0)
+    {
+        memmove(lx->window, lx->window + from, retained);
+    }
+
+    size_t n = fread(lx->window + retained, 1, lx->window_size - retained, lx->file);
+    lx->buffer = lx->window;
+    lx->buffer_offset = keep;
+    lx->pos = lx->window + pos;
+    lx->end = lx->window + retained + n;
+    return n > 0;
+}
+
+static int lexerPeekSlow(Lexer *lx, size_t k)
+{
+    while ((size_t)(lx->end - lx->pos) <= k)
+    {
+        if (!lexerFill(lx)) return EOF;
+    }
+    return (unsigned char)lx->pos[k];
+}
+
+static inline int lexerPeek(Lexer *lx, size_t k)
+{
+    if ((size_t)(lx->end - lx->pos) > k)
+        return (unsigned char)lx->pos[k];
+    return lexerPeekSlow(lx, k);
+}
 
 static void lexerAdvance(Lexer *lx)
 {
-    if (lx->current == '\n')
+    if (lx->pos == lx->end && lexerPeekSlow(lx, 0) == EOF) return;
+
+    if (*lx->pos == '\n')
     {
         lx->line++;
         lx->column = 0;
-    } else if (lx->current != EOF)
+    } else
     {
         lx->column++;
     }
+    lx->pos++;
+}
 
-    lx->current = lx->next;
-    lx->next = fgetc(lx->file);
+// Skips n buffered bytes that hold no newline
+static inline void lexerSkipColumns(Lexer *lx, size_t n)
+{
+    if (n == 0) return;
+
+    lx->column += (int)n;
+    lx->pos += n;
 }
 
-static void lexerSkipWhitespace(Lexer *lx)
+// Skips n buffered bytes, counting their newlines in bulk
+static inline void lexerSkipLines(Lexer *lx, size_t n)
 {
-    for (;;)
-    {
-        while (isspace(lx->current))
-        {
-            lexerAdvance(lx);
-        }
+    if (n == 0) return;
 
-        if (lx->current == '/' && lx->next == '/')
-        {
-            while (lx->current != '\n' && lx->current != EOF)
-            {
-                lexerAdvance(lx);
-            }
-        } else
-        {
-            break;
-        }
+    size_t last = 0;
+    size_t lines = scan_newlines(lx->pos, n, &last);
+    if (lines)
+    {
+        lx->line += (int)lines;
+        lx->column = (int)(n - last - 1);
+    } else
+    {
+        lx->column += (int)n;
     }
+    lx->pos += n;
 }
 
 typedef struct
 {
     const char *name;
+    unsigned char length;
     TokenType type;
 } Keyword;
 
+#define KEYWORD_ENTRY(name, type) { name, sizeof(name) - 1, type },
 static const Keyword keywords[] = {
-    { "new", TOK_NEW },
-    { "if", TOK_IF },
-    { "then", TOK_THEN },
-    { "else", TOK_ELSE },
-    {"try", TOK_TRY},
-    {"except", TOK_EXCEPT},
-    {"finally", TOK_FINALLY},
-    { "and", TOK_AND },
-    { "or", TOK_OR },
-    { "not", TOK_NOT },
-    { "send", TOK_SEND },
-    { "receive", TOK_RECEIVE },
-    { "usbin", TOK_USBIN },
-    { "usbout", TOK_USBOUT },
-    {"as", TOK_AS},
-    {"funct", TOK_FUNCT},
-    {"import", TOK_IMPORT},
-    { NULL, TOK_UNKNOWN }
+    QK_KEYWORDS(KEYWORD_ENTRY)
 };
+#undef KEYWORD_ENTRY
+
+_Static_assert(sizeof(keywords) / sizeof(keywords[0]) == TOK_STEP - TOK_TRUE,
+    "QK_KEYWORDS must spell every keyword token from TOK_TRUE to TOK_STEP except TOK_AT");
+
+TokenType lexerKeyword(const char *text, size_t length)
+{
+    if (length == 0 || length > KEYWORD_MAX_LENGTH) return TOK_IDENTIFIER;
+
+    uint32_t slot = keyword_hash(KEYWORD_SEED, text, length) & ((1u << KEYWORD_TABLE_BITS) - 1);
+    unsigned index = keyword_slots[slot];
+    if (!index) return TOK_IDENTIFIER;
+
+    const Keyword *kw = &keywords[index - 1];
+    if (kw->length != length) return TOK_IDENTIFIER;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (keyword_fold((unsigned char)text[i]) != keyword_fold((unsigned char)kw->name[i]))
+            return TOK_IDENTIFIER;
+    }
+    return kw->type;
+}
+
+const char *lexerKeywordName(TokenType type)
+{
+    // QK_KEYWORDS follows TokenType order from TOK_TRUE, skipping only TOK_AT
+    if (type < TOK_TRUE || type > TOK_STEP || type == TOK_AT) return NULL;
+    return keywords[type - TOK_TRUE - (type > TOK_AT)].name;
+}
 
-static Token makeToken(Lexer *lx, TokenType type, const char *value, int col)
+static Token makeToken(Lexer *lx, TokenType type, size_t offset, int col)
 {
     Token tok;
     tok.type = type;
-    tok.value = value ? strdup(value) : NULL;
+    tok.offset = offset;
+    tok.length = lexerOffset(lx) - offset;
     tok.line = lx->line;
     tok.column = col;
     return tok;
 }
 
-static Token lexerIdentifier(Lexer *lx)
+Lexer *lexerInitBuffer(const char *source, size_t length)
+{
+    Lexer *lx = malloc(sizeof(Lexer));
+    lx->file = NULL;
+    lx->map = NULL;
+    lx->buffer = source;
+    lx->buffer_offset = 0;
+    lx->pos = source;
+    lx->end = source + length;
+    lx->window = NULL;
+    lx->window_size = 0;
+    lx->keep[0] = 0;
+    lx->keep[1] = 0;
+    lx->line = 1;
+    lx->column = 0;
+    return lx;
+}
+
+Lexer *lexerInit(FILE *file)
+{
+    Lexer *lx = lexerInitBuffer(NULL, 0);
+    lx->file = file;
+    return lx;
+}
+
+Lexer *lexerInitPath(const char *path)
+{
+    FileMap *map = filemap_open(path);
+    if (!map) return NULL;
+
+    Lexer *lx = lexerInitBuffer(map->data, map->size);
+    lx->map = map;
+    return lx;
+}
+
+/* Scanning is a DFA over character classes. Both tables are plain constant
+ * data, so dispatch is two loads per character and nothing depends on the
+ * C locale: bytes outside ASCII are always CC_OTHER. */
+typedef enum
 {
-    char buf[256];
-    int len = 0;
-    int col = lx->column;
+    CC_OTHER,
+    CC_SPACE,
+    CC_NEWLINE,
+    CC_ALPHA,       // letters and '_'
+    CC_DIGIT,
+    CC_DOT,
+    CC_QUOTE,
+    CC_BACKSLASH,
+    CC_SLASH,
+    CC_EQUAL,
+    CC_BANG,
+    CC_LESS,
+    CC_GREATER,
+    CC_PUNCT,       // single character tokens, see lexer_single
+    CC_EOF,
+    CC_COUNT
+} CharClass;
 
-    while (isalnum(lx->current) || lx->current == '_')
+static const uint8_t char_class[256] = {
+    [' '] = CC_SPACE, ['\t'] = CC_SPACE, ['\v'] = CC_SPACE, ['\f'] = CC_SPACE, ['\r'] = CC_SPACE,
+    ['\n'] = CC_NEWLINE,
+    ['A'] = CC_ALPHA, ['B'] = CC_ALPHA, ['C'] = CC_ALPHA, ['D'] = CC_ALPHA, ['E'] = CC_ALPHA,
+    ['F'] = CC_ALPHA, ['G'] = CC_ALPHA, ['H'] = CC_ALPHA, ['I'] = CC_ALPHA, ['J'] = CC_ALPHA,
+    ['K'] = CC_ALPHA, ['L'] = CC_ALPHA, ['M'] = CC_ALPHA, ['N'] = CC_ALPHA, ['O'] = CC_ALPHA,
+    ['P'] = CC_ALPHA, ['Q'] = CC_ALPHA, ['R'] = CC_ALPHA, ['S'] = CC_ALPHA, ['T'] = CC_ALPHA,
+    ['U'] = CC_ALPHA, ['V'] = CC_ALPHA, ['W'] = CC_ALPHA, ['X'] = CC_ALPHA, ['Y'] = CC_ALPHA,
+    ['Z'] = CC_ALPHA,
+    ['a'] = CC_ALPHA, ['b'] = CC_ALPHA, ['c'] = CC_ALPHA, ['d'] = CC_ALPHA, ['e'] = CC_ALPHA,
+    ['f'] = CC_ALPHA, ['g'] = CC_ALPHA, ['h'] = CC_ALPHA, ['i'] = CC_ALPHA, ['j'] = CC_ALPHA,
+    ['k'] = CC_ALPHA, ['l'] = CC_ALPHA, ['m'] = CC_ALPHA, ['n'] = CC_ALPHA, ['o'] = CC_ALPHA,
+    ['p'] = CC_ALPHA, ['q'] = CC_ALPHA, ['r'] = CC_ALPHA, ['s'] = CC_ALPHA, ['t'] = CC_ALPHA,
+    ['u'] = CC_ALPHA, ['v'] = CC_ALPHA, ['w'] = CC_ALPHA, ['x'] = CC_ALPHA, ['y'] = CC_ALPHA,
+    ['z'] = CC_ALPHA, ['_'] = CC_ALPHA,
+    ['0'] = CC_DIGIT, ['1'] = CC_DIGIT, ['2'] = CC_DIGIT, ['3'] = CC_DIGIT, ['4'] = CC_DIGIT,
+    ['5'] = CC_DIGIT, ['6'] = CC_DIGIT, ['7'] = CC_DIGIT, ['8'] = CC_DIGIT, ['9'] = CC_DIGIT,
+    ['.'] = CC_DOT,
+    ['"'] = CC_QUOTE,
+    ['\\'] = CC_BACKSLASH,
+    ['/'] = CC_SLASH,
+    ['='] = CC_EQUAL,
+    ['!'] = CC_BANG,
+    ['<'] = CC_LESS,
+    ['>'] = CC_GREATER,
+    ['@'] = CC_PUNCT, ['+'] = CC_PUNCT, ['-'] = CC_PUNCT, ['*'] = CC_PUNCT, ['%'] = CC_PUNCT,
+    ['('] = CC_PUNCT, [')'] = CC_PUNCT, ['{'] = CC_PUNCT, ['}'] = CC_PUNCT, ['['] = CC_PUNCT,
+    [']'] = CC_PUNCT, [','] = CC_PUNCT, [':'] = CC_PUNCT, [';'] = CC_PUNCT,
+};
+
+static const TokenType lexer_single[256] = {
+    ['@'] = TOK_AT, ['+'] = TOK_PLUS, ['-'] = TOK_MINUS, ['*'] = TOK_STAR, ['%'] = TOK_PERCENT,
+    ['('] = TOK_LPAREN, [')'] = TOK_RPAREN, ['{'] = TOK_LBRACE, ['}'] = TOK_RBRACE,
+    ['['] = TOK_LBRACKET, [']'] = TOK_RBRACKET, [','] = TOK_COMMA, ['.'] = TOK_DOT,
+    [':'] = TOK_COLON, [';'] = TOK_SEMICOLON,
+};
+
+/* LS_EMIT is 0 so that every transition the table leaves out means "stop
+ * here, the token for the current state ends before this character". */
+typedef enum
+{
+    LS_EMIT,
+    LS_START,
+    LS_COMMENT,
+    LS_SLASH,
+    LS_IDENT,
+    LS_NUMBER,
+    LS_STRING,
+    LS_STRING_ESC,
+    LS_STRING_END,
+    LS_EQ,
+    LS_EQ_EQ,
+    LS_BANG,
+    LS_BANG_EQ,
+    LS_LT,
+    LS_LT_EQ,
+    LS_GT,
+    LS_GT_EQ,
+    LS_SINGLE,
+    LS_UNKNOWN,
+    LS_COUNT
+} LexState;
+
+#define LS_ANY(state) \
+    [CC_OTHER] = state, [CC_SPACE] = state, [CC_ALPHA] = state, [CC_DIGIT] = state, \
+    [CC_DOT] = state, [CC_SLASH] = state, [CC_EQUAL] = state, [CC_BANG] = state, \
+    [CC_LESS] = state, [CC_GREATER] = state, [CC_PUNCT] = state
+
+static const uint8_t lexer_transition[LS_COUNT][CC_COUNT] = {
+    [LS_START] = {
+        [CC_SPACE] = LS_START, [CC_NEWLINE] = LS_START,
+        [CC_ALPHA] = LS_IDENT, [CC_DIGIT] = LS_NUMBER, [CC_DOT] = LS_SINGLE,
+        [CC_QUOTE] = LS_STRING, [CC_SLASH] = LS_SLASH,
+        [CC_EQUAL] = LS_EQ, [CC_BANG] = LS_BANG, [CC_LESS] = LS_LT, [CC_GREATER] = LS_GT,
+        [CC_PUNCT] = LS_SINGLE, [CC_OTHER] = LS_UNKNOWN, [CC_BACKSLASH] = LS_UNKNOWN,
+    },
+    // a comment runs up to the newline, which is then skipped as whitespace
+    [LS_COMMENT] = {
+        LS_ANY(LS_COMMENT), [CC_QUOTE] = LS_COMMENT, [CC_BACKSLASH] = LS_COMMENT,
+        [CC_NEWLINE] = LS_START, [CC_EOF] = LS_START,
+    },
+    [LS_SLASH] = { [CC_SLASH] = LS_COMMENT },
+    [LS_IDENT] = { [CC_ALPHA] = LS_IDENT, [CC_DIGIT] = LS_IDENT },
+    [LS_NUMBER] = { [CC_DIGIT] = LS_NUMBER, [CC_DOT] = LS_NUMBER },
+    [LS_STRING] = {
+        LS_ANY(LS_STRING), [CC_NEWLINE] = LS_STRING,
+        [CC_BACKSLASH] = LS_STRING_ESC, [CC_QUOTE] = LS_STRING_END,
+    },
+    [LS_STRING_ESC] = {
+        LS_ANY(LS_STRING), [CC_NEWLINE] = LS_STRING,
+        [CC_BACKSLASH] = LS_STRING, [CC_QUOTE] = LS_STRING,
+    },
+    [LS_EQ] = { [CC_EQUAL] = LS_EQ_EQ },
+    [LS_BANG] = { [CC_EQUAL] = LS_BANG_EQ },
+    [LS_LT] = { [CC_EQUAL] = LS_LT_EQ },
+    [LS_GT] = { [CC_EQUAL] = LS_GT_EQ },
+};
+
+static const TokenType lexer_accept[LS_COUNT] = {
+    [LS_START] = TOK_EOF,
+    [LS_SLASH] = TOK_SLASH,
+    [LS_IDENT] = TOK_IDENTIFIER,
+    [LS_NUMBER] = TOK_NUMBER,
+    [LS_STRING] = TOK_STRING,
+    [LS_STRING_ESC] = TOK_STRING,
+    [LS_STRING_END] = TOK_STRING,
+    [LS_EQ] = TOK_ASSIGN,
+    [LS_EQ_EQ] = TOK_EQUAL,
+    [LS_BANG] = TOK_UNKNOWN,
+    [LS_BANG_EQ] = TOK_NOT_EQUAL,
+    [LS_LT] = TOK_LT,
+    [LS_LT_EQ] = TOK_LE,
+    [LS_GT] = TOK_GT,
+    [LS_GT_EQ] = TOK_GE,
+    [LS_UNKNOWN] = TOK_UNKNOWN,
+};
+
+static inline CharClass lexerClass(int c)
+{
+    return c == EOF ? CC_EOF : (CharClass)char_class[c];
+}
+
+static Token lexerScan(Lexer *lx)
+{
+    LexState state = LS_START;
+    size_t start = 0;
+    int col = 0;
+    int first = EOF;
+
+    for (;;)
     {
-        buf[len++] = lx->current;
+        // jump over runs that cannot leave the current state. The kernels only
+        // see what is buffered, the table picks up at the window's end.
+        size_t avail = (size_t)(lx->end - lx->pos);
+        switch (state)
+        {
+            case LS_START: lexerSkipLines(lx, scan_space(lx->pos, avail)); break;
+            case LS_COMMENT: lexerSkipColumns(lx, scan_line(lx->pos, avail)); break;
+            case LS_IDENT: lexerSkipColumns(lx, scan_ident(lx->pos, avail)); break;
+            case LS_STRING: lexerSkipLines(lx, scan_string(lx->pos, avail)); break;
+            default: break;
+        }
+
+        int c = lexerPeek(lx, 0);
+        if (state == LS_START)
+        {
+            // whitespace and comments loop back here, the token starts at c
+            start = lexerOffset(lx);
+            col = lx->column;
+            first = c;
+        }
+
+        LexState next = (LexState)lexer_transition[state][lexerClass(c)];
+        if (next == LS_EMIT) break;
         lexerAdvance(lx);
+        state = next;
+
+        // single character tokens end without looking at the next one
+        if (state == LS_SINGLE || state == LS_UNKNOWN) break;
     }
-    buf[len] = '\0';
 
-    for (int i = 0; keywords[i].name; i++)
+    switch (state)
     {
-        if (strcasecmp(buf, keywords[i].name) == 0)
+        case LS_SINGLE:
+            return makeToken(lx, lexer_single[first], start, col);
+        case LS_IDENT:
         {
-            return makeToken(lx, keywords[i].type, NULL, col);
+            Token tok = makeToken(lx, TOK_IDENTIFIER, start, col);
+            tok.type = lexerKeyword(lexerTokenText(lx, &tok), tok.length);
+            return tok;
         }
+        case LS_STRING:
+        case LS_STRING_ESC:
+        case LS_STRING_END:
+        {
+            // the token covers the raw body, escapes and all, but not the quotes
+            Token tok = makeToken(lx, TOK_STRING, start + 1, col);
+            if (state == LS_STRING_END) tok.length--;
+            return tok;
+        }
+        default:
+            return makeToken(lx, lexer_accept[state], start, col);
     }
+}
 
-    return makeToken(lx, TOK_IDENTIFIER, buf, col);
+void lexerSeek(Lexer *lx, size_t offset, int line, int column)
+{
+    lx->pos = lx->buffer + (offset - lx->buffer_offset);
+    lx->line = line;
+    lx->column = column;
+    lx->keep[0] = lx->keep[1] = offset;
 }
 
-static Token lexerNumeric(Lexer *lx)
+Token lexerNextToken(Lexer *lx)
 {
-    char buf[256];
-    int len = 0;
-    int col = lx->column;
+    Token tok = lexerScan(lx);
 
-    while (isdigit(lx->current) || lx->current == '.')
+    // the streaming window keeps the last two tokens' text alive
+    lx->keep[0] = lx->keep[1];
+    lx->keep[1] = tok.offset;
+    return tok;
+}
+
+_Static_assert(TOK_UNKNOWN <= UINT8_MAX, "TokenStream stores token types in a byte");
+
+TokenStream *lexerTokenizeAll(Lexer *lx)
+{
+    TokenStream *ts = calloc(1, sizeof(TokenStream));
+
+    // roughly one token per six bytes of script, refined by doubling
+    size_t capacity = (size_t)(lx->end - lx->pos) / 6 + 256;
+    for (;;)
     {
-        buf[len++] = lx->current;
-        lexerAdvance(lx);
+        if (ts->count == ts->capacity)
+        {
+            ts->capacity = ts->capacity ? ts->capacity * 2 : capacity;
+            ts->type = realloc(ts->type, ts->capacity);
+            ts->offset = realloc(ts->offset, sizeof(size_t) * ts->capacity);
+            ts->length = realloc(ts->length, sizeof(size_t) * ts->capacity);
+            ts->line = realloc(ts->line, sizeof(int) * ts->capacity);
+            ts->column = realloc(ts->column, sizeof(int) * ts->capacity);
+        }
+
+        // keep[] is left alone, so the streaming window retains everything
+        Token tok = lexerScan(lx);
+        size_t i = ts->count++;
+        ts->type[i] = (uint8_t)tok.type;
+        ts->offset[i] = tok.offset;
+        ts->length[i] = tok.length;
+        ts->line[i] = tok.line;
+        ts->column[i] = tok.column;
+        if (tok.type == TOK_EOF) break;
     }
-    buf[len] = '\0';
 
-    return makeToken(lx, TOK_NUMBER, buf, col);
+    ts->base = lx->buffer;
+    ts->base_offset = lx->buffer_offset;
+    return ts;
+}
+
+void lexerFreeTokens(TokenStream *ts)
+{
+    if (!ts) return;
+    free(ts->type);
+    free(ts->offset);
+    free(ts->length);
+    free(ts->line);
+    free(ts->column);
+    free(ts);
 }
 
-static Token lexerString(Lexer *lx)
+/* Parallel lexing splits the source after newlines where the serial lexer
+ * would be back in LS_START. Only strings and comments carry state across a
+ * line, so finding those splits needs just this reduced machine. A range's
+ * end state depends on the state it starts in, so each worker first maps
+ * every possible start state to an end state, and chaining the maps gives
+ * the true state at each range boundary. */
+typedef enum
 {
-    char buf[1024];
-    /* Strings are greedy bastards */
-    int len = 0;
-    int col = lx->column;
+    SPLIT_NORMAL,
+    SPLIT_SLASH,
+    SPLIT_COMMENT,
+    SPLIT_STRING,
+    SPLIT_STRING_ESC,
+    SPLIT_STATES
+} SplitState;
+
+static const uint8_t split_transition[SPLIT_STATES][CC_COUNT] = {
+    [SPLIT_NORMAL] = { [CC_SLASH] = SPLIT_SLASH, [CC_QUOTE] = SPLIT_STRING },
+    [SPLIT_SLASH] = { [CC_SLASH] = SPLIT_COMMENT, [CC_QUOTE] = SPLIT_STRING },
+    [SPLIT_COMMENT] = {
+        LS_ANY(SPLIT_COMMENT), [CC_QUOTE] = SPLIT_COMMENT, [CC_BACKSLASH] = SPLIT_COMMENT,
+    },
+    [SPLIT_STRING] = {
+        LS_ANY(SPLIT_STRING), [CC_NEWLINE] = SPLIT_STRING, [CC_BACKSLASH] = SPLIT_STRING_ESC,
+    },
+    [SPLIT_STRING_ESC] = {
+        LS_ANY(SPLIT_STRING), [CC_NEWLINE] = SPLIT_STRING,
+        [CC_BACKSLASH] = SPLIT_STRING, [CC_QUOTE] = SPLIT_STRING,
+    },
+};
 
-    lexerAdvance(lx); /* skip */
+// below this many bytes per chunk threads cost more than they save
+#define LEXER_PARALLEL_MIN (256 * 1024)
 
-    while (lx->current != '"' && lx->current != EOF)
+typedef struct
+{
+    const char *source;
+    size_t begin;
+    size_t end;
+    uint8_t map[SPLIT_STATES];  // start state -> state at end
+    TokenStream *tokens;        // this chunk's tokens, offsets chunk-relative
+    int lines;                  // newlines in the chunk
+    TokenStream *out;
+    size_t out_index;
+    size_t line_base;
+    int last;
+} LexChunk;
+
+// Runs the split machine from every start state at once. Paths that reach the
+// same state stay merged, which usually leaves two: inside a string or not.
+static void lexerSplitMap(void *arg)
+{
+    LexChunk *chunk = arg;
+    uint8_t state[SPLIT_STATES];
+    uint8_t path[SPLIT_STATES];     // start state -> index into state[]
+    int paths = SPLIT_STATES;
+    for (int i = 0; i < SPLIT_STATES; i++)
     {
-        if (lx->current == '\\')
+        state[i] = (uint8_t)i;
+        path[i] = (uint8_t)i;
+    }
+
+    int pending = 1;    // some path is in SLASH or STRING_ESC, which any byte ends
+    for (size_t i = chunk->begin; i < chunk->end; i++)
+    {
+        // otherwise only these bytes can move a path at all
+        if (!pending)
         {
-            lexerAdvance(lx);
+            i += scan_split(chunk->source + i, chunk->end - i);
+            if (i == chunk->end) break;
+        }
+
+        uint8_t cls = char_class[(unsigned char)chunk->source[i]];
+        pending = 0;
+        for (int k = 0; k < paths; k++)
+        {
+            state[k] = split_transition[state[k]][cls];
+            pending |= state[k] == SPLIT_SLASH || state[k] == SPLIT_STRING_ESC;
         }
-        buf[len++] = lx->current;
-        lexerAdvance(lx);
-    }
 
-    lexerAdvance(lx);
-    buf[len] = '\0';
+        if (paths > 1 && cls == CC_NEWLINE)
+        {
+            // newlines are where comment paths rejoin the normal one
+            int merged = 0;
+            uint8_t moved[SPLIT_STATES];
+            for (int k = 0; k < paths; k++)
+            {
+                int m = 0;
+                while (m < merged && state[m] != state[k]) m++;
+                if (m == merged) state[merged++] = state[k];
+                moved[k] = (uint8_t)m;
+            }
+            for (int s = 0; s < SPLIT_STATES; s++)
+                path[s] = moved[path[s]];
+            paths = merged;
+        }
+    }
 
-    return makeToken(lx, TOK_STRING, buf, col);
+    for (int s = 0; s < SPLIT_STATES; s++)
+        chunk->map[s] = state[path[s]];
 }
 
-Lexer *lexerInit(FILE *file)
+static void lexerChunkTokens(void *arg)
 {
-    Lexer *lx = malloc(sizeof(Lexer));
-    lx->file = file;
-    lx->line = 1;
-    lx->column = 0;
-    lx->current = fgetc(file);
-    lx->next = fgetc(file);
-    return lx;
+    LexChunk *chunk = arg;
+    Lexer *lx = lexerInitBuffer(chunk->source + chunk->begin, chunk->end - chunk->begin);
+    chunk->tokens = lexerTokenizeAll(lx);
+    chunk->lines = lx->line - 1;
+    lexerFree(lx);
 }
 
-Token lexerNextToken(Lexer *lx)
+// Copies a chunk's tokens into the joint stream, dropping its EOF unless it
+// is the last chunk
+static void lexerChunkStitch(void *arg)
 {
-    lexerSkipWhitespace(lx);
+    LexChunk *chunk = arg;
+    TokenStream *in = chunk->tokens;
+    TokenStream *out = chunk->out;
+    size_t count = chunk->last ? in->count : in->count - 1;
+    size_t at = chunk->out_index;
 
-    if (lx->current == EOF)
+    memcpy(out->type + at, in->type, count);
+    memcpy(out->length + at, in->length, sizeof(size_t) * count);
+    memcpy(out->column + at, in->column, sizeof(int) * count);
+    for (size_t i = 0; i < count; i++)
     {
-        return makeToken(lx, TOK_EOF, NULL, lx->column);
+        out->offset[at + i] = in->offset[i] + chunk->begin;
+        out->line[at + i] = in->line[i] + (int)chunk->line_base;
     }
+}
 
-    if (isalpha(lx->current) || lx->current == '_')
-        return lexerIdentifier(lx);
-    if (isdigit(lx->current))
-        return lexerNumeric(lx);
-    if (lx->current == '"')
-        return lexerString(lx);
-
-    int col = lx->column;
-
-    if (lx->current == '=' && lx->next == '=') {
-        lexerAdvance(lx);
-        lexerAdvance(lx);
-        return makeToken(lx, TOK_EQUAL, NULL, col);
+static void lexerRunChunks(LexChunk *chunks, int count, ThreadFn fn)
+{
+    Thread *threads[64];
+    for (int i = 1; i < count; i++)
+    {
+        threads[i] = thread_start(fn, &chunks[i]);
+        if (!threads[i]) fn(&chunks[i]);
     }
-    if (lx->current == '!' && lx->next == '=') {
-        lexerAdvance(lx);
-        lexerAdvance(lx);
-        return makeToken(lx, TOK_NOT_EQUAL, NULL, col);
+    fn(&chunks[0]);
+    for (int i = 1; i < count; i++)
+        thread_join(threads[i]);
+}
+
+TokenStream *lexerTokenizeParallel(const char *source, size_t length, int threads)
+{
+    if (threads <= 0) threads = thread_hardware_count();
+    if (threads > 64) threads = 64;
+    if ((size_t)threads > length / LEXER_PARALLEL_MIN) threads = (int)(length / LEXER_PARALLEL_MIN);
+    if (threads <= 1)
+    {
+        Lexer *lx = lexerInitBuffer(source, length);
+        TokenStream *ts = lexerTokenizeAll(lx);
+        lexerFree(lx);
+        return ts;
     }
-    if (lx->current == '<' && lx->next == '=') {
-        lexerAdvance(lx);
-        lexerAdvance(lx);
-        return makeToken(lx, TOK_LE, NULL, col);
+
+    LexChunk *chunks = calloc((size_t)threads, sizeof(LexChunk));
+    for (int i = 0; i < threads; i++)
+    {
+        chunks[i].source = source;
+        chunks[i].begin = length / (size_t)threads * (size_t)i;
+        chunks[i].end = i + 1 < threads ? length / (size_t)threads * (size_t)(i + 1) : length;
     }
-    if (lx->current == '>' && lx->next == '=') {
-        lexerAdvance(lx);
-        lexerAdvance(lx);
-        return makeToken(lx, TOK_GE, NULL, col);
+    lexerRunChunks(chunks, threads, lexerSplitMap);
+
+    // move each boundary forward to the first newline outside a string
+    SplitState state = SPLIT_NORMAL;
+    size_t split = 0;
+    for (int i = 1; i < threads; i++)
+    {
+        state = (SplitState)chunks[i - 1].map[state];
+        size_t at = chunks[i].begin;
+        SplitState s = state;
+        if (at < split)
+        {
+            at = split;
+            s = SPLIT_NORMAL;
+        }
+        while (at < length)
+        {
+            unsigned char c = (unsigned char)source[at++];
+            int safe = c == '\n' && s != SPLIT_STRING && s != SPLIT_STRING_ESC;
+            s = (SplitState)split_transition[s][char_class[c]];
+            if (safe) break;
+        }
+        chunks[i - 1].end = at;
+        chunks[i].begin = at;
+        split = at;
     }
+    lexerRunChunks(chunks, threads, lexerChunkTokens);
 
-    switch (lx->current)
+    TokenStream *ts = calloc(1, sizeof(TokenStream));
+    size_t lines = 0;
+    for (int i = 0; i < threads; i++)
     {
-        case '@': lexerAdvance(lx); return makeToken(lx, TOK_AT, NULL, col);
-        case '=': lexerAdvance(lx); return makeToken(lx, TOK_ASSIGN, NULL, col);
-        case '<': lexerAdvance(lx); return makeToken(lx, TOK_LT, NULL, col);
-        case '>': lexerAdvance(lx); return makeToken(lx, TOK_GT, NULL, col);
-        case '+': lexerAdvance(lx); return makeToken(lx, TOK_PLUS, NULL, col);
-        case '-': lexerAdvance(lx); return makeToken(lx, TOK_MINUS, NULL, col);
-        case '*': lexerAdvance(lx); return makeToken(lx, TOK_STAR, NULL, col);
-        case '/': lexerAdvance(lx); return makeToken(lx, TOK_SLASH, NULL, col);
-        case '%': lexerAdvance(lx); return makeToken(lx, TOK_PERCENT, NULL, col);
-        case '(': lexerAdvance(lx); return makeToken(lx, TOK_LPAREN, NULL, col);
-        case ')': lexerAdvance(lx); return makeToken(lx, TOK_RPAREN, NULL, col);
-        case '{': lexerAdvance(lx); return makeToken(lx, TOK_LBRACE, NULL, col);
-        case '}': lexerAdvance(lx); return makeToken(lx, TOK_RBRACE, NULL, col);
-        case '[': lexerAdvance(lx); return makeToken(lx, TOK_LBRACKET, NULL, col);
-        case ']': lexerAdvance(lx); return makeToken(lx, TOK_RBRACKET, NULL, col);
-        case ',': lexerAdvance(lx); return makeToken(lx, TOK_COMMA, NULL, col);
-        case '.': lexerAdvance(lx); return makeToken(lx, TOK_DOT, NULL, col);
-        case ':': lexerAdvance(lx); return makeToken(lx, TOK_COLON, NULL, col);
-        case ';': lexerAdvance(lx); return makeToken(lx, TOK_SEMICOLON, NULL, col);
+        chunks[i].out = ts;
+        chunks[i].out_index = ts->count;
+        chunks[i].line_base = lines;
+        chunks[i].last = i == threads - 1;
+        ts->count += chunks[i].tokens->count - 1;
+        lines += (size_t)chunks[i].lines;
     }
+    ts->count++;    // the last chunk's EOF
+    ts->capacity = ts->count;
+    ts->type = malloc(ts->capacity);
+    ts->offset = malloc(sizeof(size_t) * ts->capacity);
+    ts->length = malloc(sizeof(size_t) * ts->capacity);
+    ts->line = malloc(sizeof(int) * ts->capacity);
+    ts->column = malloc(sizeof(int) * ts->capacity);
+    ts->base = source;
+    ts->base_offset = 0;
+    lexerRunChunks(chunks, threads, lexerChunkStitch);
+
+    for (int i = 0; i < threads; i++)
+        lexerFreeTokens(chunks[i].tokens);
+    free(chunks);
+    return ts;
+}
+
+const char *lexerTokenText(const Lexer *lx, const Token *tok)
+{
+    return lx->buffer + (tok->offset - lx->buffer_offset);
+}
 
-    char unknown[2] = { (char)lx->current, '\0'};
-    lexerAdvance(lx);
-    return makeToken(lx, TOK_UNKNOWN, unknown, col);
+size_t lexerUnescape(char *dst, const char *text, size_t length)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (text[i] == '\\' && ++i == length) break;
+        dst[len++] = text[i];
+    }
+    return len;
 }
 
 void lexerFree(Lexer *lx)
 {
+    if (!lx) return;
+    filemap_close(lx->map);
+    free(lx->window);
     free(lx);
 }
@@ -2,6 +2,8 @@
 #define LEXER_H
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
     /* Literals */
@@ -243,26 +245,95 @@ typedef enum {
 
 } TokenType;
 
+struct FileMap;
+
 typedef struct Lexer
 {
-    FILE *file;
-    int current;
-    int next;
+    FILE *file;             // streaming source, NULL when lexing a buffer
+    struct FileMap *map;    // mapping owned by lexerInitPath
+    const char *buffer;     // source bytes, or the streaming window
+    size_t buffer_offset;   // source offset of buffer[0]
+    const char *pos;        // current character
+    const char *end;        // end of the bytes available right now
+    char *window;           // refill buffer for the streaming path
+    size_t window_size;
+    size_t keep[2];         // start offsets of the last two tokens handed out
     int line;
     int column;
 } Lexer;
 
 
+// A view into the source: no text is copied while lexing. String tokens cover
+// the raw body between the quotes, escapes included.
 typedef struct
 {
     TokenType type;
-    char *value;
+    size_t offset;
+    size_t length;
     int line;
     int column;
 } Token;
 
+// The whole input lexed in one go, one array per token field, with the EOF
+// token last. Text offsets resolve against the lexer's buffer, so the stream
+// is only usable while its lexer is alive.
+typedef struct TokenStream
+{
+    size_t count;
+    size_t capacity;
+    uint8_t *type;          // TokenType
+    size_t *offset;
+    size_t *length;
+    int *line;
+    int *column;
+    const char *base;       // text of the token at offset base_offset
+    size_t base_offset;
+} TokenStream;
+
 Lexer *lexerInit(FILE *file);
+Lexer *lexerInitBuffer(const char *source, size_t length);
+Lexer *lexerInitPath(const char *path);
 Token  lexerNextToken(Lexer *lexer);
+// Buffer lexers only: continue from a token start whose position is known
+void lexerSeek(Lexer *lexer, size_t offset, int line, int column);
 void  lexerFree(Lexer *lexer);
 
+// Text of a token lexed by this lexer, not NUL-terminated. Buffer-backed
+// lexers keep it valid for the life of the buffer; on the streaming path it
+// survives until two more tokens have been lexed.
+const char *lexerTokenText(const Lexer *lexer, const Token *tok);
+// Copies a string token's body to dst with escapes resolved, returns its length.
+// dst needs room for tok->length bytes.
+size_t lexerUnescape(char *dst, const char *text, size_t length);
+
+// Lexes everything that is left. On the streaming path the window then holds
+// the rest of the input, so no token's text is ever dropped.
+TokenStream *lexerTokenizeAll(Lexer *lexer);
+void lexerFreeTokens(TokenStream *tokens);
+// Same tokens as lexerTokenizeAll over the buffer, lexed in chunks on up to
+// threads threads (0 for one per hardware thread). Small inputs stay serial.
+// Token text points into source.
+TokenStream *lexerTokenizeParallel(const char *source, size_t length, int threads);
+
+static inline Token lexerStreamToken(const TokenStream *tokens, size_t index)
+{
+    Token tok;
+    tok.type = (TokenType)tokens->type[index];
+    tok.offset = tokens->offset[index];
+    tok.length = tokens->length[index];
+    tok.line = tokens->line[index];
+    tok.column = tokens->column[index];
+    return tok;
+}
+
+static inline const char *lexerStreamText(const TokenStream *tokens, size_t index)
+{
+    return tokens->base + (tokens->offset[index] - tokens->base_offset);
+}
+
+// TOK_IDENTIFIER when text is not a keyword (case-insensitive)
+TokenType lexerKeyword(const char *text, size_t length);
+// canonical lowercase spelling of a keyword token, NULL for anything else
+const char *lexerKeywordName(TokenType type);
+
 #endif
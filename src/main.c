@@ -5,16 +5,133 @@
 #include "ast.h"
 #include "parser.h"
 #include "lexer.h"
+#include "intern.h"
+#include "module.h"
+#include "filemap.h"
+#include "qkc.h"
+#include "ast_binary.h"
+#include "compiler.h"
+#include "device_sim.h"
+#include "vm.h"
 
-int main(int argc, char *argv[])
+typedef struct
+{
+    const char *cache_dir;  // --cache=DIR
+    int emit_binary;        // --emit-ast=bin: write <script>.qka instead of printing the AST
+    int check;              // --check: validate while parsing, print only diagnostics
+    int stream;             // --stream: as --check, a statement at a time in bounded memory
+    int run;                // --run: execute scripts that check out, on simulated devices
+} Options;
+
+// Everything held open while a script is processed
+typedef struct
+{
+    FileMap *source;    // the whole script, when it goes through the cache
+    FILE *file;
+    Lexer *lexer;
+    Parser *parser;
+    Arena *arena;       // holds a tree loaded from the cache
+    Validator *checker; // validating as statements are parsed (--check)
+} Script;
+
+static void script_close(Script *script)
+{
+    if (script->checker) validator_free(validator_finish(script->checker, NULL, 0));
+    parser_free(script->parser);    // the AST goes with the parser's arena
+    lexerFree(script->lexer);
+    if (script->file) fclose(script->file);
+    filemap_close(script->source);
+    arena_free(script->arena);
+}
+
+// writes the AST of script.qk to script.qka, see ast_binary.h
+static int quokka_emit_binary(const char *filename, ASTNode *ast)
 {
-    if (argc < 2)
+    size_t length = strlen(filename);
+    char *path = malloc(length + 1);
+    memcpy(path, filename, length - 3);
+    memcpy(path + length - 3, ".qka", 5);
+
+    FILE *out = fopen(path, "wb");
+    int failed = !out || ast_serialize(ast, out) != 0;
+    if (out && fclose(out) != 0) failed = 1;
+    if (failed)
+        perror(path);
+    else
+        printf("AST written to %s\n", path);
+    free(path);
+    return failed;
+}
+
+typedef struct
+{
+    Validator *checker;
+    ASTNode *imports;   // copies of the script's imports, for module_resolve
+    Arena *arena;       // holds them
+} Stream;
+
+// Validates a streamed statement. Its strings are kept when later work still
+// refers to them: a declared or imported name, the detail of an error.
+static int quokka_stream_statement(ASTNode *statement, void *ctx)
+{
+    Stream *stream = ctx;
+    int errors = validator_error_count(stream->checker);
+    validator_check_statement(statement, stream->checker);
+
+    if (statement->type == AST_IMPORT)
     {
-        fprintf(stderr, "Usage: %s <input_file.qk>\n", argv[0]);
+        ASTNode *import = ast_create(stream->arena, AST_IMPORT, statement->line, statement->column);
+        import->string_value = statement->string_value;
+        ast_add_child(stream->arena, stream->imports, import);
         return 1;
     }
+    return statement->type == AST_DECLARATION || validator_error_count(stream->checker) != errors;
+}
+
+// Runs the imported modules in dependency order and then the script, all on
+// one VM so a device declared in a module is the one the script calls. Device
+// calls are simulated and traced to stdout.
+static int quokka_execute(ASTNode *ast, const ImportGraph *imports)
+{
+    DeviceSim *sim = device_sim_create(stdout);
+    DeviceBackend backend = device_sim_backend(sim);
+    VM *vm = vm_create(&backend);
+    Diagnostics errors;
+    diagnostics_init(&errors);
+
+    int failed = 0;
+    for (size_t i = 0; i <= imports->count && !failed; i++)
+    {
+        ASTNode *program = i < imports->count ? imports->modules[i]->program : ast;
+        Bytecode *code = compiler_compile(program, vm, &errors);
+        const char *kind = "Compile error";
+        if (code && vm_run(vm, code) != 0)
+        {
+            const Diagnostic *error = vm_error(vm);
+            diagnostics_add_detail(&errors, error->line, error->column, error->message, error->detail);
+            kind = "Runtime error";
+        }
+        if (errors.count > 0)
+        {
+            if (i < imports->count)
+                fprintf(stderr, "In %s:\n", imports->modules[i]->path);
+            diagnostics_print(&errors, stderr, kind);
+            failed = 1;
+        }
+        bytecode_free(code);
+    }
+
+    diagnostics_free(&errors);
+    vm_free(vm);
+    device_sim_free(sim);
+    return failed;
+}
 
-    const char *filename = argv[1];
+// Parses one script, loads what it imports and validates it. With a cache
+// directory a script already seen by this version comes out of the cache
+// without being lexed or parsed. Non-zero when anything failed.
+static int quokka_run(const char *filename, ModuleCache *modules, const Options *options)
+{
     const char *ext = filename + strlen(filename) - 3;
     if (strcmp(ext, ".qk") != 0)
     {
@@ -22,57 +139,199 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    FILE *file = fopen(filename, "r");
-
-    Lexer *lexer = lexerInit(file);
-    if (!lexer)
+    Script script = { 0 };
+    ASTNode *ast = NULL;
+    uint64_t key = 0;
+    if (options->cache_dir && !options->stream && (script.source = filemap_open(filename)))
     {
-        fprintf(stderr, "Error: Could not initialize lexer\n");
-        fclose(file);
-        return 1;
+        key = qkc_key(module_content_hash(script.source->data, script.source->size));
+        script.arena = arena_create();
+        ast = qkc_load(options->cache_dir, key, script.source->size, script.arena);
     }
+    int cached = ast != NULL;
 
-    Parser *parser = parser_init(lexer);
-    if (!parser)
+    if (!cached)
     {
-        fprintf(stderr, "Error: Could not initialize parser\n");
-        lexerFree(lexer);
-        fclose(file);
-        return 1;
+        // map the script when we can, stream it through stdio otherwise (pipes, FIFOs)
+        script.lexer = script.source ? lexerInitBuffer(script.source->data, script.source->size)
+            : lexerInitPath(filename);
+        if (!script.lexer)
+        {
+            script.file = fopen(filename, "r");
+            if (!script.file)
+            {
+                perror(filename);
+                script_close(&script);
+                return 1;
+            }
+            script.lexer = lexerInit(script.file);
+        }
+        if (!script.lexer)
+        {
+            fprintf(stderr, "Error: Could not initialize lexer\n");
+            script_close(&script);
+            return 1;
+        }
+
+        script.parser = parser_init(script.lexer);
+        if (!script.parser)
+        {
+            fprintf(stderr, "Error: Could not initialize parser\n");
+            script_close(&script);
+            return 1;
+        }
+
+        if (options->stream)
+        {
+            // only the imports outlive their statement
+            script.arena = arena_create();
+            script.checker = validator_begin();
+            Stream stream = { script.checker, ast_create(script.arena, AST_PROGRAM, 1, 0), script.arena };
+            parser_stream(script.parser, quokka_stream_statement, &stream);
+            ast = stream.imports;
+        } else if (options->check)
+        {
+            script.checker = validator_begin();
+            parser_on_statement(script.parser, validator_check_statement, script.checker);
+            ast = parser_parse(script.parser);
+        } else
+        {
+            ast = parser_parse(script.parser);
+        }
+        if (!ast)
+        {
+            fprintf(stderr, "Error: Could not parse input\n");
+            script_close(&script);
+            return 1;
+        }
+
+        if (script.parser->error_count > 0)
+        {
+            diagnostics_print(&script.parser->diagnostics, stderr, "Parse error");
+            fprintf(stderr, "Parsing failed with %d errors\n", script.parser->error_count);
+        }
     }
+    int parse_errors = script.parser ? script.parser->error_count : 0;
 
-    ASTNode *ast = parser_parse(parser);
-    if (!ast)
+    ImportGraph imports;
+    int import_errors = module_resolve(modules, filename, ast, &imports);
+    diagnostics_print(&imports.diagnostics, stderr, "Import error");
+    for (size_t i = 0; i < imports.count; i++)
     {
-        fprintf(stderr, "Error: Could not parse input\n");
-        parser_free(parser);
-        lexerFree(lexer);
-        fclose(file);
-        return 1;
+        const Module *module = imports.modules[i];
+        if (module->error_count == 0) continue;
+        fprintf(stderr, "In %s:\n", module->path);
+        diagnostics_print(&module->diagnostics, stderr, "Parse error");
+        import_errors += module->error_count;
     }
 
-    if (parser->error_count > 0)
+    int quiet = options->check || options->stream || options->run;
+    int emit_errors = 0;
+    if (options->emit_binary)
+    {
+        emit_errors = quokka_emit_binary(filename, ast);
+    } else if (!quiet)
     {
-        fprintf(stderr, "Parsing failed with %d errors\n", parser->error_count);
+        printf("Abstract\n");
+        ast_print(ast, 0);
     }
 
-    printf("Abstract\n");
-    ast_print(ast, 0);
-
-    printf("\n Validation \n");
-    ValidationResult *result = validator_validate(ast);
+    // Validated even when cached: which devices are declared depends on the
+    // imports, which may have changed since.
+    if (!quiet)
+        printf("\n Validation \n");
+    ASTNode **programs = malloc(sizeof(ASTNode *) * (imports.count + 1));
+    for (size_t i = 0; i < imports.count; i++)
+        programs[i] = imports.modules[i]->program;
+    ValidationResult *result;
+    if (script.checker)
+    {
+        result = validator_finish(script.checker, programs, imports.count);
+        script.checker = NULL;
+    } else
+    {
+        result = validator_validate_with(ast, programs, imports.count);
+    }
     validator_print_errors(result);
-
-    int error_count = result->error_count;
+    int validation_errors = result->error_count;
     validator_free(result);
-    ast_free(ast);
-    parser_free(parser);
-    lexerFree(lexer);
-    fclose(file);
+    free(programs);
+
+    int run_errors = 0;
+    if (options->run && parse_errors + import_errors + validation_errors == 0)
+        run_errors = quokka_execute(ast, &imports);
+    module_graph_free(&imports);
 
-    if (error_count > 0)
+    // only scripts that came through clean are worth keeping
+    if (!cached && script.source && parse_errors == 0 && validation_errors == 0)
+        qkc_store(options->cache_dir, key, script.source->size, ast);
+
+    script_close(&script);
+    if (parse_errors + import_errors + validation_errors + emit_errors + run_errors > 0)
     {
         return 1;
     }
     return 0;
 }
+
+int main(int argc, char *argv[])
+{
+    Options options = { 0 };
+    int first = 1;
+    for (; first < argc && strncmp(argv[first], "--", 2) == 0; first++)
+    {
+        if (strncmp(argv[first], "--cache=", 8) == 0 && argv[first][8])
+        {
+            options.cache_dir = argv[first] + 8;
+        } else if (strcmp(argv[first], "--check") == 0)
+        {
+            options.check = 1;
+        } else if (strcmp(argv[first], "--stream") == 0)
+        {
+            options.stream = 1;
+        } else if (strcmp(argv[first], "--run") == 0)
+        {
+            options.run = 1;
+        } else if (strcmp(argv[first], "--emit-ast=bin") == 0)
+        {
+            options.emit_binary = 1;
+        } else if (strcmp(argv[first], "--emit-ast=text") == 0)
+        {
+            options.emit_binary = 0;
+        } else
+        {
+            fprintf(stderr, "Error: Unknown option %s\n", argv[first]);
+            return 1;
+        }
+    }
+
+    if (options.stream && options.emit_binary)
+    {
+        fprintf(stderr, "Error: --stream keeps no AST to emit\n");
+        return 1;
+    }
+    if (options.stream && options.run)
+    {
+        fprintf(stderr, "Error: --stream keeps no AST to run\n");
+        return 1;
+    }
+
+    if (first >= argc)
+    {
+        fprintf(stderr, "Usage: %s [--check | --stream | --run] [--cache=<dir>] [--emit-ast=text|bin] <input_file.qk>...\n", argv[0]);
+        return 1;
+    }
+
+    // headers imported by several scripts are parsed once for all of them
+    ModuleCache *modules = module_cache_create(0);
+    module_cache_set_disk(modules, options.cache_dir);
+    int failed = 0;
+    for (int i = first; i < argc; i++)
+    {
+        if (quokka_run(argv[i], modules, &options) != 0)
+            failed = 1;
+    }
+    module_cache_free(modules);
+    intern_clear();
+    return failed;
+}
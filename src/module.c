@@ -0,0 +1,422 @@
+#include "module.h"
+#include "compat.h"
+#include "filemap.h"
+#include "intern.h"
+#include "parser.h"
+#include "qkc.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Cache slots, open addressing on the interned path pointer. A slot can hold
+// no module: the file was unreadable the last time it was imported.
+typedef struct
+{
+    const char *path;
+    Module *module;
+    unsigned visit;     // resolve call that last queued the path
+} ModuleEntry;
+
+struct ModuleCache
+{
+    ModuleEntry *entries;
+    size_t capacity;
+    size_t count;
+    Module *retired;
+    const char *disk;
+    int threads;
+    unsigned visit;
+    size_t parses;
+};
+
+typedef struct
+{
+    const char *path;
+    int line;           // of the first import that asked for it
+    int column;
+    Module *cached;
+    const char *disk;
+    Module *module;     // out: cached when unchanged, NULL when unreadable
+    int parsed;         // out: module came from the parser
+} ModuleJob;
+
+typedef struct
+{
+    ModuleJob *jobs;
+    size_t count;
+    size_t next;
+    Mutex *lock;
+} ModuleWave;
+
+enum { MODULE_UNSEEN, MODULE_OPEN, MODULE_DONE };
+
+uint64_t module_content_hash(const char *data, size_t size)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static size_t module_slot(const ModuleCache *cache, const char *path)
+{
+    size_t slot = (size_t)(((uintptr_t)path >> 2) * 0x9E3779B97F4A7C15ull) & (cache->capacity - 1);
+    while (cache->entries[slot].path && cache->entries[slot].path != path)
+        slot = (slot + 1) & (cache->capacity - 1);
+    return slot;
+}
+
+static ModuleEntry* module_entry(ModuleCache *cache, const char *path)
+{
+    if ((cache->count + 1) * 4 > cache->capacity * 3)
+    {
+        ModuleEntry *old = cache->entries;
+        size_t old_capacity = cache->capacity;
+        cache->capacity = old_capacity ? old_capacity * 2 : 64;
+        cache->entries = calloc(cache->capacity, sizeof(ModuleEntry));
+        for (size_t i = 0; i < old_capacity; i++)
+        {
+            if (old[i].path)
+                cache->entries[module_slot(cache, old[i].path)] = old[i];
+        }
+        free(old);
+    }
+
+    ModuleEntry *entry = &cache->entries[module_slot(cache, path)];
+    if (!entry->path)
+    {
+        entry->path = path;
+        cache->count++;
+    }
+    return entry;
+}
+
+// Drops "." segments, repeated separators and each ".." with the segment
+// before it, for paths that cannot be resolved on disk; returns the new length
+static size_t module_collapse(char *path, size_t length)
+{
+    size_t root = length > 1 && path[1] == ':' ? 2 : 0;
+    if (root < length && (path[root] == '/' || path[root] == '\\'))
+        root++;
+
+    size_t out = root, i = root;
+    while (i < length)
+    {
+        size_t start = i;
+        while (i < length && path[i] != '/' && path[i] != '\\')
+            i++;
+        size_t n = i - start;
+        if (i < length) i++;
+        if (n == 0 || (n == 1 && path[start] == '.')) continue;
+
+        if (n == 2 && path[start] == '.' && path[start + 1] == '.')
+        {
+            size_t last = out;
+            while (last > root && path[last - 1] != '/')
+                last--;
+            int parent = out - last == 2 && path[last] == '.' && path[last + 1] == '.';
+            if (out > root && !parent)
+            {
+                out = last > root ? last - 1 : root;
+                continue;
+            }
+            if (root > 0 && out == root) continue;  // nothing above the root
+        }
+        if (out > root) path[out++] = '/';
+        memmove(path + out, path + start, n);
+        out += n;
+    }
+    if (out == 0) path[out++] = '.';
+    return out;
+}
+
+// Import paths are relative to the directory of the file importing them. The
+// interned result is canonical, so every spelling of a file shares one cache
+// entry: resolved on disk when the file exists, collapsed by hand otherwise.
+static const char* module_join(const char *importer, const char *path, size_t length)
+{
+    size_t dir = strlen(importer);
+    if (length > 0 && (path[0] == '/' || path[0] == '\\' || (length > 1 && path[1] == ':')))
+        dir = 0;
+    while (dir > 0 && importer[dir - 1] != '/' && importer[dir - 1] != '\\')
+        dir--;
+
+    char small[256];
+    char *buf = dir + length < sizeof(small) ? small : malloc(dir + length + 1);
+    memcpy(buf, importer, dir);
+    memcpy(buf + dir, path, length);
+    buf[dir + length] = '\0';
+
+    char *real = compat_realpath(buf);
+    const char *joined = real ? intern_cstr(real) : intern(buf, module_collapse(buf, dir + length));
+    free(real);
+    if (buf != small) free(buf);
+    return joined;
+}
+
+static ModuleImport* module_imports(const char *importer, const ASTNode *program, int *count)
+{
+    *count = 0;
+    ModuleImport *imports = NULL;
+    for (int i = 0; program && i < program->num_children; i++)
+    {
+        const ASTNode *node = program->children[i];
+        if (node->type != AST_IMPORT || !node->string_value) continue;
+
+        imports = realloc(imports, sizeof(ModuleImport) * (size_t)(*count + 1));
+        imports[*count].path = module_join(importer, node->string_value, intern_length(node->string_value));
+        imports[*count].line = node->line;
+        imports[*count].column = node->column;
+        (*count)++;
+    }
+    return imports;
+}
+
+static void module_load(ModuleJob *job)
+{
+    FileMap *map = filemap_open(job->path);
+    if (!map)
+    {
+        job->module = NULL;
+        return;
+    }
+
+    uint64_t hash = module_content_hash(map->data, map->size);
+    if (job->cached && job->cached->hash == hash)
+    {
+        job->module = job->cached;
+        filemap_close(map);
+        return;
+    }
+
+    Module *module = calloc(1, sizeof(Module));
+    module->path = job->path;
+    module->hash = hash;
+    module->arena = arena_create();
+
+    uint64_t key = qkc_key(hash);
+    if (job->disk)
+        module->program = qkc_load(job->disk, key, map->size, module->arena);
+
+    if (!module->program)
+    {
+        Lexer *lx = lexerInitBuffer(map->data, map->size);
+        Parser *p = parser_init_arena(lx, module->arena);
+        module->program = parser_parse(p);
+        module->error_count = p->error_count;
+        module->diagnostics = p->diagnostics;
+        diagnostics_init(&p->diagnostics);
+        parser_free(p);
+        lexerFree(lx);
+        job->parsed = 1;
+
+        if (job->disk && module->error_count == 0)
+            qkc_store(job->disk, key, map->size, module->program);
+    }
+    filemap_close(map);
+
+    module->imports = module_imports(module->path, module->program, &module->import_count);
+    job->module = module;
+}
+
+static void module_worker(void *arg)
+{
+    ModuleWave *wave = arg;
+    for (;;)
+    {
+        mutex_lock(wave->lock);
+        size_t i = wave->next++;
+        mutex_unlock(wave->lock);
+        if (i >= wave->count) return;
+        module_load(&wave->jobs[i]);
+    }
+}
+
+static void module_run_wave(ModuleCache *cache, ModuleJob *jobs, size_t count)
+{
+    size_t workers = (size_t)cache->threads < count ? (size_t)cache->threads : count;
+    if (workers <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            module_load(&jobs[i]);
+        return;
+    }
+
+    ModuleWave wave = { jobs, count, 0, mutex_create() };
+    Thread *threads[64];
+    if (workers > 64) workers = 64;
+
+    intern_set_shared(1);
+    for (size_t i = 0; i + 1 < workers; i++)
+        threads[i] = thread_start(module_worker, &wave);
+    module_worker(&wave);
+    for (size_t i = 0; i + 1 < workers; i++)
+        thread_join(threads[i]);
+    intern_set_shared(0);
+
+    mutex_free(wave.lock);
+}
+
+static void module_free(Module *module)
+{
+    arena_free(module->arena);
+    diagnostics_free(&module->diagnostics);
+    free(module->imports);
+    free(module);
+}
+
+static void module_retire(ModuleCache *cache, Module *module)
+{
+    if (!module) return;
+    module->retired = cache->retired;
+    cache->retired = module;
+}
+
+ModuleCache* module_cache_create(int threads)
+{
+    ModuleCache *cache = calloc(1, sizeof(ModuleCache));
+    cache->threads = threads > 0 ? threads : thread_hardware_count();
+    return cache;
+}
+
+void module_cache_free(ModuleCache *cache)
+{
+    if (!cache) return;
+
+    for (size_t i = 0; i < cache->capacity; i++)
+    {
+        if (cache->entries[i].module)
+            module_free(cache->entries[i].module);
+    }
+    while (cache->retired)
+    {
+        Module *next = cache->retired->retired;
+        module_free(cache->retired);
+        cache->retired = next;
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+void module_cache_set_disk(ModuleCache *cache, const char *dir)
+{
+    cache->disk = dir;
+}
+
+size_t module_cache_parses(const ModuleCache *cache)
+{
+    return cache->parses;
+}
+
+// queues the files not yet seen by this resolve call
+static void module_queue(ModuleCache *cache, ModuleJob **jobs, size_t *count, size_t *capacity,
+    const ModuleImport *imports, int import_count)
+{
+    for (int i = 0; i < import_count; i++)
+    {
+        ModuleEntry *entry = module_entry(cache, imports[i].path);
+        if (entry->visit == cache->visit) continue;
+        entry->visit = cache->visit;
+
+        if (*count == *capacity)
+        {
+            *capacity = *capacity ? *capacity * 2 : 16;
+            *jobs = realloc(*jobs, sizeof(ModuleJob) * *capacity);
+        }
+        (*jobs)[(*count)++] = (ModuleJob){ imports[i].path, imports[i].line, imports[i].column,
+            entry->module, cache->disk, NULL, 0 };
+    }
+}
+
+// Post-order over the imports, so dependencies come out first. An import
+// leading back to a module still open is a cycle, reported and not followed.
+static void module_order(ModuleCache *cache, ImportGraph *graph, const ModuleImport *import)
+{
+    ModuleEntry *entry = module_entry(cache, import->path);
+    Module *module = entry->module;
+    if (!module) return;
+
+    if (module->visit != cache->visit)
+    {
+        module->visit = cache->visit;
+        module->state = MODULE_UNSEEN;
+    }
+    if (module->state == MODULE_OPEN)
+    {
+        diagnostics_add_detail(&graph->diagnostics, import->line, import->column, "Import cycle through", module->path);
+        graph->error_count++;
+        return;
+    }
+    if (module->state == MODULE_DONE) return;
+
+    module->state = MODULE_OPEN;
+    for (int i = 0; i < module->import_count; i++)
+        module_order(cache, graph, &module->imports[i]);
+    module->state = MODULE_DONE;
+
+    graph->modules = realloc(graph->modules, sizeof(Module*) * (graph->count + 1));
+    graph->modules[graph->count++] = module;
+}
+
+int module_resolve(ModuleCache *cache, const char *path, ASTNode *program, ImportGraph *graph)
+{
+    graph->modules = NULL;
+    graph->count = 0;
+    graph->error_count = 0;
+    diagnostics_init(&graph->diagnostics);
+    cache->visit++;
+
+    int root_count;
+    ModuleImport *root = module_imports(path, program, &root_count);
+
+    // Breadth first, one wave per level of the graph: every file of a wave is
+    // known before it starts, so it can be parsed in parallel while the cache
+    // is only read. Results go into the cache between waves.
+    ModuleJob *jobs = NULL;
+    size_t count = 0, capacity = 0;
+    module_queue(cache, &jobs, &count, &capacity, root, root_count);
+
+    size_t done = 0;
+    while (done < count)
+    {
+        size_t end = count;
+        module_run_wave(cache, jobs + done, end - done);
+
+        for (size_t i = done; i < end; i++)
+        {
+            ModuleJob job = jobs[i];
+            if (job.module != job.cached)
+            {
+                module_retire(cache, job.cached);
+                module_entry(cache, job.path)->module = job.module;
+                cache->parses += (size_t)job.parsed;
+            }
+            if (!job.module)
+            {
+                diagnostics_add_detail(&graph->diagnostics, job.line, job.column, "Cannot read imported file", job.path);
+                graph->error_count++;
+                continue;
+            }
+            module_queue(cache, &jobs, &count, &capacity, job.module->imports, job.module->import_count);
+        }
+        done = end;
+    }
+
+    for (int i = 0; i < root_count; i++)
+        module_order(cache, graph, &root[i]);
+
+    free(jobs);
+    free(root);
+    return graph->error_count;
+}
+
+void module_graph_free(ImportGraph *graph)
+{
+    free(graph->modules);
+    graph->modules = NULL;
+    graph->count = 0;
+    diagnostics_free(&graph->diagnostics);
+}
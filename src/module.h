@@ -0,0 +1,65 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include "arena.h"
+#include "ast.h"
+#include "diagnostics.h"
+#include <stdint.h>
+
+// One @import of a module or script, resolved against the importer's directory
+typedef struct
+{
+    const char *path;   // interned
+    int line;
+    int column;
+} ModuleImport;
+
+// A parsed .j file, shared by every script that imports it. Modules belong to
+// their cache and stay valid until module_cache_free, even once replaced by a
+// newer version of the file.
+typedef struct Module
+{
+    const char *path;           // interned, as resolved
+    uint64_t hash;              // of the file contents
+    Arena *arena;               // holds program
+    ASTNode *program;
+    int error_count;
+    Diagnostics diagnostics;    // parse errors
+    ModuleImport *imports;
+    int import_count;
+    unsigned visit;             // module_resolve bookkeeping
+    int state;
+    struct Module *retired;     // next in the cache's list of replaced modules
+} Module;
+
+typedef struct ModuleCache ModuleCache;
+
+// Modules in dependency order, dependencies first
+typedef struct
+{
+    Module **modules;
+    size_t count;
+    int error_count;
+    Diagnostics diagnostics;    // unreadable imports and import cycles
+} ImportGraph;
+
+// threads: parse workers, 0 for one per hardware thread
+ModuleCache* module_cache_create(int threads);
+void module_cache_free(ModuleCache *cache);
+// Also keep modules in a .qkc cache directory (qkc.h), NULL for none. The
+// directory name has to outlive the cache.
+void module_cache_set_disk(ModuleCache *cache, const char *dir);
+// files parsed over the cache's lifetime, hits in memory or on disk excluded
+size_t module_cache_parses(const ModuleCache *cache);
+
+// Loads everything program imports, directly or not, through the cache. A
+// cached module is reused when its file still hashes the same, otherwise the
+// file is parsed again. Modules of one level of the graph are parsed in
+// parallel. Returns the graph's error count (parse errors in modules not
+// included, see Module.error_count).
+int module_resolve(ModuleCache *cache, const char *path, ASTNode *program, ImportGraph *graph);
+void module_graph_free(ImportGraph *graph);
+
+uint64_t module_content_hash(const char *data, size_t size);
+
+#endif //MODULE_H
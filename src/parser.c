@@ -3,31 +3,93 @@
 //
 
 #include "parser.h"
-#include <stdio.h>
+#include "intern.h"
 #include <stdlib.h>
 #include <string.h>
 
 Parser* parser_init(Lexer *lexer)
+{
+    Parser *p = parser_init_arena(lexer, arena_create());
+    p->owns_arena = 1;
+    return p;
+}
+
+Parser* parser_init_arena(Lexer *lexer, Arena *arena)
 {
     Parser *p = malloc(sizeof(Parser));
     p->lexer = lexer;
+    p->tokens = NULL;
+    p->index = 0;
+    p->arena = arena;
+    p->owns_arena = 0;
     p->current = lexerNextToken(lexer);
     p->peek = lexerNextToken(lexer);
+    p->previous = TOK_EOF;
     p->error_count = 0;
+    p->panic = 0;
+    diagnostics_init(&p->diagnostics);
+    p->on_statement = NULL;
+    p->statement_ctx = NULL;
+    return p;
+}
+
+// stream index clamped to the trailing EOF token
+static size_t parser_token_index(Parser *p, size_t k)
+{
+    size_t last = p->tokens->count - 1;
+    return p->index + k < last ? p->index + k : last;
+}
+
+Parser* parser_init_tokens(const TokenStream *tokens, Arena *arena)
+{
+    Parser *p = malloc(sizeof(Parser));
+    p->lexer = NULL;
+    p->tokens = tokens;
+    p->index = 0;
+    p->arena = arena;
+    p->owns_arena = 0;
+    p->current = lexerStreamToken(tokens, 0);
+    p->peek = lexerStreamToken(tokens, parser_token_index(p, 1));
+    p->previous = TOK_EOF;
+    p->error_count = 0;
+    p->panic = 0;
+    diagnostics_init(&p->diagnostics);
+    p->on_statement = NULL;
+    p->statement_ctx = NULL;
     return p;
 }
 
 static void parser_advance(Parser *p)
 {
-    if (p->current.value) free(p->current.value);
+    p->previous = p->current.type;
     p->current = p->peek;
-    p->peek = lexerNextToken(p->lexer);
+    if (p->tokens)
+    {
+        p->index = parser_token_index(p, 1);
+        p->peek = lexerStreamToken(p->tokens, parser_token_index(p, 1));
+    } else
+    {
+        p->index++;
+        p->peek = lexerNextToken(p->lexer);
+    }
+}
+
+// Type of the token k places after the current one. Pulling from a lexer
+// only the next token is known, further out is TOK_UNKNOWN.
+static TokenType parser_lookahead(Parser *p, size_t k)
+{
+    if (k == 0) return p->current.type;
+    if (p->tokens) return (TokenType)p->tokens->type[parser_token_index(p, k)];
+    return k == 1 ? p->peek.type : TOK_UNKNOWN;
 }
 
+// Only the first error of a statement is reported, whatever follows it until
+// parser_synchronize is usually fallout from the same mistake
 static void parser_error(Parser *p, const char *msg)
 {
-    fprintf(stderr, "[%d:%d] Parse error: %s\n",
-        p->current.line, p->current.column, msg);
+    if (p->panic) return;
+    p->panic = 1;
+    diagnostics_add(&p->diagnostics, p->current.line, p->current.column, msg);
     p->error_count++;
 }
 
@@ -46,6 +108,8 @@ static int parser_check(Parser *p, TokenType type)
     return p->current.type == type;
 }
 
+// A missing token is reported and left for recovery, the current one may well
+// start the next statement
 static Token parser_consume(Parser *p, TokenType type, const char *msg)
 {
     Token t = p->current;
@@ -53,15 +117,78 @@ static Token parser_consume(Parser *p, TokenType type, const char *msg)
     {
         parser_error(p, msg);
         t.type = TOK_UNKNOWN;
+        return t;
     }
     parser_advance(p);
     return t;
 }
 
+// Keywords the grammar itself is built on. Every other keyword (device, status,
+// log, header, ...) can still be used wherever a name is expected.
+static int parser_is_reserved(TokenType type)
+{
+    switch (type)
+    {
+        case TOK_NEW: case TOK_IF: case TOK_THEN: case TOK_ELSE: case TOK_AS: case TOK_IMPORT:
+        case TOK_AND: case TOK_OR: case TOK_NOT: case TOK_NAND: case TOK_NOR: case TOK_XOR: case TOK_XNOR:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int parser_check_name(Parser *p)
+{
+    return parser_check(p, TOK_IDENTIFIER)
+        || (lexerKeywordName(p->current.type) && !parser_is_reserved(p->current.type));
+}
+
+// Source text of the current token. Pulling from a lexer it is only valid until
+// the token after next is lexed, so anything kept in the AST is copied out.
+static const char* parser_text(Parser *p)
+{
+    if (p->tokens) return lexerStreamText(p->tokens, p->index);
+    return lexerTokenText(p->lexer, &p->current);
+}
+
+static ASTNode* parser_name_node(Parser *p, int line, int col)
+{
+    if (!parser_check_name(p)) return ast_create_identifier(p->arena, "", 0, line, col);
+    return ast_create_identifier(p->arena, parser_text(p), p->current.length, line, col);
+}
+
+static const char* parser_name_value(Parser *p)
+{
+    return intern(parser_text(p), parser_check_name(p) ? p->current.length : 0);
+}
+
+// string literal body with escapes resolved, "" when the token is not a string
+static const char* parser_string_value(Parser *p)
+{
+    size_t length = parser_check(p, TOK_STRING) ? p->current.length : 0;
+    const char *text = parser_text(p);
+    if (!memchr(text, '\\', length)) return intern(text, length);
+
+    char small[256];
+    char *buf = length <= sizeof(small) ? small : malloc(length);
+    const char *value = intern(buf, lexerUnescape(buf, text, length));
+    if (buf != small) free(buf);
+    return value;
+}
+
+static void parser_consume_name(Parser *p, const char *msg)
+{
+    if (!parser_check_name(p))
+    {
+        parser_error(p, msg);
+        return;
+    }
+    parser_advance(p);
+}
+
 // forward decs
 static ASTNode* parser_parse_statement(Parser *p);
 static ASTNode* parser_parse_expression(Parser *p);
-static ASTNode* parser_parse_comparison(Parser *p);
 static ASTNode* parser_parse_primary(Parser *p);
 static ASTNode* parser_parse_call_or_member(Parser *p, ASTNode *object);
 static ASTNode* parser_parse_block(Parser *p);
@@ -73,24 +200,25 @@ static ASTNode* parser_parse_expression_statement(Parser *p);
 
 static ASTNode* parser_parse_program(Parser *p)
 {
-    ASTNode *program = ast_create(AST_PROGRAM, p->current.line, p->current.column);
+    ASTNode *program = ast_create(p->arena, AST_PROGRAM, p->current.line, p->current.column);
 
     while (!parser_check(p, TOK_EOF))
     {
         ASTNode *stmt = parser_parse_statement(p);
         if (stmt)
         {
-            ast_add_child(program, stmt);
+            ast_add_child(p->arena, program, stmt);
+            if (p->on_statement) p->on_statement(stmt, p->statement_ctx);
+        }
+        if (p->error_count >= PARSER_ERROR_LIMIT)
+        {
+            diagnostics_add(&p->diagnostics, p->current.line, p->current.column, "Too many errors, giving up");
+            break;
         }
     }
     return program;
 }
 
-static ASTNode* parser_parse_expression(Parser *p)
-{
-    return parser_parse_comparison(p);
-}
-
 static ASTNode* parser_parse_import(Parser *p)
 {
     int line = p->current.line;
@@ -99,11 +227,11 @@ static ASTNode* parser_parse_import(Parser *p)
     parser_consume(p, TOK_AT, "Expected '@'");
     parser_consume(p, TOK_IMPORT, "Expected 'import'");
 
-    char *path_value = p->current.value ? strdup(p->current.value) : strdup("");
+    const char *path_value = parser_string_value(p);
     parser_consume(p, TOK_STRING, "Expected string path");
     parser_consume(p, TOK_SEMICOLON, "Expected ';' after import");
 
-    ASTNode *import = ast_create(AST_IMPORT, line, col);
+    ASTNode *import = ast_create(p->arena, AST_IMPORT, line, col);
     import->string_value = path_value;
 
     return import;
@@ -115,28 +243,22 @@ static ASTNode* parser_parse_declaration(Parser *p)
     int col = p->current.column;
 
     parser_consume(p, TOK_NEW, "Expected 'new'");
-    char *device_type_value = p->current.value ? strdup(p->current.value) : strdup("");
-    parser_consume(p, TOK_IDENTIFIER, "Expected device type");
-    char *device_name_value = p->current.value ? strdup(p->current.value) : strdup("");
-    parser_consume(p, TOK_IDENTIFIER, "Expected device name");
+    ASTNode *type_node = parser_name_node(p, line, col);
+    parser_consume_name(p, "Expected device type");
+    const char *device_name_value = parser_name_value(p);
+    parser_consume_name(p, "Expected device name");
 
     parser_consume(p, TOK_AS, "Expected 'as'");
-    char *alias_value = p->current.value ? strdup(p->current.value) : strdup("");
-    parser_consume(p, TOK_IDENTIFIER, "Expected alias name");
+    ASTNode *alias_node = parser_name_node(p, line, col);
+    parser_consume_name(p, "Expected alias name");
 
     parser_consume(p, TOK_SEMICOLON, "Expected ';' after declaration");
 
-    ASTNode *decl = ast_create(AST_DECLARATION, line, col);
-    decl->string_value = strdup(device_name_value);
-    ASTNode *type_node = ast_create_identifier(device_type_value, line, col);
-    ASTNode *alias_node = ast_create_identifier(alias_value, line, col);
-
-    ast_add_child(decl, type_node);
-    ast_add_child(decl, alias_node);
+    ASTNode *decl = ast_create(p->arena, AST_DECLARATION, line, col);
+    decl->string_value = device_name_value;
 
-    free(device_type_value);
-    free(device_name_value);
-    free(alias_value);
+    ast_add_child(p->arena, decl, type_node);
+    ast_add_child(p->arena, decl, alias_node);
 
     return decl;
 }
@@ -146,13 +268,13 @@ static ASTNode* parser_parse_block(Parser *p)
     int col = p->current.column;
 
     parser_consume(p, TOK_LBRACE, "Expected '{'");
-    ASTNode *block = ast_create(AST_BLOCK, line, col);
+    ASTNode *block = ast_create(p->arena, AST_BLOCK, line, col);
 
     while (!parser_check(p, TOK_RBRACE) && !parser_check(p, TOK_EOF))
     {
         ASTNode *stmt = parser_parse_statement(p);
         if (stmt)
-            ast_add_child(block, stmt);
+            ast_add_child(p->arena, block, stmt);
     }
 
     parser_consume(p, TOK_RBRACE, "Expected '}'");
@@ -181,42 +303,40 @@ static ASTNode* parser_parse_if(Parser *p)
 
     parser_consume(p, TOK_SEMICOLON, "Expected ';' after if statement");
 
-    ASTNode *if_stmt = ast_create(AST_IF_STMT, line, col);
-    ast_add_child(if_stmt, condition);
-    ast_add_child(if_stmt, then_block);
+    ASTNode *if_stmt = ast_create(p->arena, AST_IF_STMT, line, col);
+    ast_add_child(p->arena, if_stmt, condition);
+    ast_add_child(p->arena, if_stmt, then_block);
     if (else_block)
-        ast_add_child(if_stmt, else_block);
+        ast_add_child(p->arena, if_stmt, else_block);
 
     return if_stmt;
 }
 
 static ASTNode* parser_parse_arguments(Parser *p)
 {
-    ASTNode *args = ast_create(AST_ARGUMENTS, p->current.line, p->current.column);
+    ASTNode *args = ast_create(p->arena, AST_ARGUMENTS, p->current.line, p->current.column);
 
     if (!parser_check(p, TOK_RPAREN))
     {
         do
         {
             // Handle named arguments: name="value"
-            if (p->peek.type == TOK_ASSIGN && parser_check(p, TOK_IDENTIFIER))
+            if (parser_lookahead(p, 1) == TOK_ASSIGN && parser_check_name(p))
             {
-                char *name_value = p->current.value ? strdup(p->current.value) : strdup("");  // Copy FIRST
                 int name_line = p->current.line;
                 int name_col = p->current.column;
+                ASTNode *name = parser_name_node(p, name_line, name_col);  // before the token goes away
 
                 parser_advance(p);
                 parser_consume(p, TOK_ASSIGN, "Expected '='");
-                ASTNode *value = parser_parse_primary(p);
+                ASTNode *value = parser_parse_expression(p);
 
-                ASTNode *arg = ast_create(AST_BINARY_OP, name_line, name_col);
-                arg->op = strdup("=");
-                arg->left = ast_create_identifier(name_value, name_line, name_col);  // Use copied value
-                free(name_value);
+                ASTNode *arg = ast_create_binary(p->arena, name, AST_OP_ASSIGN, value, name_line, name_col);
+                ast_add_child(p->arena, args, arg);
             } else
             {
                 ASTNode *expr = parser_parse_expression(p);
-                ast_add_child(args, expr);
+                ast_add_child(p->arena, args, expr);
             }
         } while (parser_match(p, TOK_COMMA));
     }
@@ -231,54 +351,16 @@ static ASTNode* parser_parse_call_or_member(Parser *p, ASTNode *object)
         int line = p->current.line;
         int col = p->current.column;
 
-        // Accept either IDENTIFIER or keywords that can be method names
-        char *member_name = NULL;
-
-        if (parser_check(p, TOK_IDENTIFIER))
-        {
-            member_name = strdup(p->current.value ? p->current.value : "");
-            parser_advance(p);
-        }
-        else if (parser_check(p, TOK_CONNECT))
-        {
-            member_name = strdup("connect");
-            parser_advance(p);
-        }
-        else if (parser_check(p, TOK_DISCONNECT))
-        {
-            member_name = strdup("disconnect");
-            parser_advance(p);
-        }
-        else if (parser_check(p, TOK_WRITE))
-        {
-            member_name = strdup("write");
-            parser_advance(p);
-        }
-        else if (parser_check(p, TOK_READ))
-        {
-            member_name = strdup("read");
-            parser_advance(p);
-        }
-        else if (parser_check(p, TOK_SEND))
-        {
-            member_name = strdup("send");
-            parser_advance(p);
-        }
-        else if (parser_check(p, TOK_RECEIVE))
-        {
-            member_name = strdup("receive");
-            parser_advance(p);
-        }
-        else
+        // Accept either IDENTIFIER or any keyword as a method name
+        if (!parser_check(p, TOK_IDENTIFIER) && !lexerKeywordName(p->current.type))
         {
             parser_error(p, "Expected member name");
             return object;
         }
+        ASTNode *member_node = ast_create_identifier(p->arena, parser_text(p), p->current.length, line, col);
+        parser_advance(p);
 
-        ASTNode *member_node = ast_create_identifier(member_name, line, col);
-        free(member_name);
-
-        ASTNode *access = ast_create_member(object, member_node, object->line, object->column);
+        ASTNode *access = ast_create_member(p->arena, object, member_node, object->line, object->column);
 
         // Check for function call
         if (parser_check(p, TOK_LPAREN))
@@ -287,7 +369,7 @@ static ASTNode* parser_parse_call_or_member(Parser *p, ASTNode *object)
             ASTNode *args = parser_parse_arguments(p);
             parser_consume(p, TOK_RPAREN, "Expected ')' after arguments");
 
-            ASTNode *call = ast_create_call(access, args, access->line, access->column);
+            ASTNode *call = ast_create_call(p->arena, access, args, access->line, access->column);
             object = call;
         } else
         {
@@ -303,48 +385,218 @@ static ASTNode* parser_parse_expression_statement(Parser *p)
     ASTNode *expr = parser_parse_expression(p);
     parser_consume(p, TOK_SEMICOLON, "Expected ';' after expression");
 
-    ASTNode *stmt = ast_create(AST_EXPR, expr->line, expr->column);
+    ASTNode *stmt = ast_create(p->arena, AST_EXPR, expr->line, expr->column);
     stmt->left = expr;
     return stmt;
 }
 
+// Panic mode recovery: skip to just past a ';' or '}', or to a token that
+// starts a statement or closes a block. Always moves past a statement that consumed
+// nothing, so a stray token cannot stall the statement loops.
+static void parser_synchronize(Parser *p, size_t start)
+{
+    p->panic = 0;
+    if (p->index == start && !parser_check(p, TOK_EOF))
+        parser_advance(p);
+
+    while (!parser_check(p, TOK_EOF))
+    {
+        if (p->previous == TOK_SEMICOLON || p->previous == TOK_RBRACE) return;
+        switch (p->current.type)
+        {
+            case TOK_AT: case TOK_NEW: case TOK_IF: case TOK_RBRACE:
+                return;
+            default:
+                parser_advance(p);
+        }
+    }
+}
+
 static ASTNode* parser_parse_statement(Parser *p)
 {
+    size_t start = p->index;
+    ASTNode *stmt;
     if (parser_check(p, TOK_AT))
-        return parser_parse_import(p);
-    if (parser_check(p, TOK_NEW))
-        return parser_parse_declaration(p);
-    if (parser_check(p, TOK_IF))
-        return parser_parse_if(p);
-    if (parser_check(p, TOK_EOF))
+        stmt = parser_parse_import(p);
+    else if (parser_check(p, TOK_NEW))
+        stmt = parser_parse_declaration(p);
+    else if (parser_check(p, TOK_IF))
+        stmt = parser_parse_if(p);
+    else if (parser_check(p, TOK_EOF))
         return NULL;
+    else
+        stmt = parser_parse_expression_statement(p);
 
-    return parser_parse_expression_statement(p);
+    if (p->panic)
+        parser_synchronize(p, start);
+    return stmt;
 }
 
-static ASTNode* parser_parse_comparison(Parser *p)
+// Binding powers, higher binds tighter. Binary levels are even; prefix
+// operators are odd so they never tie with one. 'not' sits below the
+// comparisons and takes a whole one as its operand, unary minus binds
+// tightest.
+typedef struct
 {
-    ASTNode *left = parser_parse_primary(p);
+    uint8_t power;      // 0 when the token is not an operator in this position
+    uint8_t right;      // right associative
+    ASTOperator op;
+} ParserOperator;
+
+static const ParserOperator parser_binary[TOK_UNKNOWN + 1] = {
+    [TOK_ASSIGN] = { 2, 1, AST_OP_ASSIGN },
+    [TOK_OR] = { 4, 0, AST_OP_OR }, [TOK_NOR] = { 4, 0, AST_OP_NOR },
+    [TOK_XOR] = { 6, 0, AST_OP_XOR }, [TOK_XNOR] = { 6, 0, AST_OP_XNOR },
+    [TOK_AND] = { 8, 0, AST_OP_AND }, [TOK_NAND] = { 8, 0, AST_OP_NAND },
+    [TOK_EQUAL] = { 10, 0, AST_OP_EQ }, [TOK_NOT_EQUAL] = { 10, 0, AST_OP_NE },
+    [TOK_LT] = { 10, 0, AST_OP_LT }, [TOK_GT] = { 10, 0, AST_OP_GT },
+    [TOK_LE] = { 10, 0, AST_OP_LE }, [TOK_GE] = { 10, 0, AST_OP_GE },
+    [TOK_PLUS] = { 12, 0, AST_OP_ADD }, [TOK_MINUS] = { 12, 0, AST_OP_SUB },
+    [TOK_STAR] = { 14, 0, AST_OP_MUL }, [TOK_SLASH] = { 14, 0, AST_OP_DIV },
+    [TOK_PERCENT] = { 14, 0, AST_OP_MOD },
+};
+
+static const ParserOperator parser_prefix[TOK_UNKNOWN + 1] = {
+    [TOK_NOT] = { 9, 1, AST_OP_NOT },
+    [TOK_MINUS] = { 15, 1, AST_OP_NEG },
+};
+
+typedef struct
+{
+    const ParserOperator *op;   // NULL for an open parenthesis
+    int prefix;
+    int line;
+    int column;
+} ParserPending;
+
+// operand and operator stacks, on the C stack until an expression outgrows it
+#define PARSER_STACK_INLINE 32
 
-    while (parser_check(p, TOK_EQUAL) || parser_check(p, TOK_NOT_EQUAL) || parser_check(p, TOK_LT) || parser_check(p, TOK_GT) || parser_check(p, TOK_LE) || parser_check(p, TOK_GE))
+typedef struct
+{
+    ASTNode **operands;
+    ParserPending *pending;
+    size_t operand_count;
+    size_t pending_count;
+    size_t capacity;
+    ASTNode *operand_inline[PARSER_STACK_INLINE];
+    ParserPending pending_inline[PARSER_STACK_INLINE];
+} ParserStack;
+
+static void parser_stack_reserve(ParserStack *st)
+{
+    if (st->operand_count < st->capacity && st->pending_count < st->capacity) return;
+
+    size_t capacity = st->capacity * 2;
+    if (st->operands == st->operand_inline)
     {
-        const char *op;
-        int line = p->current.line;
-        int col = p->current.column;
+        st->operands = malloc(sizeof(ASTNode*) * capacity);
+        st->pending = malloc(sizeof(ParserPending) * capacity);
+        memcpy(st->operands, st->operand_inline, sizeof(st->operand_inline));
+        memcpy(st->pending, st->pending_inline, sizeof(st->pending_inline));
+    } else
+    {
+        st->operands = realloc(st->operands, sizeof(ASTNode*) * capacity);
+        st->pending = realloc(st->pending, sizeof(ParserPending) * capacity);
+    }
+    st->capacity = capacity;
+}
 
-        if (parser_match(p, TOK_EQUAL)) op = "==";
-        else if (parser_match(p, TOK_NOT_EQUAL)) op = "!=";
-        else if (parser_match(p, TOK_LT)) op = "<";
-        else if (parser_match(p, TOK_GT)) op = ">";
-        else if (parser_match(p, TOK_LE)) op = "<=";
-        else if (parser_match(p, TOK_GE)) op = ">=";
-        else break;
+static void parser_push_pending(ParserStack *st, const ParserOperator *op, int prefix, const Token *tok)
+{
+    parser_stack_reserve(st);
+    st->pending[st->pending_count++] = (ParserPending){ op, prefix, tok->line, tok->column };
+}
 
-        ASTNode *right = parser_parse_primary(p);
-        left = ast_create_binary(left, op, right, line, col);
+// applies the topmost pending operator to its operands
+static void parser_reduce(Parser *p, ParserStack *st)
+{
+    ParserPending top = st->pending[--st->pending_count];
+    ASTNode *right = st->operands[--st->operand_count];
+    if (top.prefix)
+    {
+        ASTNode *unary = ast_create(p->arena, AST_UNARY_OP, top.line, top.column);
+        unary->op = top.op->op;
+        unary->left = right;
+        st->operands[st->operand_count++] = unary;
+    } else
+    {
+        ASTNode *left = st->operands[--st->operand_count];
+        st->operands[st->operand_count++] = ast_create_binary(p->arena, left, top.op->op, right, top.line, top.column);
     }
+}
 
-    return left;
+// Operator precedence over explicit stacks: nesting, whether by precedence,
+// prefix operators or parentheses, costs stack entries rather than C frames.
+// Only calls recurse, through their arguments.
+static ASTNode* parser_parse_expression(Parser *p)
+{
+    ParserStack st;
+    st.operands = st.operand_inline;
+    st.pending = st.pending_inline;
+    st.operand_count = 0;
+    st.pending_count = 0;
+    st.capacity = PARSER_STACK_INLINE;
+    size_t parens = 0;
+
+    for (;;)
+    {
+        // operand position: prefix operators and '(' pile up, then a primary
+        for (;;)
+        {
+            const ParserOperator *prefix = &parser_prefix[p->current.type];
+            if (prefix->power)
+            {
+                parser_push_pending(&st, prefix, 1, &p->current);
+                parser_advance(p);
+            } else if (parser_check(p, TOK_LPAREN))
+            {
+                parser_push_pending(&st, NULL, 0, &p->current);
+                parens++;
+                parser_advance(p);
+            } else
+            {
+                break;
+            }
+        }
+        ASTNode *operand = parser_parse_primary(p);
+        parser_stack_reserve(&st);
+        st.operands[st.operand_count++] = operand;
+
+        // operator position: a binary operator, or ')' closing one of ours
+        const ParserOperator *binary = &parser_binary[p->current.type];
+        while (!binary->power && parens > 0)
+        {
+            while (st.pending[st.pending_count - 1].op)
+                parser_reduce(p, &st);
+            st.pending_count--;
+            parens--;
+            parser_consume(p, TOK_RPAREN, "Expected ')' after expression");
+            binary = &parser_binary[p->current.type];
+        }
+        if (!binary->power) break;
+
+        while (st.pending_count > 0)
+        {
+            const ParserOperator *top = st.pending[st.pending_count - 1].op;
+            if (!top || top->power < binary->power || (top->power == binary->power && binary->right))
+                break;
+            parser_reduce(p, &st);
+        }
+        parser_push_pending(&st, binary, 0, &p->current);
+        parser_advance(p);
+    }
+
+    while (st.pending_count > 0)
+        parser_reduce(p, &st);
+
+    ASTNode *result = st.operands[0];
+    if (st.operands != st.operand_inline)
+    {
+        free(st.operands);
+        free(st.pending);
+    }
+    return result;
 }
 
 static ASTNode* parser_parse_primary(Parser *p)
@@ -354,47 +606,52 @@ static ASTNode* parser_parse_primary(Parser *p)
 
     if (parser_check(p, TOK_NUMBER))
     {
-        double value = strtod(p->current.value ? p->current.value : "0", NULL);
+        // strtod needs a terminated copy, number tokens are only digits and dots
+        char small[64];
+        size_t length = p->current.length;
+        char *buf = length < sizeof(small) ? small : malloc(length + 1);
+        memcpy(buf, parser_text(p), length);
+        buf[length] = '\0';
+        double value = strtod(buf, NULL);
+        if (buf != small) free(buf);
         parser_advance(p);
-        return ast_create_number(value, line, col);
+        return ast_create_number(p->arena, value, line, col);
     }
 
     if (parser_check(p, TOK_STRING))
     {
-        char *value = p->current.value ? strdup(p->current.value) : strdup("");
+        ASTNode *str_node = ast_create(p->arena, AST_STRING, line, col);
+        str_node->string_value = parser_string_value(p);
         parser_advance(p);
-        ASTNode *str_node = ast_create_string(value, line, col);
-        free(value);
         return str_node;
     }
 
-    if (parser_check(p, TOK_IDENTIFIER))
+    // keywords are case-insensitive, the token type says which literal it is
+    if (parser_check(p, TOK_TRUE) || parser_check(p, TOK_FALSE))
     {
-        char *ident_value = p->current.value ? strdup(p->current.value) : strdup("");
+        ASTNode *boolean = ast_create_boolean(p->arena, parser_check(p, TOK_TRUE), line, col);
+        parser_advance(p);
+        return boolean;
+    }
+
+    if (parser_check_name(p))
+    {
+        ASTNode *ident = parser_name_node(p, line, col);
         parser_advance(p);
-        ASTNode *ident = ast_create_identifier(ident_value, line, col);
-        free(ident_value);
 
         if (parser_check(p, TOK_LPAREN))
         {
             parser_consume(p, TOK_LPAREN, "Expected '('");
             ASTNode *args = parser_parse_arguments(p);
             parser_consume(p, TOK_RPAREN, "Expected ')' after arguments");
-            ASTNode *call = ast_create_call(ident, args, line, col);
+            ASTNode *call = ast_create_call(p->arena, ident, args, line, col);
             return call;
         }
         return parser_parse_call_or_member(p, ident);
     }
 
-    if (parser_match(p, TOK_LPAREN))
-    {
-        ASTNode *expr = parser_parse_expression(p);
-        parser_consume(p, TOK_RPAREN, "Expected ')' after expression");
-        return expr;
-    }
-
     parser_error(p, "Unexpected token");
-    return ast_create(AST_IDENTIFIER, line, col);
+    return ast_create(p->arena, AST_IDENTIFIER, line, col);
 }
 
 ASTNode* parser_parse(Parser *p)
@@ -402,11 +659,55 @@ ASTNode* parser_parse(Parser *p)
     return parser_parse_program(p);
 }
 
+void parser_on_statement(Parser *p, ParserStatementFn fn, void *ctx)
+{
+    p->on_statement = fn;
+    p->statement_ctx = ctx;
+}
+
+ASTNode* parser_next_statement(Parser *p)
+{
+    return parser_parse_statement(p);
+}
+
+int parser_stream(Parser *p, ParserStreamFn fn, void *ctx)
+{
+    InternMark mark = intern_mark();
+    while (!parser_check(p, TOK_EOF))
+    {
+        ASTNode *stmt = parser_parse_statement(p);
+        int keep = stmt && fn(stmt, ctx);
+
+        if (p->arena)
+            arena_reset(p->arena);
+        else if (stmt)
+            ast_free(stmt);
+        if (keep)
+            mark = intern_mark();
+        else
+            intern_release(mark);
+
+        if (p->error_count >= PARSER_ERROR_LIMIT)
+        {
+            diagnostics_add(&p->diagnostics, p->current.line, p->current.column, "Too many errors, giving up");
+            break;
+        }
+    }
+    return p->error_count;
+}
+
+void parser_seek(Parser *p, size_t index)
+{
+    p->index = index;
+    p->current = lexerStreamToken(p->tokens, parser_token_index(p, 0));
+    p->peek = lexerStreamToken(p->tokens, parser_token_index(p, 1));
+}
+
 void parser_free(Parser *p)
 {
     if (!p) return;
 
-    if (p->current.value) free(p->current.value);
-    if (p->peek.value) free(p->peek.value);
+    if (p->owns_arena) arena_free(p->arena);
+    diagnostics_free(&p->diagnostics);
     free(p);
 }
@@ -7,17 +7,55 @@
 
 #include "lexer.h"
 #include "ast.h"
+#include "diagnostics.h"
+
+// parser_parse gives up after this many errors
+#define PARSER_ERROR_LIMIT 100
+
+// called with each top-level statement as soon as it is parsed
+typedef void (*ParserStatementFn)(ASTNode *statement, void *ctx);
+// parser_stream's callback, non-zero keeps the strings the statement interned
+typedef int (*ParserStreamFn)(ASTNode *statement, void *ctx);
 
 typedef struct
 {
     Lexer *lexer;
+    const TokenStream *tokens;  // set when parsing a pre-lexed stream
+    size_t index;               // position of current (tokens: in the stream)
+    Arena *arena;       // where the AST is built, NULL for heap nodes
+    int owns_arena;
     Token current;
     Token peek;
+    TokenType previous;
     int error_count;
+    int panic;                  // errors are suppressed until the next statement boundary
+    Diagnostics diagnostics;    // parse errors, printed by the caller
+    ParserStatementFn on_statement;
+    void *statement_ctx;
 } Parser;
 
+// The AST lives in an arena owned by the parser and is released by parser_free
 Parser* parser_init(Lexer *lexer);
+// Builds into a caller-owned arena instead (NULL for heap nodes, see ast_free)
+Parser* parser_init_arena(Lexer *lexer, Arena *arena);
+// Parses tokens from lexerTokenizeAll by index, which makes any lookahead a
+// plain array read. Arena as for parser_init_arena.
+Parser* parser_init_tokens(const TokenStream *tokens, Arena *arena);
 ASTNode* parser_parse(Parser *p);
+// Lets parser_parse hand each top-level statement to fn while it is fresh,
+// e.g. validator_check_statement for a single pass over the tree
+void parser_on_statement(Parser *p, ParserStatementFn fn, void *ctx);
+// One top-level statement at a time, NULL at the end of input
+ASTNode* parser_next_statement(Parser *p);
+// Parses the whole input without building a program: each top-level
+// statement goes to fn and is released when fn returns (the parser's arena is
+// reset), so memory is bounded by the largest statement, not the input. So
+// are the strings it interned, unless fn keeps them because something still
+// refers to them (a declared name, a diagnostic). Stops at the error limit
+// like parser_parse; returns the error count.
+int parser_stream(Parser *p, ParserStreamFn fn, void *ctx);
+// Token stream parsers only: continue at token index
+void parser_seek(Parser *p, size_t index);
 void parser_free(Parser *p);
 
 #endif //PARSER_H
@@ -0,0 +1,78 @@
+#include "qkc.h"
+#include "ast_binary.h"
+#include "compat.h"
+#include "filemap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QKC_MAGIC 0x00434B51u   // "QKC\0" in little endian, other byte orders never match
+
+// A file is this header followed by the tree in the format of ast_binary.h
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t source_size;
+} QkcHeader;
+
+uint64_t qkc_key(uint64_t source_hash)
+{
+    return (source_hash ^ QKC_VERSION) * 1099511628211ull;
+}
+
+static char* qkc_path(const char *dir, uint64_t key, const char *suffix)
+{
+    size_t size = strlen(dir) + 32;
+    char *path = malloc(size);
+    snprintf(path, size, "%s/%016llx.qkc%s", dir, (unsigned long long)key, suffix);
+    return path;
+}
+
+ASTNode* qkc_load(const char *dir, uint64_t key, size_t source_size, Arena *arena)
+{
+    char *path = qkc_path(dir, key, "");
+    FileMap *map = filemap_open(path);
+    free(path);
+    if (!map) return NULL;
+
+    ASTNode *tree = NULL;
+    QkcHeader h;
+    if (map->size >= sizeof(h))
+    {
+        memcpy(&h, map->data, sizeof(h));
+        if (h.magic == QKC_MAGIC && h.version == QKC_VERSION && h.key == key && h.source_size == source_size)
+            tree = ast_decode(map->data + sizeof(h), map->size - sizeof(h), arena);
+    }
+    filemap_close(map);
+    return tree;
+}
+
+int qkc_store(const char *dir, uint64_t key, size_t source_size, ASTNode *program)
+{
+    QkcHeader h = { QKC_MAGIC, QKC_VERSION, key, source_size };
+
+    compat_mkdir(dir);
+    char *path = qkc_path(dir, key, "");
+    char *tmp = qkc_path(dir, key, ".tmp");
+
+    // written aside and renamed into place, so readers never see half a file;
+    // "x" fails when another process is writing the same entry
+    int result = -1;
+    FILE *f = fopen(tmp, "wbx");
+    if (f)
+    {
+        fwrite(&h, sizeof(h), 1, f);
+        int ok = ast_serialize(program, f) == 0;
+        ok = fclose(f) == 0 && ok;
+        if (ok && rename(tmp, path) == 0)
+            result = 0;
+        else
+            remove(tmp);
+    }
+
+    free(tmp);
+    free(path);
+    return result;
+}
@@ -0,0 +1,27 @@
+#ifndef QKC_H
+#define QKC_H
+
+#include "ast.h"
+#include <stdint.h>
+
+// On-disk cache of parsed ASTs: one .qkc file per distinct source text in a
+// cache directory, named after qkc_key. A file holds the tree in the binary
+// format of ast_binary.h and is loaded with a single mapping, no lexing or
+// parsing.
+//
+// Bump whenever the parser's output or the file layout changes, old entries
+// then stop matching.
+#define QKC_VERSION 3
+
+// cache key of a source text from its module_content_hash
+uint64_t qkc_key(uint64_t source_hash);
+
+// The cached tree for key, built into arena. NULL when there is no entry or it
+// does not check out (other version, other source size, damaged).
+ASTNode* qkc_load(const char *dir, uint64_t key, size_t source_size, Arena *arena);
+
+// Writes program under key, creating dir if needed. An entry written by
+// someone else in the meantime is left alone. 0 on success.
+int qkc_store(const char *dir, uint64_t key, size_t source_size, ASTNode *program);
+
+#endif //QKC_H
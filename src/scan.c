@@ -0,0 +1,183 @@
+#include "scan.h"
+#include <stdint.h>
+
+#if !defined(QUOKKA_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_WIDTH 32
+typedef __m256i ScanVec;
+#define scan_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define scan_set1(c) _mm256_set1_epi8((char)(c))
+#define scan_eq(a, b) _mm256_cmpeq_epi8(a, b)
+#define scan_lt(a, b) _mm256_cmpgt_epi8(b, a)
+#define scan_or(a, b) _mm256_or_si256(a, b)
+#define scan_add(a, b) _mm256_add_epi8(a, b)
+#define scan_bits(v) ((uint32_t)_mm256_movemask_epi8(v))
+#define SCAN_ALL 0xffffffffu
+#elif !defined(QUOKKA_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define SCAN_WIDTH 16
+typedef __m128i ScanVec;
+#define scan_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define scan_set1(c) _mm_set1_epi8((char)(c))
+#define scan_eq(a, b) _mm_cmpeq_epi8(a, b)
+#define scan_lt(a, b) _mm_cmplt_epi8(a, b)
+#define scan_or(a, b) _mm_or_si128(a, b)
+#define scan_add(a, b) _mm_add_epi8(a, b)
+#define scan_bits(v) ((uint32_t)_mm_movemask_epi8(v))
+#define SCAN_ALL 0xffffu
+#endif
+
+#ifdef SCAN_WIDTH
+#ifdef _MSC_VER
+#include <intrin.h>
+static inline unsigned scan_first(uint32_t bits)
+{
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return (unsigned)index;
+}
+
+static inline unsigned scan_final(uint32_t bits)
+{
+    unsigned long index;
+    _BitScanReverse(&index, bits);
+    return (unsigned)index;
+}
+
+#define scan_count(bits) __popcnt(bits)
+#else
+#define scan_first(bits) ((unsigned)__builtin_ctz(bits))
+#define scan_final(bits) (31u - (unsigned)__builtin_clz(bits))
+#define scan_count(bits) ((unsigned)__builtin_popcount(bits))
+#endif
+
+// bytes in [lo, hi]: shift the range down to start at -128 and compare signed
+static inline ScanVec scan_range(ScanVec v, int lo, int hi)
+{
+    return scan_lt(scan_add(v, scan_set1(0x80 - lo)), scan_set1(-128 + (hi - lo + 1)));
+}
+#endif
+
+static inline int scan_is_space(unsigned char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline int scan_is_ident(unsigned char c)
+{
+    return (unsigned char)((c | 0x20) - 'a') < 26 || (unsigned char)(c - '0') < 10 || c == '_';
+}
+
+size_t scan_space(const char *p, size_t n)
+{
+    size_t i = 0;
+#ifdef SCAN_WIDTH
+    const ScanVec space = scan_set1(' ');
+    for (; i + SCAN_WIDTH <= n; i += SCAN_WIDTH)
+    {
+        ScanVec v = scan_load(p + i);
+        uint32_t stop = ~scan_bits(scan_or(scan_eq(v, space), scan_range(v, '\t', '\r'))) & SCAN_ALL;
+        if (stop) return i + scan_first(stop);
+    }
+#endif
+    while (i < n && scan_is_space((unsigned char)p[i])) i++;
+    return i;
+}
+
+size_t scan_line(const char *p, size_t n)
+{
+    size_t i = 0;
+#ifdef SCAN_WIDTH
+    const ScanVec newline = scan_set1('\n');
+    for (; i + SCAN_WIDTH <= n; i += SCAN_WIDTH)
+    {
+        uint32_t stop = scan_bits(scan_eq(scan_load(p + i), newline));
+        if (stop) return i + scan_first(stop);
+    }
+#endif
+    while (i < n && p[i] != '\n') i++;
+    return i;
+}
+
+size_t scan_string(const char *p, size_t n)
+{
+    size_t i = 0;
+#ifdef SCAN_WIDTH
+    const ScanVec quote = scan_set1('"');
+    const ScanVec backslash = scan_set1('\\');
+    for (; i + SCAN_WIDTH <= n; i += SCAN_WIDTH)
+    {
+        ScanVec v = scan_load(p + i);
+        uint32_t stop = scan_bits(scan_or(scan_eq(v, quote), scan_eq(v, backslash)));
+        if (stop) return i + scan_first(stop);
+    }
+#endif
+    while (i < n && p[i] != '"' && p[i] != '\\') i++;
+    return i;
+}
+
+size_t scan_ident(const char *p, size_t n)
+{
+    size_t i = 0;
+#ifdef SCAN_WIDTH
+    const ScanVec lower = scan_set1(0x20);
+    const ScanVec underscore = scan_set1('_');
+    for (; i + SCAN_WIDTH <= n; i += SCAN_WIDTH)
+    {
+        ScanVec v = scan_load(p + i);
+        ScanVec ident = scan_or(scan_range(scan_or(v, lower), 'a', 'z'),
+            scan_or(scan_range(v, '0', '9'), scan_eq(v, underscore)));
+        uint32_t stop = ~scan_bits(ident) & SCAN_ALL;
+        if (stop) return i + scan_first(stop);
+    }
+#endif
+    while (i < n && scan_is_ident((unsigned char)p[i])) i++;
+    return i;
+}
+
+size_t scan_split(const char *p, size_t n)
+{
+    size_t i = 0;
+#ifdef SCAN_WIDTH
+    const ScanVec newline = scan_set1('\n');
+    const ScanVec quote = scan_set1('"');
+    const ScanVec backslash = scan_set1('\\');
+    const ScanVec slash = scan_set1('/');
+    for (; i + SCAN_WIDTH <= n; i += SCAN_WIDTH)
+    {
+        ScanVec v = scan_load(p + i);
+        uint32_t stop = scan_bits(scan_or(scan_or(scan_eq(v, newline), scan_eq(v, quote)),
+            scan_or(scan_eq(v, backslash), scan_eq(v, slash))));
+        if (stop) return i + scan_first(stop);
+    }
+#endif
+    while (i < n && p[i] != '\n' && p[i] != '"' && p[i] != '\\' && p[i] != '/') i++;
+    return i;
+}
+
+size_t scan_newlines(const char *p, size_t n, size_t *last)
+{
+    size_t i = 0;
+    size_t count = 0;
+#ifdef SCAN_WIDTH
+    const ScanVec newline = scan_set1('\n');
+    for (; i + SCAN_WIDTH <= n; i += SCAN_WIDTH)
+    {
+        uint32_t bits = scan_bits(scan_eq(scan_load(p + i), newline));
+        if (bits)
+        {
+            count += scan_count(bits);
+            *last = i + scan_final(bits);
+        }
+    }
+#endif
+    for (; i < n; i++)
+    {
+        if (p[i] == '\n')
+        {
+            count++;
+            *last = i;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,26 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+// Byte-run kernels for the lexer. Each returns the index of the first byte in
+// p[0..n) that ends the run, or n when the whole range belongs to it. They
+// use AVX2 or SSE2 when the compiler targets them and plain loops otherwise;
+// define QUOKKA_NO_SIMD to force the scalar versions.
+
+// whitespace: ' ', '\t', '\n', '\v', '\f', '\r'
+size_t scan_space(const char *p, size_t n);
+// rest of a // comment, stops at '\n'
+size_t scan_line(const char *p, size_t n);
+// string body, stops at '"' or '\\'
+size_t scan_string(const char *p, size_t n);
+// identifier tail, stops at anything but letters, digits and '_'
+size_t scan_ident(const char *p, size_t n);
+
+// bytes that can move strings and comments along: '\n', '"', '\\' and '/'
+size_t scan_split(const char *p, size_t n);
+
+// number of '\n' in p[0..n); *last gets the index of the final one
+size_t scan_newlines(const char *p, size_t n, size_t *last);
+
+#endif //SCAN_H
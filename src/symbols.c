@@ -0,0 +1,125 @@
+#include "symbols.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SYMBOL_NONE ((size_t)-1)
+
+// One slot per name ever declared, open addressing on the interned pointer.
+// Slots are never removed, a name that went out of scope points nowhere.
+typedef struct
+{
+    const char *name;
+    size_t symbol;      // innermost declaration, SYMBOL_NONE when out of scope
+} SymbolSlot;
+
+typedef struct
+{
+    const char *name;
+    Declaration declaration;
+    size_t shadowed;    // declaration of the same name it hides
+} Symbol;
+
+struct SymbolTable
+{
+    SymbolSlot *slots;
+    size_t capacity;
+    size_t used;
+
+    Symbol *symbols;    // in declaration order, so a scope is a suffix
+    size_t count;
+    size_t symbol_capacity;
+
+    size_t *scopes;     // symbol count when each open scope was entered
+    size_t depth;
+    size_t scope_capacity;
+};
+
+static size_t symbol_slot(const SymbolTable *table, const char *name)
+{
+    size_t slot = (size_t)(((uintptr_t)name >> 2) * 0x9E3779B97F4A7C15ull) & (table->capacity - 1);
+    while (table->slots[slot].name && table->slots[slot].name != name)
+        slot = (slot + 1) & (table->capacity - 1);
+    return slot;
+}
+
+static SymbolSlot* symbol_insert(SymbolTable *table, const char *name)
+{
+    if ((table->used + 1) * 4 > table->capacity * 3)
+    {
+        SymbolSlot *old = table->slots;
+        size_t old_capacity = table->capacity;
+        table->capacity = old_capacity ? old_capacity * 2 : 64;
+        table->slots = calloc(table->capacity, sizeof(SymbolSlot));
+        for (size_t i = 0; i < old_capacity; i++)
+        {
+            if (old[i].name)
+                table->slots[symbol_slot(table, old[i].name)] = old[i];
+        }
+        free(old);
+    }
+
+    SymbolSlot *slot = &table->slots[symbol_slot(table, name)];
+    if (!slot->name)
+    {
+        slot->name = name;
+        slot->symbol = SYMBOL_NONE;
+        table->used++;
+    }
+    return slot;
+}
+
+SymbolTable* symbol_table_create(void)
+{
+    return calloc(1, sizeof(SymbolTable));
+}
+
+void symbol_table_free(SymbolTable *table)
+{
+    if (!table) return;
+    free(table->slots);
+    free(table->symbols);
+    free(table->scopes);
+    free(table);
+}
+
+void symbol_table_enter(SymbolTable *table)
+{
+    if (table->depth == table->scope_capacity)
+    {
+        table->scope_capacity = table->scope_capacity ? table->scope_capacity * 2 : 16;
+        table->scopes = realloc(table->scopes, sizeof(size_t) * table->scope_capacity);
+    }
+    table->scopes[table->depth++] = table->count;
+}
+
+void symbol_table_leave(SymbolTable *table)
+{
+    if (table->depth == 0) return;
+    size_t start = table->scopes[--table->depth];
+    while (table->count > start)
+    {
+        const Symbol *symbol = &table->symbols[--table->count];
+        table->slots[symbol_slot(table, symbol->name)].symbol = symbol->shadowed;
+    }
+}
+
+void symbol_table_declare(SymbolTable *table, const char *name, int line, int column)
+{
+    if (!name) return;
+    if (table->count == table->symbol_capacity)
+    {
+        table->symbol_capacity = table->symbol_capacity ? table->symbol_capacity * 2 : 64;
+        table->symbols = realloc(table->symbols, sizeof(Symbol) * table->symbol_capacity);
+    }
+
+    SymbolSlot *slot = symbol_insert(table, name);
+    table->symbols[table->count] = (Symbol){ name, { line, column }, slot->symbol };
+    slot->symbol = table->count++;
+}
+
+const Declaration* symbol_table_lookup(const SymbolTable *table, const char *name)
+{
+    if (!name || table->capacity == 0) return NULL;
+    const SymbolSlot *slot = &table->slots[symbol_slot(table, name)];
+    return slot->name && slot->symbol != SYMBOL_NONE ? &table->symbols[slot->symbol].declaration : NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+// Names declared in nested scopes, innermost first. Names are interned and
+// hashed by pointer, so lookups cost the same however many are declared.
+typedef struct SymbolTable SymbolTable;
+
+// Where a name was declared, copied out of the tree: a streamed script frees
+// each statement's nodes while its names are still in scope.
+typedef struct
+{
+    int line;
+    int column;
+} Declaration;
+
+SymbolTable* symbol_table_create(void);
+void symbol_table_free(SymbolTable *table);
+
+// scopes nest; leaving one forgets what was declared in it
+void symbol_table_enter(SymbolTable *table);
+void symbol_table_leave(SymbolTable *table);
+
+// declares name in the current scope, shadowing any outer declaration
+void symbol_table_declare(SymbolTable *table, const char *name, int line, int column);
+// the innermost declaration of name, NULL when there is none; valid until the
+// table next changes
+const Declaration* symbol_table_lookup(const SymbolTable *table, const char *name);
+
+#endif //SYMBOLS_H
@@ -0,0 +1,159 @@
+// Binary AST format: a serialized program loads back identical from a file
+// and from memory, a mapped view reads the same nodes in place, and files that
+// are truncated, of another version, or whose indices or strings do not hold
+// together are rejected.
+
+#include "../ast_binary.h"
+#include "../parser.h"
+#include "../intern.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AST_FILE "ast_binary_test.qka"
+
+// the whole file in 8-byte aligned memory, as ast_decode wants it
+static uint64_t* read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *size = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint64_t *data = malloc(*size + 8);
+    *size = fread(data, 1, *size, f);
+    fclose(f);
+    return data;
+}
+
+// the pooled tree and a view of it hold the same nodes
+static int same_pool(const ASTPool *a, const ASTPool *b)
+{
+    if (a->count != b->count || a->root != b->root) return 0;
+    for (ASTIndex i = 1; i < a->count; i++)
+    {
+        const char *sa = ast_pool_string(a, i), *sb = ast_pool_string(b, i);
+        if (a->type[i] != b->type[i] || a->op[i] != b->op[i] || a->line[i] != b->line[i]
+            || a->column[i] != b->column[i] || a->lhs[i] != b->lhs[i] || a->rhs[i] != b->rhs[i]
+            || ast_pool_number(a, i) != ast_pool_number(b, i)
+            || (!sa || !sb ? sa != sb : strcmp(sa, sb) != 0))
+            return 0;
+    }
+    for (uint32_t i = 0; i < a->list_count; i++)
+        if (a->lists[i] != b->lists[i]) return 0;
+    return a->list_count == b->list_count;
+}
+
+// the view and the tree decoder agree on what is acceptable
+static int decodes(const void *data, size_t size)
+{
+    Arena *arena = arena_create();
+    ASTNode *tree = ast_decode(data, size, arena);
+    arena_free(arena);
+    ASTPool pool;
+    int viewed = ast_view_decode(data, size, &pool) == 0;
+    check(viewed == (tree != NULL), "view and decoder agree");
+    return tree != NULL;
+}
+
+int main(void)
+{
+    const char *script =
+        "@import \"logging.j\";\n"
+        "new device USB1 as Keyboard;\n"
+        "if (USB1.status() == \"connected\" and not (x < 3.5)) then {\n"
+        "    USB1.write(header=\"KEY-UP\", payload=-42 * (y + 1) % 7);\n"
+        "} else {\n"
+        "    log(\"\");\n"
+        "};\n"
+        "z = a = b;\n";
+    Lexer *lx = lexerInitBuffer(script, strlen(script));
+    Parser *p = parser_init(lx);
+    ASTNode *program = parser_parse(p);
+    check(p->error_count == 0, "script parses");
+
+    FILE *out = fopen(AST_FILE, "wb");
+    check(out && ast_serialize(program, out) == 0, "serialize");
+    if (out) fclose(out);
+
+    Arena *arena = arena_create();
+    ASTNode *loaded = ast_load(AST_FILE, arena);
+    check(loaded && same_tree(program, loaded), "loaded from the file");
+    arena_free(arena);
+
+    // read in place: strings point into the mapping, nothing is interned
+    ASTView view;
+    ASTPool *pooled = ast_pool_from_tree(program);
+    size_t interned = intern_count();
+    check(ast_view_open(AST_FILE, &view) == 0, "view opens");
+    if (view.map)
+    {
+        check(same_pool(pooled, &view.pool), "view matches the pooled tree");
+        ASTIndex i = 1;
+        while (i < view.pool.count && !ast_pool_string(&view.pool, i)) i++;
+        const char *text = i < view.pool.count ? ast_pool_string(&view.pool, i) : NULL;
+        check(text && text >= view.map->data && text < view.map->data + view.map->size, "strings in the mapping");
+        check(intern_count() == interned, "view interns nothing");
+        ast_view_close(&view);
+    }
+    ast_pool_free(pooled);
+    check(ast_view_open("ast_binary_test_missing.qka", &view) == -1 && !view.map, "view of a missing file");
+
+    size_t size = 0;
+    uint64_t *data = read_file(AST_FILE, &size);
+    check(data && size > sizeof(ASTBinaryHeader) && size % 8 == 0, "file padded to 8 bytes");
+    if (data)
+    {
+        ASTBinaryHeader h;
+        memcpy(&h, data, sizeof(h));
+        check(h.magic == AST_BINARY_MAGIC && h.version == AST_BINARY_VERSION, "header");
+
+        arena = arena_create();
+        loaded = ast_decode(data, size, arena);
+        check(loaded && same_tree(program, loaded), "decoded from memory");
+        arena_free(arena);
+
+        check(!decodes(data, size - 8), "truncated");
+        check(!decodes(data, sizeof(h) - 1), "shorter than a header");
+
+        char *bytes = (char *)data;
+        uint64_t *copy = malloc(size);
+        char *damaged = (char *)copy;
+
+        memcpy(copy, data, size);
+        ((ASTBinaryHeader *)copy)->version++;
+        check(!decodes(copy, size), "other version");
+
+        memcpy(copy, data, size);
+        ((ASTBinaryHeader *)copy)->root = h.node_count;
+        check(!decodes(copy, size), "root out of range");
+
+        // the string section is last, its final byte is a terminator or padding
+        memcpy(copy, data, size);
+        size_t last = size - 1;
+        while (bytes[last] == '\0' && last > size - 8) last--;
+        damaged[last + 1] = 'x';
+        check(bytes[last + 1] == '\0' && !decodes(copy, size), "unterminated string");
+
+        // every node made a child of node 1: shared subtrees
+        memcpy(copy, data, size);
+        size_t lists = sizeof(h) + ((sizeof(double) * h.number_count + 7) & ~(size_t)7)
+            + 5 * ((sizeof(uint32_t) * h.node_count + 7) & ~(size_t)7);
+        for (uint32_t i = 0; i < h.list_count; i++)
+            memcpy(damaged + lists + 4 * i, &(uint32_t){ 2 }, 4);
+        check(!decodes(copy, size), "shared children");
+
+        free(copy);
+        free(data);
+    }
+
+    check(ast_load("ast_binary_test_missing.qka", NULL) == NULL, "missing file");
+
+    remove(AST_FILE);
+    parser_free(p);
+    lexerFree(lx);
+    intern_clear();
+
+    return test_finish("binary AST");
+}
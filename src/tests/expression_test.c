@@ -0,0 +1,217 @@
+// Operator precedence and associativity, checked against a fully
+// parenthesised rendering of each parsed expression, then nesting deep enough
+// to overflow a recursive descent parser: parentheses, prefix operators and a
+// long operator chain. The deep trees also go through the pooled layout and
+// its printer.
+
+#include "../ast_pool.h"
+#include "../compat.h"
+#include "../parser.h"
+#include "../intern.h"
+#include "../validator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    const char *source;
+    const char *expected;
+} Case;
+
+static const Case cases[] = {
+    { "a + b * c;", "(a + (b * c))" },
+    { "a * b + c;", "((a * b) + c)" },
+    { "a - b - c;", "((a - b) - c)" },
+    { "a / b % c * d;", "(((a / b) % c) * d)" },
+    { "(a + b) * c;", "((a + b) * c)" },
+    { "((((a))));", "a" },
+    { "-a * b;", "((-a) * b)" },
+    { "a * -b;", "(a * (-b))" },
+    { "- - a;", "(-(-a))" },
+    { "a - -1;", "(a - (-1))" },
+    { "a < b + c;", "(a < (b + c))" },
+    { "a == b != c;", "((a == b) != c)" },
+    { "a <= b and c >= d;", "((a <= b) and (c >= d))" },
+    { "a or b and c;", "(a or (b and c))" },
+    { "a and b or c;", "((a and b) or c)" },
+    { "a xor b or c and d;", "((a xor b) or (c and d))" },
+    { "a nor b xnor c nand d;", "(a nor (b xnor (c nand d)))" },
+    { "not a == b;", "(not(a == b))" },
+    { "not a and b;", "((not a) and b)" },
+    { "not not a;", "(not(not a))" },
+    { "a = b = c + 1;", "(a = (b = (c + 1)))" },
+    { "a = not b or c;", "(a = ((not b) or c))" },
+    { "f(a + b * c, k=-1);", "f((a + (b * c)), (k = (-1)))" },
+    { "x.y(a) * 2;", "(x.y(a) * 2)" },
+};
+
+typedef struct
+{
+    char *text;
+    size_t used;
+    size_t capacity;
+} Buffer;
+
+static void put(Buffer *b, const char *s, size_t n)
+{
+    if (b->used + n + 1 > b->capacity)
+    {
+        b->capacity = (b->used + n + 1) * 2;
+        b->text = realloc(b->text, b->capacity);
+    }
+    memcpy(b->text + b->used, s, n);
+    b->used += n;
+    b->text[b->used] = '\0';
+}
+
+static void puts_buffer(Buffer *b, const char *s)
+{
+    put(b, s, strlen(s));
+}
+
+static void render(Buffer *b, const ASTNode *node)
+{
+    char number[32];
+    if (!node)
+    {
+        puts_buffer(b, "?");
+        return;
+    }
+
+    switch (node->type)
+    {
+        case AST_IDENTIFIER:
+            put(b, node->string_value, intern_length(node->string_value));
+            break;
+        case AST_NUMBER:
+            snprintf(number, sizeof(number), "%g", node->number_value);
+            puts_buffer(b, number);
+            break;
+        case AST_UNARY_OP:
+            puts_buffer(b, "(");
+            puts_buffer(b, ast_op_name(node->op));
+            if (node->op == AST_OP_NOT && node->left && node->left->type != AST_UNARY_OP
+                && node->left->type != AST_BINARY_OP)
+                puts_buffer(b, " ");
+            render(b, node->left);
+            puts_buffer(b, ")");
+            break;
+        case AST_BINARY_OP:
+            puts_buffer(b, "(");
+            render(b, node->left);
+            puts_buffer(b, " ");
+            puts_buffer(b, ast_op_name(node->op));
+            puts_buffer(b, " ");
+            render(b, node->right);
+            puts_buffer(b, ")");
+            break;
+        case AST_MEMBER_ACCESS:
+            render(b, node->left);
+            puts_buffer(b, ".");
+            render(b, node->right);
+            break;
+        case AST_CALL:
+            render(b, node->left);
+            puts_buffer(b, "(");
+            for (int i = 0; node->right && i < node->right->num_children; i++)
+            {
+                if (i > 0) puts_buffer(b, ", ");
+                render(b, node->right->children[i]);
+            }
+            puts_buffer(b, ")");
+            break;
+        default:
+            puts_buffer(b, ast_type_name(node->type));
+            break;
+    }
+}
+
+// the expression of a single expression statement, NULL for anything else
+static ASTNode* parse(const char *source, Parser **parser, Lexer **lexer)
+{
+    *lexer = lexerInitBuffer(source, strlen(source));
+    *parser = parser_init(*lexer);
+    ASTNode *program = parser_parse(*parser);
+    if (program->num_children != 1 || program->children[0]->type != AST_EXPR)
+        return NULL;
+    return program->children[0]->left;
+}
+
+// Prints the pooled tree with stdout sent to the null device. The base depth
+// is negative so no line is indented, indentation alone would make the output
+// quadratic in the depth.
+static void print_pooled(ASTNode *node)
+{
+    ASTPool *pool = ast_pool_from_tree(node);
+    fflush(stdout);
+    int saved = compat_dup(fileno(stdout));
+    if (freopen(COMPAT_NULL_DEVICE, "w", stdout))
+    {
+        ast_pool_print(pool, pool->root, -(int)pool->count);
+        fflush(stdout);
+    }
+    compat_dup2(saved, fileno(stdout));
+    compat_close(saved);
+    clearerr(stdout);
+    ast_pool_free(pool);
+}
+
+static int check_deep(const char *what, const char *open, const char *middle, const char *close, int depth)
+{
+    Buffer b = { 0 };
+    puts_buffer(&b, "x = ");
+    for (int i = 0; i < depth; i++) puts_buffer(&b, open);
+    puts_buffer(&b, middle);
+    for (int i = 0; i < depth; i++) puts_buffer(&b, close);
+    puts_buffer(&b, ";");
+
+    Parser *p;
+    Lexer *lx;
+    ASTNode *expr = parse(b.text, &p, &lx);
+    int ok = expr && p->error_count == 0;
+    ValidationResult *result = ok ? validator_validate(expr) : NULL;
+    ok = ok && result->error_count == 0;
+    if (ok)
+        print_pooled(expr->right);
+    if (!ok)
+        fprintf(stderr, "FAIL: %s nested %d deep\n", what, depth);
+
+    validator_free(result);
+    parser_free(p);
+    lexerFree(lx);
+    free(b.text);
+    return !ok;
+}
+
+int main(void)
+{
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        Parser *p;
+        Lexer *lx;
+        ASTNode *expr = parse(cases[i].source, &p, &lx);
+        Buffer b = { 0 };
+        render(&b, expr);
+        if (!expr || p->error_count != 0 || strcmp(b.text, cases[i].expected) != 0)
+        {
+            fprintf(stderr, "FAIL: %s parsed as %s, expected %s\n", cases[i].source, b.text, cases[i].expected);
+            failures++;
+        }
+        free(b.text);
+        parser_free(p);
+        lexerFree(lx);
+    }
+
+    failures += check_deep("parentheses", "(", "a", ")", 200000);
+    failures += check_deep("prefix operators", "- not ", "a", "", 200000);
+    failures += check_deep("operator chain", "a + ", "a", "", 200000);
+    failures += check_deep("mixed", "(a * -(b + ", "c", "))", 100000);
+    intern_clear();
+
+    if (failures)
+        return 1;
+    printf("expression parsing OK\n");
+    return 0;
+}
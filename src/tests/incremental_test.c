@@ -0,0 +1,127 @@
+// Random edits applied through document_edit, each checked against a fresh
+// document_open of the same text: same tokens, same statement ranges, same
+// error count and an identical tree. Then the cost of a one character edit in
+// a large script, incremental against a full re-parse.
+
+#include "../document.h"
+#include "../intern.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *statements[] = {
+    "new device USB%d as Mouse;\n",
+    "USB%d.connect();\n",
+    "if (USB%d.status() == \"connected\") then {\n    USB%d.write(header=\"KEY-UP\", payload=\"LEFT\");\n} else {\n    log(\"no\");\n};\n",
+    "@import \"keys%d.j\";\n",
+    "// comment %d\n",
+    "log(\"two\nlines %d\");\n",
+};
+
+static const char *snippets[] = {
+    ";", "\n", " ", "\"", "//", "(", ")", "{", "}", "=", "==", "x", "USB9", ".", "status()",
+    "new device A as B;\n", "if (a) then { b(); };\n", "\"str\ning\"", "log(1);", "12.5",
+};
+
+static char* make_script(int count, size_t *length)
+{
+    size_t capacity = (size_t)count * 160 + 1;
+    char *text = malloc(capacity);
+    size_t used = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const char *format = statements[next_random(sizeof(statements) / sizeof(statements[0]))];
+        int n = (int)next_random(10);
+        used += (size_t)snprintf(text + used, capacity - used, format, n, n);
+    }
+    *length = used;
+    return text;
+}
+
+static int same_document(const Document *a, const Document *b)
+{
+    const TokenStream *x = a->tokens;
+    const TokenStream *y = b->tokens;
+    if (a->length != b->length || memcmp(a->text, b->text, a->length) != 0) return 0;
+    if (x->count != y->count) return 0;
+    for (size_t i = 0; i < x->count; i++)
+    {
+        if (x->type[i] != y->type[i] || x->offset[i] != y->offset[i] || x->length[i] != y->length[i]
+            || x->line[i] != y->line[i] || x->column[i] != y->column[i])
+            return 0;
+    }
+    if (a->error_count != b->error_count) return 0;
+    for (int i = 0; i < a->program->num_children; i++)
+    {
+        if (i >= b->program->num_children) return 0;
+        if (a->statements[i].first != b->statements[i].first || a->statements[i].end != b->statements[i].end)
+            return 0;
+    }
+    return same_tree(a->program, b->program);
+}
+
+static double seconds(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+int main(void)
+{
+    seed_random(4242);
+    size_t length;
+    char *text = make_script(40, &length);
+    Document *doc = document_open(text, length);
+    free(text);
+
+    size_t reparsed = 0, statements_total = 0;
+    for (int edit = 0; edit < 3000 && !failures; edit++)
+    {
+        size_t offset = next_random((unsigned)doc->length + 1);
+        size_t deleted = next_random(4) ? 0 : next_random(12);
+        if (deleted > doc->length - offset) deleted = doc->length - offset;
+        const char *inserted = next_random(3) ? snippets[next_random(sizeof(snippets) / sizeof(snippets[0]))] : "";
+
+        document_edit(doc, offset, deleted, inserted, strlen(inserted));
+        reparsed += doc->reparsed_statements;
+        statements_total += (size_t)doc->program->num_children;
+
+        Document *fresh = document_open(doc->text, doc->length);
+        if (!same_document(doc, fresh))
+        {
+            printf("FAIL: edit %d (%zu, -%zu, +\"%s\") differs from a fresh parse\n", edit, offset, deleted, inserted);
+            failures++;
+        }
+        document_free(fresh);
+
+        // keep the script from drifting too far from its original size
+        if (doc->length > 8000)
+            document_edit(doc, doc->length / 2, doc->length / 4, "", 0);
+    }
+    document_free(doc);
+    printf("random edits: %zu of %zu statements re-parsed\n", reparsed, statements_total);
+
+    // one character typed into the middle of a large script
+    text = make_script(20000, &length);
+    double start = seconds();
+    doc = document_open(text, length);
+    double full = seconds() - start;
+
+    int rounds = 200;
+    start = seconds();
+    for (int i = 0; i < rounds; i++)
+    {
+        size_t offset = length / 2 + (size_t)i;
+        document_edit(doc, offset, 0, "\n", 1);
+    }
+    double incremental = (seconds() - start) / rounds;
+    printf("%zu byte script: full parse %.2f ms, incremental edit %.3f ms\n",
+        length, full * 1e3, incremental * 1e3);
+
+    document_free(doc);
+    free(text);
+    intern_clear();
+
+    return test_finish("incremental parsing");
+}
@@ -22,6 +22,8 @@ static const char *tokenName(TokenType t)
         case TOK_USBIN: return "USBIN";
         case TOK_USBOUT: return "USBOUT";
         case TOK_AS: return "AS";
+        case TOK_DEVICE: return "DEVICE";
+        case TOK_HEADER: return "HEADER";
         case TOK_STATUS: return "STATUS";
         case TOK_CONNECT: return "CONNECT";
         case TOK_THEN: return "THEN";
@@ -80,15 +82,14 @@ int main(int argc, char **argv)
     for (;;)
     {
         Token tok = lexerNextToken(lx);
-        printf("[%d:%d] %-12s %s\n",
+        int has_text = tok.type == TOK_IDENTIFIER || tok.type == TOK_NUMBER
+            || tok.type == TOK_STRING || tok.type == TOK_UNKNOWN;
+        printf("[%d:%d] %-12s %.*s\n",
             tok.line,
             tok.column,
             tokenName(tok.type),
-            tok.value ? tok.value : "");
-
-        if (tok.value) {
-            free(tok.value);
-        }
+            has_text ? (int)tok.length : 0,
+            lexerTokenText(lx, &tok));
 
         if (tok.type == TOK_EOF)
             break;
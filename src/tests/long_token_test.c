@@ -0,0 +1,140 @@
+// Tokens far larger than the lexer's read window: a multi-MB string literal,
+// a long identifier and a long number, lexed from a buffer and streamed from a
+// file. Optional argument: size of the string payload in bytes.
+
+#include "../parser.h"
+#include "../intern.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct
+{
+    TokenType type;
+    size_t offset;
+    size_t length;
+} Expected;
+
+// a check about one of the inputs, named in the report
+static void check_in(int ok, const char *what, const char *path)
+{
+    char message[512];
+    if (ok) return;
+    snprintf(message, sizeof(message), "(%s) %s", path, what);
+    check(0, message);
+}
+
+static void lex_all(Lexer *lx, const char *source, const Expected *expected, int count, const char *path)
+{
+    clock_t start = clock();
+    for (int i = 0; i <= count; i++)
+    {
+        Token tok = lexerNextToken(lx);
+        if (i == count)
+        {
+            check_in(tok.type == TOK_EOF, "missing EOF", path);
+            break;
+        }
+
+        const Expected *e = &expected[i];
+        check_in(tok.type == e->type, "token type", path);
+        check_in(tok.offset == e->offset, "token offset", path);
+        check_in(tok.length == e->length, "token length", path);
+        if (tok.length == e->length)
+            check_in(memcmp(lexerTokenText(lx, &tok), source + e->offset, e->length) == 0, "token text", path);
+    }
+    printf("%-8s %.3f s\n", path, (double)(clock() - start) / CLOCKS_PER_SEC);
+}
+
+int main(int argc, char **argv)
+{
+    size_t payload = argc > 1 ? strtoul(argv[1], NULL, 10) : 8u << 20;
+    size_t ident = payload / 16 + 1;
+    size_t digits = payload / 16 + 1;
+
+    size_t capacity = payload + ident + digits + 64;
+    char *source = malloc(capacity);
+    Expected expected[16];
+    int count = 0;
+    size_t used = 0;
+
+    // log("<payload>");
+    memcpy(source + used, "log(\"", 5);
+    expected[count++] = (Expected){ TOK_LOG, used, 3 };
+    expected[count++] = (Expected){ TOK_LPAREN, used + 3, 1 };
+    used += 5;
+    size_t body = used;
+    size_t unescaped = 0;
+    for (size_t i = 0; i < payload; i++, unescaped++)
+    {
+        if (i % 4096 == 4094 && i + 1 < payload)
+        {
+            // an escaped quote every so often, and some newlines
+            source[used++] = '\\';
+            source[used++] = '"';
+            i++;
+            continue;
+        }
+        source[used++] = i % 97 == 96 ? '\n' : (char)('a' + i % 26);
+    }
+    expected[count++] = (Expected){ TOK_STRING, body, used - body };
+    memcpy(source + used, "\");\n", 4);
+    expected[count++] = (Expected){ TOK_RPAREN, used + 1, 1 };
+    expected[count++] = (Expected){ TOK_SEMICOLON, used + 2, 1 };
+    used += 4;
+
+    // <identifier>(<number>);
+    size_t at = used;
+    for (size_t i = 0; i < ident; i++)
+        source[used++] = i == 0 ? '_' : (char)('a' + i % 26);
+    expected[count++] = (Expected){ TOK_IDENTIFIER, at, ident };
+    source[used++] = '(';
+    expected[count++] = (Expected){ TOK_LPAREN, used - 1, 1 };
+    at = used;
+    for (size_t i = 0; i < digits; i++)
+        source[used++] = (char)('0' + i % 10);
+    expected[count++] = (Expected){ TOK_NUMBER, at, digits };
+    source[used++] = ')';
+    expected[count++] = (Expected){ TOK_RPAREN, used - 1, 1 };
+    source[used++] = ';';
+    expected[count++] = (Expected){ TOK_SEMICOLON, used - 1, 1 };
+    source[used] = '\0';
+
+    Lexer *lx = lexerInitBuffer(source, used);
+    lex_all(lx, source, expected, count, "buffer");
+    lexerFree(lx);
+
+    const char *tmp = "long_token_test.tmp";
+    FILE *f = fopen(tmp, "w+b");
+    if (!f)
+    {
+        perror(tmp);
+        return 1;
+    }
+    fwrite(source, 1, used, f);
+    rewind(f);
+    lx = lexerInit(f);
+    lex_all(lx, source, expected, count, "stream");
+    lexerFree(lx);
+    fclose(f);
+    remove(tmp);
+
+    // the parser sees the whole literal, escapes resolved
+    lx = lexerInitBuffer(source, used);
+    Parser *p = parser_init(lx);
+    ASTNode *program = parser_parse(p);
+    ASTNode *call = program->num_children > 0 ? program->children[0]->left : NULL;
+    ASTNode *args = call && call->type == AST_CALL ? call->right : NULL;
+    ASTNode *str = args && args->num_children > 0 ? args->children[0] : NULL;
+    check_in(str && str->type == AST_STRING && intern_length(str->string_value) == unescaped,
+        "parsed string length", "parser");
+    check_in(p->error_count == 0, "parse errors", "parser");
+    parser_free(p);
+    lexerFree(lx);
+    intern_clear();
+    free(source);
+
+    return test_finish("long tokens");
+}
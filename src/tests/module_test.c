@@ -0,0 +1,134 @@
+// Import resolution through a shared module cache: 500 scripts importing the
+// same headers parse each header once, dependencies come out before their
+// importers, a changed header is parsed again, and unreadable files and
+// import cycles are reported. Different spellings of one path are one module.
+
+#include "../module.h"
+#include "../compat.h"
+#include "../parser.h"
+#include "../intern.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void write_file(const char *path, const char *text)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+    fputs(text, f);
+    fclose(f);
+}
+
+static const char *files[] = {
+    "module_test_base.j", "module_test_left.j", "module_test_right.j", "module_test_top.j",
+    "module_test_cycle_a.j", "module_test_cycle_b.j",
+    "module_test_dir/module_test_shared.j", "module_test_dir/module_test_inner.j",
+};
+
+// the path modules are known by, as module_resolve interns it
+static const char* canonical(const char *path)
+{
+    char *real = compat_realpath(path);
+    const char *interned = intern_cstr(real ? real : path);
+    free(real);
+    return interned;
+}
+
+// position of path in the graph, -1 when missing
+static int position(const ImportGraph *graph, const char *path)
+{
+    for (size_t i = 0; i < graph->count; i++)
+    {
+        if (graph->modules[i]->path == canonical(path))
+            return (int)i;
+    }
+    return -1;
+}
+
+static int resolve(ModuleCache *cache, const char *source, ImportGraph *graph)
+{
+    Lexer *lx = lexerInitBuffer(source, strlen(source));
+    Parser *p = parser_init(lx);
+    ASTNode *program = parser_parse(p);
+    int errors = module_resolve(cache, "module_test.qk", program, graph);
+    parser_free(p);
+    lexerFree(lx);
+    return errors;
+}
+
+int main(void)
+{
+    compat_mkdir("module_test_dir");
+    write_file(files[0], "new device USB0 as Hub;\n");
+    write_file(files[1], "@import \"module_test_base.j\";\nlog(\"left\");\n");
+    write_file(files[2], "@import \"module_test_base.j\";\nlog(\"right\");\n");
+    write_file(files[3], "@import \"module_test_left.j\";\n@import \"module_test_right.j\";\n");
+    write_file(files[4], "@import \"module_test_cycle_b.j\";\n");
+    write_file(files[5], "@import \"module_test_cycle_a.j\";\n");
+    write_file(files[6], "log(\"shared\");\n");
+    write_file(files[7], "@import \"./module_test_shared.j\";\n");
+
+    ModuleCache *cache = module_cache_create(4);
+    const char *script = "@import \"module_test_top.j\";\n@import \"module_test_right.j\";\nUSB0.connect();\n";
+    for (int i = 0; i < 500; i++)
+    {
+        ImportGraph graph;
+        int errors = resolve(cache, script, &graph);
+        if (i == 0)
+        {
+            check(errors == 0 && graph.count == 4, "four modules, no errors");
+            int base = position(&graph, files[0]), left = position(&graph, files[1]);
+            int right = position(&graph, files[2]), top = position(&graph, files[3]);
+            check(base >= 0 && left >= 0 && right >= 0 && top >= 0, "every module in the graph");
+            check(base < left && base < right && left < top && right < top, "dependencies first");
+            for (size_t m = 0; m < graph.count; m++)
+                check(graph.modules[m]->error_count == 0, "module parse errors");
+        }
+        module_graph_free(&graph);
+    }
+    check(module_cache_parses(cache) == 4, "each header parsed once for 500 scripts");
+
+    // a changed header is parsed again, the others still come from the cache
+    write_file(files[1], "@import \"module_test_base.j\";\nlog(\"left, changed\");\n");
+    ImportGraph graph;
+    resolve(cache, script, &graph);
+    check(module_cache_parses(cache) == 5, "changed header parsed again");
+    check(graph.count == 4, "graph after a change");
+    module_graph_free(&graph);
+
+    int errors = resolve(cache, "@import \"module_test_missing.j\";\n", &graph);
+    check(errors == 1 && graph.diagnostics.count == 1 && graph.diagnostics.items[0].line == 1
+        && graph.diagnostics.items[0].detail == intern_cstr("module_test_missing.j"), "unreadable import");
+    module_graph_free(&graph);
+
+    errors = resolve(cache, "@import \"module_test_cycle_a.j\";\n", &graph);
+    check(errors == 1 && graph.count == 2, "import cycle reported once");
+    module_graph_free(&graph);
+
+    // one file through three spellings, two of them from the script
+    size_t parses = module_cache_parses(cache);
+    errors = resolve(cache, "@import \"module_test_dir/module_test_shared.j\";\n"
+        "@import \"./module_test_dir/../module_test_dir//module_test_shared.j\";\n"
+        "@import \"module_test_dir/module_test_inner.j\";\n", &graph);
+    check(errors == 0 && graph.count == 2, "one module for every spelling");
+    check(position(&graph, files[6]) == 0 && position(&graph, files[7]) == 1, "shared module before its importer");
+    check(module_cache_parses(cache) == parses + 2, "shared module parsed once");
+    module_graph_free(&graph);
+
+    errors = resolve(cache, "@import \"module_test_missing.j\";\n@import \"module_test_dir/../module_test_missing.j\";\n", &graph);
+    check(errors == 1 && graph.diagnostics.count == 1, "unreadable import reported once for two spellings");
+    module_graph_free(&graph);
+
+    module_cache_free(cache);
+    intern_clear();
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+        remove(files[i]);
+    compat_rmdir("module_test_dir");
+
+    return test_finish("module resolution");
+}
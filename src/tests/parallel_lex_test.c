@@ -0,0 +1,96 @@
+// lexerTokenizeParallel against the serial lexer over a generated script full
+// of the constructs that make chunk splitting hard: strings spanning lines,
+// escaped quotes, quotes inside comments, // inside strings, and one literal
+// longer than a whole chunk. Every token field has to match, for several
+// thread counts.
+
+#include "../lexer.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *pieces[] = {
+    "new device USB1 as Mouse;\n",
+    "USB1.write(header=\"KEY-UP\", payload=\"LEFT\");\n",
+    "// a comment with a \" quote in it\n",
+    "// \"unbalanced\n",
+    "log(\"a string // that is not a comment\");\n",
+    "log(\"line one\nline two \\\" still inside\n\");\n",
+    "log(\"escaped backslash \\\\\");\n",
+    "if (a >= 10.5 and b != c) then { x.y(); } else { z(); };\n",
+    "   \t\r\n",
+    "/ / // done\n",
+    "weird @ ! % [ ] : \\ \x80\x81;\n",
+    "\n\n",
+};
+
+static int compare(const TokenStream *a, const TokenStream *b, int threads)
+{
+    if (a->count != b->count)
+    {
+        fprintf(stderr, "FAIL (%d threads): %zu tokens, expected %zu\n", threads, b->count, a->count);
+        return 1;
+    }
+    for (size_t i = 0; i < a->count; i++)
+    {
+        if (a->type[i] != b->type[i] || a->offset[i] != b->offset[i] || a->length[i] != b->length[i]
+            || a->line[i] != b->line[i] || a->column[i] != b->column[i])
+        {
+            fprintf(stderr, "FAIL (%d threads): token %zu differs\n", threads, i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    seed_random(12345);
+    size_t capacity = 8u << 20;
+    char *source = malloc(capacity);
+    size_t length = 0;
+    int long_literal = 0;
+
+    while (length < capacity - (1u << 20) - 256)
+    {
+        if (!long_literal && length > capacity / 3)
+        {
+            // one string with newlines that outlasts a whole chunk
+            long_literal = 1;
+            source[length++] = '"';
+            for (int i = 0; i < 1 << 20; i++)
+                source[length++] = i % 61 == 60 ? '\n' : (char)('a' + i % 26);
+            source[length++] = '"';
+            source[length++] = ';';
+            continue;
+        }
+
+        const char *piece = pieces[next_random(sizeof(pieces) / sizeof(pieces[0]))];
+        size_t n = strlen(piece);
+        memcpy(source + length, piece, n);
+        length += n;
+    }
+
+    // an unterminated string running to the end
+    memcpy(source + length, "log(\"never closed\n", 18);
+    length += 18;
+
+    Lexer *lx = lexerInitBuffer(source, length);
+    TokenStream *serial = lexerTokenizeAll(lx);
+
+    int counts[] = { 1, 2, 3, 4, 7, 8, 16, 0 };
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    {
+        TokenStream *parallel = lexerTokenizeParallel(source, length, counts[i]);
+        failures += compare(serial, parallel, counts[i]);
+        lexerFreeTokens(parallel);
+    }
+
+    printf("%zu bytes, %zu tokens\n", length, serial->count);
+    lexerFreeTokens(serial);
+    lexerFree(lx);
+    free(source);
+
+    return test_finish("parallel lexing");
+}
@@ -6,16 +6,19 @@
 #include "../ast.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 int main(int argc, char **argv)
 {
-    if (argc < 2)
+    // --tokens lexes the whole file first and parses the token stream
+    int batch = argc > 2 && strcmp(argv[1], "--tokens") == 0;
+    if (argc < 2 + batch)
     {
-        fprintf(stderr, "Usage: %s <file_name.qk>", argv[0]);
+        fprintf(stderr, "Usage: %s [--tokens] <file_name.qk>", argv[0]);
         return 1;
     }
 
-    const char *path = argv[1];
+    const char *path = argv[1 + batch];
 
     FILE *f = fopen(path, "r");
     if (!f)
@@ -25,15 +28,28 @@ int main(int argc, char **argv)
     }
 
     Lexer *lx = lexerInit(f);
-    Parser *p = parser_init(lx);
+    TokenStream *tokens = NULL;
+    Parser *p;
+    if (batch)
+    {
+        tokens = lexerTokenizeAll(lx);
+        p = parser_init_tokens(tokens, NULL);
+    } else
+    {
+        p = parser_init(lx);
+    }
 
     ASTNode *program = parser_parse(p);
+    diagnostics_print(&p->diagnostics, stderr, "Parse error");
 
     ast_print(program, 0);
 
-    printf("\n Errors: %d \n", p->error_count);
-    ast_free(program);
+    int error_count = p->error_count;
+    printf("\n Errors: %d \n", error_count);
+    if (batch) ast_free(program);
+    parser_free(p);
+    lexerFreeTokens(tokens);
     lexerFree(lx);
     fclose(f);
-    return p->error_count > 0 ? 1 : 0;
+    return error_count > 0 ? 1 : 0;
 }
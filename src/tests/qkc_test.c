@@ -0,0 +1,144 @@
+// The .qkc cache: a stored tree loads back identical, also 200k levels deep,
+// and truncated, damaged, foreign-version or mismatched entries are misses,
+// never crashes.
+
+#include "../qkc.h"
+#include "../compat.h"
+#include "../module.h"
+#include "../parser.h"
+#include "../intern.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_DIR "qkc_test_cache"
+#define HEADER_SIZE 24     // QkcHeader, left intact below unless testing it
+
+static char* entry_path(uint64_t key)
+{
+    static char path[128];
+    snprintf(path, sizeof(path), "%s/%016llx.qkc", CACHE_DIR, (unsigned long long)key);
+    return path;
+}
+
+static char* read_entry(uint64_t key, size_t *size)
+{
+    FILE *f = fopen(entry_path(key), "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *size = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = malloc(*size);
+    *size = fread(data, 1, *size, f);
+    fclose(f);
+    return data;
+}
+
+static void write_entry(uint64_t key, const char *data, size_t size)
+{
+    FILE *f = fopen(entry_path(key), "wb");
+    fwrite(data, 1, size, f);
+    fclose(f);
+}
+
+// parses source, stores it and loads it back; 1 when the two trees match
+static int round_trip(const char *source, size_t length, uint64_t *key)
+{
+    Lexer *lx = lexerInitBuffer(source, length);
+    Parser *p = parser_init(lx);
+    ASTNode *program = parser_parse(p);
+    *key = qkc_key(module_content_hash(source, length));
+
+    int ok = p->error_count == 0 && qkc_store(CACHE_DIR, *key, length, program) == 0;
+    Arena *arena = arena_create();
+    ASTNode *loaded = ok ? qkc_load(CACHE_DIR, *key, length, arena) : NULL;
+    ok = loaded && same_tree(program, loaded);
+
+    arena_free(arena);
+    parser_free(p);
+    lexerFree(lx);
+    return ok;
+}
+
+static int loads(uint64_t key, size_t source_size)
+{
+    Arena *arena = arena_create();
+    ASTNode *tree = qkc_load(CACHE_DIR, key, source_size, arena);
+    arena_free(arena);
+    return tree != NULL;
+}
+
+int main(void)
+{
+    const char *script =
+        "@import \"logging.j\";\n"
+        "new device USB1 as Keyboard;\n"
+        "USB1.connect();\n"
+        "if (USB1.status() == \"connected\" and not (x < 3.5)) then {\n"
+        "    USB1.write(header=\"KEY-UP\", payload=-42 * (y + 1) % 7);\n"
+        "} else {\n"
+        "    log(\"Keyboard not detected, aborting.\");\n"
+        "};\n"
+        "z = a = b;\n";
+    size_t length = strlen(script);
+
+    uint64_t key;
+    check(round_trip(script, length, &key), "script round trip");
+    check(!loads(key, length + 1), "other source size misses");
+    check(!loads(key ^ 1, length), "other key misses");
+
+    // left-nested 200k deep, the pool conversions must not recurse
+    size_t deep_length = 0;
+    char *deep = malloc(8 + 4 * 200000);
+    deep_length += (size_t)sprintf(deep, "x = a");
+    for (int i = 0; i < 200000; i++)
+        deep_length += (size_t)sprintf(deep + deep_length, " - a");
+    deep_length += (size_t)sprintf(deep + deep_length, ";\n");
+    uint64_t deep_key;
+    check(round_trip(deep, deep_length, &deep_key), "deep tree round trip");
+    free(deep);
+
+    size_t size;
+    char *entry = read_entry(key, &size);
+    check(entry != NULL && size > HEADER_SIZE, "entry written under its key");
+    if (entry)
+    {
+        write_entry(key, entry, size - 8);
+        check(!loads(key, length), "truncated entry misses");
+
+        char *copy = malloc(size);
+        memcpy(copy, entry, size);
+        copy[4] ^= 0x7f;    // version
+        write_entry(key, copy, size);
+        check(!loads(key, length), "other version misses");
+
+        memcpy(copy, entry, HEADER_SIZE);
+        memset(copy + HEADER_SIZE, 0xff, size - HEADER_SIZE);
+        write_entry(key, copy, size);
+        check(!loads(key, length), "garbage body misses");
+
+        // single damaged bytes may still load (a line number, say) but must never crash
+        unsigned seed = 12345;
+        for (int i = 0; i < 2000; i++)
+        {
+            memcpy(copy, entry, size);
+            seed = seed * 1103515245u + 12345u;
+            copy[HEADER_SIZE + (seed >> 8) % (size - HEADER_SIZE)] ^= (char)(1 + (seed >> 24) % 255);
+            write_entry(key, copy, size);
+            loads(key, length);
+        }
+
+        write_entry(key, entry, size);
+        check(loads(key, length), "restored entry loads");
+        free(copy);
+        free(entry);
+    }
+
+    remove(entry_path(key));
+    remove(entry_path(deep_key));
+    check(compat_rmdir(CACHE_DIR) == 0, "cache directory holds only the two entries");
+    intern_clear();
+
+    return test_finish("qkc cache");
+}
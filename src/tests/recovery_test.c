@@ -0,0 +1,96 @@
+// Panic mode recovery: one diagnostic per real mistake, parsing resumes at
+// the next statement boundary, and a script broken all the way through stops
+// at PARSER_ERROR_LIMIT instead of reporting every cascade.
+
+#include "../parser.h"
+#include "../intern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    const char *source;
+    int errors;
+    int line;           // of the first diagnostic
+    int column;
+    int statements;     // top-level statements kept
+} Case;
+
+static const Case cases[] = {
+    { "log(1);\nlog(2);\n", 0, 0, 0, 2 },
+    // missing ';' swallows the rest of the next statement, but no more
+    { "log(1)\nlog(2);\nlog(3);\n", 1, 2, 0, 2 },
+    { "new device A as B\nnew device C as D;\n", 1, 2, 0, 2 },
+    // unbalanced parentheses and stray operands are one error each
+    { "x = (a + b;\nlog(2);\n", 1, 1, 10, 2 },
+    { "f(a b c d e);\nlog(2);\n", 1, 1, 4, 2 },
+    { "x = * * *;\nlog(2);\n", 1, 1, 4, 2 },
+    // stray closing brace at the top level
+    { "}\nlog(1);\n", 1, 1, 0, 2 },
+    // an error inside a block does not take the rest of the block with it
+    { "if (a) then {\n  log(1 +);\n  log(2);\n} else {\n  log(3);\n};\nlog(4);\n", 1, 2, 9, 2 },
+    { "if (a then { log(1); };\nlog(2);\n", 1, 1, 6, 2 },
+    { "@import \"a.j\"\n@import \"b.j\";\n", 1, 2, 0, 2 },
+    // two real mistakes, two errors
+    { "log(1;\nlog(2);\nlog(3;\n", 2, 1, 5, 3 },
+    // unterminated block runs to the end of input
+    { "if (a) then {\n  log(1);\n", 1, 3, 0, 1 },
+};
+
+static int check(const Case *c)
+{
+    Lexer *lx = lexerInitBuffer(c->source, strlen(c->source));
+    Parser *p = parser_init(lx);
+    ASTNode *program = parser_parse(p);
+
+    int ok = p->error_count == c->errors && (size_t)p->error_count == p->diagnostics.count
+        && program->num_children == c->statements;
+    if (ok && c->errors > 0)
+        ok = p->diagnostics.items[0].line == c->line && p->diagnostics.items[0].column == c->column;
+    if (!ok)
+    {
+        fprintf(stderr, "FAIL: %d errors, %d statements, expected %d and %d for:\n%s",
+            p->error_count, program->num_children, c->errors, c->statements, c->source);
+        diagnostics_print(&p->diagnostics, stderr, "Parse error");
+    }
+
+    parser_free(p);
+    lexerFree(lx);
+    return !ok;
+}
+
+int main(void)
+{
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        failures += check(&cases[i]);
+
+    // every line broken: the parser stops at the limit, with a final note
+    size_t lines = 100000;
+    const char *broken = "USB1.write(header=\"KEY-UP\" payload=\"LEFT\");\n";
+    size_t n = strlen(broken);
+    char *source = malloc(lines * n + 1);
+    for (size_t i = 0; i < lines; i++)
+        memcpy(source + i * n, broken, n);
+    source[lines * n] = '\0';
+
+    Lexer *lx = lexerInitBuffer(source, lines * n);
+    Parser *p = parser_init(lx);
+    ASTNode *program = parser_parse(p);
+    if (p->error_count != PARSER_ERROR_LIMIT || p->diagnostics.count != PARSER_ERROR_LIMIT + 1
+        || program->num_children != PARSER_ERROR_LIMIT)
+    {
+        fprintf(stderr, "FAIL: error limit, %d errors in %d statements\n", p->error_count, program->num_children);
+        failures++;
+    }
+    parser_free(p);
+    lexerFree(lx);
+    free(source);
+    intern_clear();
+
+    if (failures)
+        return 1;
+    printf("error recovery OK\n");
+    return 0;
+}
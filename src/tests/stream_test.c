@@ -0,0 +1,108 @@
+// Statement streaming: 200k statements with distinct string payloads, read
+// through stdio, go to the callback in order while the interned strings stay
+// bounded; kept strings survive for later diagnostics. Also intern_release on
+// its own: strings from before the mark keep their pointers and stay findable.
+
+#include "../parser.h"
+#include "../validator.h"
+#include "../intern.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATEMENTS 200000
+
+typedef struct
+{
+    Validator *checker;
+    int statements;
+    int out_of_order;
+    size_t most_strings;
+} Replay;
+
+static int replay_statement(ASTNode *statement, void *ctx)
+{
+    Replay *replay = ctx;
+    replay->statements++;
+    if (statement->line != replay->statements) replay->out_of_order++;
+    if (intern_count() > replay->most_strings) replay->most_strings = intern_count();
+
+    int errors = validator_error_count(replay->checker);
+    validator_check_statement(statement, replay->checker);
+    return statement->type == AST_DECLARATION || validator_error_count(replay->checker) != errors;
+}
+
+static void check_release(void)
+{
+    char text[32];
+    const char *kept[1000];
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(text, sizeof(text), "kept%d", i);
+        kept[i] = intern_cstr(text);
+    }
+    size_t before = intern_count();
+
+    InternMark mark = intern_mark();
+    for (int i = 0; i < 50000; i++)
+    {
+        snprintf(text, sizeof(text), "dropped%d", i);
+        intern_cstr(text);
+    }
+    intern_cstr("kept7");
+    intern_release(mark);
+    check(intern_count() == before, "released strings forgotten");
+
+    int same = 1;
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(text, sizeof(text), "kept%d", i);
+        same = same && intern_cstr(text) == kept[i];
+    }
+    check(same && intern_count() == before, "older strings keep their pointers");
+    const char *again = intern_cstr("dropped42");
+    check(strcmp(again, "dropped42") == 0 && intern_length(again) == 9, "released text interns again");
+}
+
+int main(void)
+{
+    FILE *script = tmpfile();
+    if (!script)
+    {
+        perror("tmpfile");
+        return 1;
+    }
+    fputs("new device USB1 as Keyboard;\n", script);
+    for (int i = 2; i <= STATEMENTS; i++)
+    {
+        if (i == STATEMENTS / 2)
+            fputs("USB9.write(payload=\"lost\");\n", script);
+        else
+            fprintf(script, "USB1.write(header=\"KEY\", payload=\"p%d\");\n", i);
+    }
+    rewind(script);
+
+    size_t strings_before = intern_count();
+    Lexer *lx = lexerInit(script);
+    Parser *p = parser_init(lx);
+    Replay replay = { validator_begin(), 0, 0, 0 };
+    int errors = parser_stream(p, replay_statement, &replay);
+    ValidationResult *result = validator_finish(replay.checker, NULL, 0);
+
+    check(errors == 0, "no parse errors");
+    check(replay.statements == STATEMENTS && replay.out_of_order == 0, "every statement, in order");
+    check(replay.most_strings - strings_before < 32, "interned strings bounded");
+    check(result->error_count == 1 && result->diagnostics.items[0].line == STATEMENTS / 2
+        && strcmp(result->diagnostics.items[0].detail, "USB9") == 0, "kept strings outlive their statement");
+
+    validator_free(result);
+    parser_free(p);
+    lexerFree(lx);
+    fclose(script);
+
+    check_release();
+    intern_clear();
+
+    return test_finish("statement streaming");
+}
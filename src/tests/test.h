@@ -0,0 +1,90 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include "../ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Every failed check is reported and counted; test_finish turns the count
+// into the test's exit status
+static int failures;
+
+static inline void check(int ok, const char *what)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// 0 after printing "<what> OK" when nothing failed, 1 otherwise
+static inline int test_finish(const char *what)
+{
+    if (failures)
+    {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("%s OK\n", what);
+    return 0;
+}
+
+static unsigned long rng = 1;
+
+static inline void seed_random(unsigned long seed)
+{
+    rng = seed;
+}
+
+// a deterministic value below bound, so a failing run can be replayed
+static inline unsigned next_random(unsigned bound)
+{
+    rng = rng * 6364136223846793005ul + 1442695040888963407ul;
+    return (unsigned)((rng >> 33) % bound);
+}
+
+// node by node, with an explicit stack so a deep tree cannot overflow it
+static inline int same_tree(const ASTNode *a, const ASTNode *b)
+{
+    size_t capacity = 1024, depth = 0;
+    const ASTNode **stack = malloc(sizeof(ASTNode *) * capacity);
+    stack[depth++] = a;
+    stack[depth++] = b;
+    int same = 1;
+    while (depth > 0 && same)
+    {
+        const ASTNode *y = stack[--depth];
+        const ASTNode *x = stack[--depth];
+        if (!x || !y)
+        {
+            same = x == y;
+            continue;
+        }
+        if (x->type != y->type || x->op != y->op || x->line != y->line || x->column != y->column
+            || x->string_value != y->string_value || x->number_value != y->number_value
+            || x->num_children != y->num_children)
+        {
+            same = 0;
+            continue;
+        }
+        if (depth + 2 * ((size_t)x->num_children + 2) > capacity)
+        {
+            capacity = (depth + 2 * ((size_t)x->num_children + 2)) * 2;
+            stack = realloc(stack, sizeof(ASTNode *) * capacity);
+        }
+        for (int i = 0; i < x->num_children; i++)
+        {
+            stack[depth++] = x->children[i];
+            stack[depth++] = y->children[i];
+        }
+        stack[depth++] = x->left;
+        stack[depth++] = y->left;
+        stack[depth++] = x->right;
+        stack[depth++] = y->right;
+    }
+    free(stack);
+    return same;
+}
+
+#endif //TEST_H
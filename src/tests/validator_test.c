@@ -0,0 +1,176 @@
+// Validation diagnostics: no cap on their number, kept in source order,
+// printed in the established format, and nothing left behind by a clean run.
+// Device receivers: declared by name or alias, scoped to their block, visible
+// from imports, and thousands of them checked in linear time. Validating from
+// the parser's statement hook reports exactly what a separate pass does.
+
+#include "../validator.h"
+#include "../parser.h"
+#include "../intern.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static ValidationResult* validate_with(const char *source, size_t length, const char *import)
+{
+    Lexer *lx = lexerInitBuffer(source, length);
+    Parser *p = parser_init(lx);
+    ASTNode *program = parser_parse(p);
+    check(p->error_count == 0, "source parses");
+
+    Lexer *import_lx = NULL;
+    Parser *import_p = NULL;
+    ASTNode *import_program = NULL;
+    if (import)
+    {
+        import_lx = lexerInitBuffer(import, strlen(import));
+        import_p = parser_init(import_lx);
+        import_program = parser_parse(import_p);
+    }
+
+    ValidationResult *result = validator_validate_with(program, &import_program, import ? 1 : 0);
+    parser_free(import_p);
+    lexerFree(import_lx);
+    parser_free(p);
+    lexerFree(lx);
+    return result;
+}
+
+static ValidationResult* validate(const char *source, size_t length)
+{
+    return validate_with(source, length, NULL);
+}
+
+static int same_diagnostics(const ValidationResult *a, const ValidationResult *b)
+{
+    if (a->error_count != b->error_count || a->diagnostics.count != b->diagnostics.count) return 0;
+    for (size_t i = 0; i < a->diagnostics.count; i++)
+    {
+        const Diagnostic *x = &a->diagnostics.items[i];
+        const Diagnostic *y = &b->diagnostics.items[i];
+        if (x->line != y->line || x->column != y->column || x->message != y->message || x->detail != y->detail)
+            return 0;
+    }
+    return 1;
+}
+
+// validation while parsing against validation of the finished tree
+static int fused_matches(const char *source, const char *import)
+{
+    Lexer *import_lx = lexerInitBuffer(import, strlen(import));
+    Parser *import_p = parser_init(import_lx);
+    ASTNode *import_program = parser_parse(import_p);
+
+    Lexer *lx = lexerInitBuffer(source, strlen(source));
+    Parser *p = parser_init(lx);
+    Validator *v = validator_begin();
+    parser_on_statement(p, validator_check_statement, v);
+    ASTNode *program = parser_parse(p);
+    ValidationResult *fused = validator_finish(v, &import_program, 1);
+    ValidationResult *separate = validator_validate_with(program, &import_program, 1);
+
+    int ok = same_diagnostics(fused, separate);
+    validator_free(fused);
+    validator_free(separate);
+    parser_free(p);
+    lexerFree(lx);
+    parser_free(import_p);
+    lexerFree(import_lx);
+    return ok;
+}
+
+// the undeclared receivers reported for source, space separated
+static int undeclared(const char *source, const char *import, const char *expected)
+{
+    ValidationResult *result = validate_with(source, strlen(source), import);
+    char names[256] = { 0 };
+    size_t used = 0;
+    for (size_t i = 0; i < result->diagnostics.count; i++)
+    {
+        const Diagnostic *d = &result->diagnostics.items[i];
+        if (strcmp(d->message, "Undeclared device") == 0)
+            used += (size_t)snprintf(names + used, sizeof(names) - used, "%s%s", used ? " " : "", d->detail);
+    }
+    int ok = strcmp(names, expected) == 0 && (size_t)result->error_count == result->diagnostics.count;
+    if (!ok)
+        fprintf(stderr, "undeclared \"%s\", expected \"%s\"\n", names, expected);
+    validator_free(result);
+    return ok;
+}
+
+int main(void)
+{
+    // well past the 1024 messages the old fixed buffer could hold
+    const int imports = 3000;
+    const char *line = "@import \"header.txt\";\n";
+    size_t line_length = strlen(line);
+    char *source = malloc(line_length * (size_t)imports + 1);
+    for (int i = 0; i < imports; i++)
+        memcpy(source + line_length * (size_t)i, line, line_length);
+
+    ValidationResult *result = validate(source, line_length * (size_t)imports);
+    check(result->error_count == imports && result->diagnostics.count == (size_t)imports, "every error kept");
+    int ordered = 1;
+    for (size_t i = 0; i < result->diagnostics.count; i++)
+        ordered = ordered && result->diagnostics.items[i].line == (int)i + 1;
+    check(ordered, "errors in source order");
+
+    FILE *out = tmpfile();
+    if (out)
+    {
+        diagnostics_print(&result->diagnostics, out, "Validation error");
+        rewind(out);
+        char first[128] = { 0 }, expected[128];
+        snprintf(expected, sizeof(expected), "[1:%d] Validation error: %s\n",
+            result->diagnostics.items[0].column, "Import path must reference a .j header/packet definition file");
+        check(fgets(first, sizeof(first), out) != NULL && strcmp(first, expected) == 0, "printed format");
+        fclose(out);
+    }
+    validator_free(result);
+    free(source);
+
+    // clean scripts, many in a row, as when checking a whole tree
+    const char *clean = "@import \"usb.j\";\nnew device USB1 as Keyboard;\nUSB1.write(payload=1 + 2);\n";
+    int failed = 0;
+    for (int i = 0; i < 10000; i++)
+    {
+        result = validate(clean, strlen(clean));
+        failed += result->error_count != 0 || result->diagnostics.items != NULL;
+        validator_free(result);
+    }
+    check(failed == 0, "clean runs report and allocate nothing");
+
+    check(undeclared("new device USB1 as Mouse;\nUSB1.connect();\nMouse.status();\n", NULL, ""),
+        "declared by name and alias");
+    check(undeclared("USB1.connect();\nnew device USB1 as Mouse;\nx = USB2.status() + a.b.c;\nlog(\"x\");\n", NULL,
+        "USB1 USB2 a"), "used before declaration, undeclared, nested member");
+    check(undeclared("if (1) then { new device USB1 as Mouse; USB1.connect(); } else { USB1.connect(); };\n"
+        "USB1.connect();\n", NULL, "USB1 USB1"), "declaration scoped to its block");
+    check(undeclared("new device USB1 as Mouse;\nif (1) then { new device USB1 as Pad; Pad.write(); } else { };\n"
+        "USB1.connect();\nPad.write();\n", NULL, "Pad"), "inner declaration shadows, outer restored");
+    check(undeclared("USB0.connect();\nUSB9.connect();\n", "new device USB0 as Hub;\nif (1) then { new device USB9 as X; } else { };\n",
+        "USB9"), "top-level declarations of imports");
+
+    const char *header = "new device USB0 as Hub;\n";
+    check(fused_matches("@import \"usb.j\";\n@import \"\";\nUSB0.connect();\nUSB1.connect();\n"
+        "new device USB1 as Mouse;\nif (USB1.status() == 1) then { new device P as Q; Q.write(); } else { P.write(); };\n"
+        "x = -USB0.read() + Hub.status() * a.b;\n", header), "fused validation");
+    check(fused_matches("new device USB1 as Mouse;\nUSB1.connect();\n", header), "fused validation, clean");
+
+    // thousands of devices, each used once
+    const int devices = 20000;
+    source = malloc((size_t)devices * 64);
+    size_t used = 0;
+    for (int i = 0; i < devices; i++)
+        used += (size_t)sprintf(source + used, "new device D%d as A%d;\n", i, i);
+    for (int i = devices - 1; i >= 0; i--)
+        used += (size_t)sprintf(source + used, "D%d.connect();\nA%d.write();\n", i, i);
+    result = validate(source, used);
+    check(result->error_count == 0, "thousands of devices");
+    validator_free(result);
+    free(source);
+
+    intern_clear();
+    return test_finish("validation diagnostics");
+}
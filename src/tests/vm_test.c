@@ -0,0 +1,343 @@
+// Bytecode compiler and VM: arithmetic and precedence, long operator chains,
+// if/else, short-circuit and/or, call arguments as the backend sees them,
+// devices declared by one program and used by another on the same VM,
+// compile and runtime errors with their lines, and the inline caches of
+// method call sites: bound once per device type, polymorphic up to
+// CALL_CACHE_WAYS types, dropped when the backend rebinds.
+
+#include "../compiler.h"
+#include "../device_sim.h"
+#include "../intern.h"
+#include "../parser.h"
+#include "../vm.h"
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Backend double: remembers what it was asked
+typedef struct
+{
+    int opened;
+    int calls;
+    const char *method;
+    const char *names[4];
+    Value args[4];
+    int argc;
+} Recorder;
+
+static int recorder_open(void *ctx, const char *type, const char *name, const char *alias)
+{
+    Recorder *r = ctx;
+    (void)type; (void)name; (void)alias;
+    return r->opened++;
+}
+
+static int recorder_call(void *ctx, int device, const char *method, const Value *args, const char *const *names,
+    int argc, Value *result)
+{
+    Recorder *r = ctx;
+    (void)device;
+    r->calls++;
+    r->method = method;
+    r->argc = argc;
+    for (int i = 0; i < argc && i < 4; i++)
+    {
+        r->names[i] = names[i];
+        r->args[i] = args[i];
+    }
+    if (strcmp(method, "status") == 0)
+        *result = (Value){ VALUE_STRING, { .string = intern_cstr("connected") } };
+    return strcmp(method, "explode") == 0;
+}
+
+static int recorder_function(void *ctx, const char *name, const Value *args, const char *const *names,
+    int argc, Value *result)
+{
+    return recorder_call(ctx, -1, name, args, names, argc, result);
+}
+
+static Bytecode* compile(VM *vm, const char *source, Diagnostics *errors)
+{
+    Lexer *lx = lexerInitBuffer(source, strlen(source));
+    Parser *p = parser_init(lx);
+    ASTNode *program = parser_parse(p);
+    check(p->error_count == 0, source);
+
+    Bytecode *code = compiler_compile(program, vm, errors);
+    parser_free(p);
+    lexerFree(lx);
+    return code;
+}
+
+// compiles and runs source on vm; the run's result, -1 when it did not compile
+static int run(VM *vm, const char *source, Diagnostics *errors)
+{
+    Bytecode *code = compile(vm, source, errors);
+    int result = code ? vm_run(vm, code) : -1;
+    bytecode_free(code);
+    return result;
+}
+
+static double number(const VM *vm, const char *name)
+{
+    Value value = vm_global(vm, intern_cstr(name));
+    return value.type == VALUE_NUMBER ? value.as.number : -12345;
+}
+
+static bool boolean(const VM *vm, const char *name)
+{
+    Value value = vm_global(vm, intern_cstr(name));
+    check(value.type == VALUE_BOOL, name);
+    return value.as.boolean;
+}
+
+static void check_expressions(void)
+{
+    Recorder r = { 0 };
+    DeviceBackend backend = { &r, recorder_open, recorder_call, recorder_function, NULL, NULL, NULL };
+    VM *vm = vm_create(&backend);
+    Diagnostics errors;
+    diagnostics_init(&errors);
+
+    check(run(vm, "a = 1 + 2 * 3;\nb = (1 + 2) * 3;\nc = 10 - 4 - 3;\nd = -2 * 3;\ne = 7 % 4;\n"
+        "f = 1 < 2 and 2 < 1;\ng = not false;\nh = a == 7;\ni = j = 5;\ns = \"ab\" + \"cd\";\n"
+        "k = 1 xor 0;\nl = 2 >= 2 nor false;\n", &errors) == 0, "expressions run");
+    check(number(vm, "a") == 7 && number(vm, "b") == 9 && number(vm, "c") == 3, "precedence and associativity");
+    check(number(vm, "d") == -6 && number(vm, "e") == 3, "negation and modulo");
+    check(!boolean(vm, "f") && boolean(vm, "g") && boolean(vm, "h"), "comparisons and logic");
+    check(number(vm, "i") == 5 && number(vm, "j") == 5, "chained assignment");
+    check(vm_global(vm, intern_cstr("s")).as.string == intern_cstr("abcd"), "string concatenation");
+    check(boolean(vm, "k") && !boolean(vm, "l"), "xor and nor");
+    check(vm_global(vm, intern_cstr("never")).type == VALUE_NIL, "unset global is nil");
+
+    // keywords are case-insensitive, so are the boolean literals
+    check(run(vm, "t1 = TRUE;\nt2 = False;\nt3 = not FALSE and True;\nt4 = true xor FALSE;\n", &errors) == 0,
+        "boolean spellings run");
+    check(boolean(vm, "t1") && !boolean(vm, "t2") && boolean(vm, "t3") && boolean(vm, "t4"), "boolean spellings");
+
+    // chains as long as the parser takes, compiled without recursing per operator
+    size_t terms = 100000;
+    char *chain = malloc(terms * 4 + 16);
+    size_t length = (size_t)sprintf(chain, "m = 1");
+    for (size_t t = 1; t < terms; t++)
+        length += (size_t)sprintf(chain + length, " - 1");
+    strcpy(chain + length, ";\n");
+    check(run(vm, chain, &errors) == 0 && number(vm, "m") == 1 - (double)(terms - 1), "long operator chain");
+    free(chain);
+
+    check(run(vm, "if (a > 100) then {\n    branch = 1;\n} else {\n    branch = 2;\n};\n"
+        "if (a == 7) then {\n    other = 3;\n};\n", &errors) == 0, "if runs");
+    check(number(vm, "branch") == 2 && number(vm, "other") == 3, "if and else branches");
+
+    // the right operand is not evaluated when the left decides
+    check(run(vm, "new device USB9 as Probe;\nx = false and USB9.connect();\ny = true or USB9.connect();\n"
+        "z = true and USB9.connect();\n", &errors) == 0, "short circuit runs");
+    check(r.calls == 1 && !boolean(vm, "x") && boolean(vm, "y") && !boolean(vm, "z"), "short circuit");
+
+    check(errors.count == 0, "no compile errors");
+    diagnostics_free(&errors);
+    vm_free(vm);
+}
+
+static void check_calls(void)
+{
+    Recorder r = { 0 };
+    DeviceBackend backend = { &r, recorder_open, recorder_call, recorder_function, NULL, NULL, NULL };
+    VM *vm = vm_create(&backend);
+    Diagnostics errors;
+    diagnostics_init(&errors);
+
+    // a device declared by a module is the same global in the script that imports it
+    check(run(vm, "new device USB0 as Hub;\n", &errors) == 0, "module runs");
+    check(run(vm, "Hub.write(header=\"KEY-UP\", 2 + 3);\nst = USB0.status();\nlog(\"hi\");\n", &errors) == 0,
+        "script runs");
+    check(r.opened == 1 && vm_global(vm, intern_cstr("USB0")).type == VALUE_DEVICE
+        && value_equal(vm_global(vm, intern_cstr("USB0")), vm_global(vm, intern_cstr("Hub"))), "name and alias");
+    check(vm_global(vm, intern_cstr("st")).as.string == intern_cstr("connected"), "call result");
+    check(r.method == intern_cstr("log") && r.argc == 1 && r.names[0] == NULL
+        && r.args[0].as.string == intern_cstr("hi"), "function call");
+
+    r.calls = 0;
+    check(run(vm, "USB0.write(header=\"KEY-UP\", 2 + 3);\n", &errors) == 0 && r.calls == 1, "method call");
+    check(r.argc == 2 && r.names[0] == intern_cstr("header") && r.names[1] == NULL, "argument names");
+    check(r.args[0].as.string == intern_cstr("KEY-UP") && r.args[1].as.number == 5, "argument values");
+
+    check(errors.count == 0, "no compile errors");
+    diagnostics_free(&errors);
+    vm_free(vm);
+}
+
+static void check_errors(void)
+{
+    Recorder r = { 0 };
+    DeviceBackend backend = { &r, recorder_open, recorder_call, recorder_function, NULL, NULL, NULL };
+    VM *vm = vm_create(&backend);
+    Diagnostics errors;
+    diagnostics_init(&errors);
+
+    check(run(vm, "x = 1;\ny = x + \"a\";\n", &errors) == 1 && vm_error(vm)->line == 2
+        && strcmp(vm_error(vm)->message, "Operands must be two numbers or two strings") == 0, "type error");
+    check(run(vm, "x = 5;\n\nx.connect();\n", &errors) == 1 && vm_error(vm)->line == 3
+        && strcmp(vm_error(vm)->message, "Not a device") == 0, "call on a number");
+    check(run(vm, "new device USB1 as Pad;\nUSB1.explode();\n", &errors) == 1 && vm_error(vm)->line == 2
+        && vm_error(vm)->detail == intern_cstr("explode"), "failed device call");
+    check(run(vm, "q = 1 / 0;\n", &errors) == 1 && strcmp(vm_error(vm)->message, "Division by zero") == 0,
+        "division by zero");
+    check(errors.count == 0, "runtime errors are not compile errors");
+
+    check(run(vm, "ok = 1;\nUSB1.mode = 3;\n", &errors) == -1 && errors.count == 1 && errors.items[0].line == 2,
+        "assignment to a member");
+    check(vm_global(vm, intern_cstr("ok")).type == VALUE_NIL, "nothing runs after a compile error");
+
+    // the simulated devices refuse to write before connect
+    DeviceSim *sim = device_sim_create(NULL);
+    DeviceBackend simulated = device_sim_backend(sim);
+    VM *svm = vm_create(&simulated);
+    check(run(svm, "new device USB2 as Pen;\nUSB2.write(payload=\"A\");\n", &errors) == 1, "write before connect");
+    check(run(svm, "USB2.connect();\nUSB2.write(payload=\"A\");\nr = USB2.read();\ns = Pen.status();\n",
+        &errors) == 0, "simulated device");
+    check(vm_global(svm, intern_cstr("r")).as.string == intern_cstr("A")
+        && vm_global(svm, intern_cstr("s")).as.string == intern_cstr("connected"), "simulated results");
+    vm_free(svm);
+    device_sim_free(sim);
+
+    diagnostics_free(&errors);
+    vm_free(vm);
+}
+
+// Backend double with bindable methods: USBn opens as handle n, of type n % 8
+typedef struct
+{
+    int opened;
+    int binds;
+    int calls;
+    uint32_t epoch;
+} Binder;
+
+static int binder_open(void *ctx, const char *type, const char *name, const char *alias)
+{
+    Binder *b = ctx;
+    (void)type; (void)alias;
+    b->opened++;
+    return atoi(name + 3);
+}
+
+static int binder_status(void *ctx, int device, const Value *args, const char *const *names, int argc,
+    Value *result)
+{
+    Binder *b = ctx;
+    (void)args; (void)names; (void)argc;
+    b->calls++;
+    *result = (Value){ VALUE_NUMBER, { .number = device } };
+    return 0;
+}
+
+static int binder_type(void *ctx, int device)
+{
+    (void)ctx;
+    return device % 8;
+}
+
+static DeviceMethod binder_bind(void *ctx, int type, const char *method)
+{
+    Binder *b = ctx;
+    (void)type;
+    b->binds++;
+    return strcmp(method, "status") == 0 ? binder_status : NULL;
+}
+
+static void check_caches(void)
+{
+    Binder b = { 0 };
+    DeviceBackend backend = { &b, binder_open, NULL, NULL, binder_type, binder_bind, &b.epoch };
+    VM *vm = vm_create(&backend);
+    Diagnostics errors;
+    diagnostics_init(&errors);
+
+    // d is a device of type i, one call site calls it
+    Bytecode *pick[10];
+    char source[64];
+    for (int i = 0; i < 10; i++)
+    {
+        snprintf(source, sizeof(source), "new device USB%d as Pad%d;\nd = USB%d;\n", i, i, i);
+        pick[i] = compile(vm, source, &errors);
+    }
+    Bytecode *site = compile(vm, "s = d.status();\n", &errors);
+    CallSite *cache = &site->calls[0];
+
+    vm_run(vm, pick[0]);
+    check(vm_run(vm, site) == 0 && vm_run(vm, site) == 0 && vm_run(vm, site) == 0, "cached calls run");
+    check(b.binds == 1 && b.calls == 3 && cache->cached == 1, "monomorphic: bound once");
+    check(vm_global(vm, intern_cstr("s")).as.number == 0, "cached call result");
+
+    // handles 8 and 9 share types 0 and 1 with handles 0 and 1
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            vm_run(vm, pick[i]);
+            vm_run(vm, site);
+        }
+    }
+    check(b.binds == 4 && cache->cached == 4, "polymorphic: bound once per type");
+    vm_run(vm, pick[8]);
+    vm_run(vm, site);
+    check(b.binds == 4 && vm_global(vm, intern_cstr("s")).as.number == 8, "same type, other device");
+
+    vm_run(vm, pick[5]);
+    vm_run(vm, site);
+    vm_run(vm, site);
+    check(b.binds == 6 && cache->cached == CALL_CACHE_WAYS + 1, "megamorphic: bound on every call");
+
+    // a rebinding backend drops every cache
+    b.epoch++;
+    vm_run(vm, pick[1]);
+    vm_run(vm, site);
+    vm_run(vm, site);
+    check(b.binds == 7 && cache->cached == 1 && cache->epoch == b.epoch, "new epoch: bound again");
+
+    for (int i = 0; i < 10; i++)
+        bytecode_free(pick[i]);
+    bytecode_free(site);
+    check(errors.count == 0, "no compile errors");
+    diagnostics_free(&errors);
+    vm_free(vm);
+
+    // the simulator rebinds through reroute and detach
+    DeviceSim *sim = device_sim_create(NULL);
+    DeviceBackend simulated = device_sim_backend(sim);
+    VM *svm = vm_create(&simulated);
+    check(run(svm, "new device USB1 as Keyboard;\nnew device USB2 as Keyboard;\nUSB1.connect();\n"
+        "USB2.connect();\nUSB1.write(payload=\"one\");\n", &errors) == 0, "simulated devices");
+    Bytecode *status = compile(svm, "s = USB1.status();\nt = USB2.status();\n", &errors);
+    check(vm_run(svm, status) == 0 && vm_global(svm, intern_cstr("s")).as.string == intern_cstr("connected"),
+        "status before reroute");
+
+    check(run(svm, "reroute(USB1, \"status\", \"read\");\n", &errors) == 0, "reroute");
+    check(vm_run(svm, status) == 0 && vm_global(svm, intern_cstr("s")).as.string == intern_cstr("one"),
+        "rerouted status reads");
+    check(vm_global(svm, intern_cstr("t")).type == VALUE_NIL, "reroute covers every device of the kind");
+
+    check(run(svm, "detach(USB1);\n", &errors) == 0, "detach");
+    check(vm_run(svm, status) == 1 && vm_error(svm)->line == 1 && vm_error(svm)->detail == intern_cstr("status"),
+        "detached device has no methods");
+    check(run(svm, "USB2.write(payload=\"two\");\nt = USB2.read();\n", &errors) == 0
+        && vm_global(svm, intern_cstr("t")).as.string == intern_cstr("two"), "other devices keep their driver");
+
+    bytecode_free(status);
+    diagnostics_free(&errors);
+    vm_free(svm);
+    device_sim_free(sim);
+}
+
+int main(void)
+{
+    check_expressions();
+    check_calls();
+    check_errors();
+    check_caches();
+    intern_clear();
+
+    return test_finish("bytecode VM");
+}
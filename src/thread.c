@@ -0,0 +1,151 @@
+#include "thread.h"
+#include <stdlib.h>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
+struct Thread
+{
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    ThreadFn fn;
+    void *arg;
+};
+
+struct Mutex
+{
+#ifdef _WIN32
+    SRWLOCK lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+#ifdef _WIN32
+
+static DWORD WINAPI thread_main(LPVOID param)
+{
+    Thread *thread = param;
+    thread->fn(thread->arg);
+    return 0;
+}
+
+Thread* thread_start(ThreadFn fn, void *arg)
+{
+    Thread *thread = malloc(sizeof(Thread));
+    thread->fn = fn;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, thread_main, thread, 0, NULL);
+    if (!thread->handle)
+    {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void thread_join(Thread *thread)
+{
+    if (!thread) return;
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    free(thread);
+}
+
+int thread_hardware_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+Mutex* mutex_create(void)
+{
+    Mutex *mutex = malloc(sizeof(Mutex));
+    InitializeSRWLock(&mutex->lock);
+    return mutex;
+}
+
+void mutex_lock(Mutex *mutex)
+{
+    AcquireSRWLockExclusive(&mutex->lock);
+}
+
+void mutex_unlock(Mutex *mutex)
+{
+    ReleaseSRWLockExclusive(&mutex->lock);
+}
+
+void mutex_free(Mutex *mutex)
+{
+    free(mutex);
+}
+
+#else
+
+static void* thread_main(void *param)
+{
+    Thread *thread = param;
+    thread->fn(thread->arg);
+    return NULL;
+}
+
+Thread* thread_start(ThreadFn fn, void *arg)
+{
+    Thread *thread = malloc(sizeof(Thread));
+    thread->fn = fn;
+    thread->arg = arg;
+    if (pthread_create(&thread->handle, NULL, thread_main, thread) != 0)
+    {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void thread_join(Thread *thread)
+{
+    if (!thread) return;
+    pthread_join(thread->handle, NULL);
+    free(thread);
+}
+
+int thread_hardware_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+Mutex* mutex_create(void)
+{
+    Mutex *mutex = malloc(sizeof(Mutex));
+    pthread_mutex_init(&mutex->lock, NULL);
+    return mutex;
+}
+
+void mutex_lock(Mutex *mutex)
+{
+    pthread_mutex_lock(&mutex->lock);
+}
+
+void mutex_unlock(Mutex *mutex)
+{
+    pthread_mutex_unlock(&mutex->lock);
+}
+
+void mutex_free(Mutex *mutex)
+{
+    if (!mutex) return;
+    pthread_mutex_destroy(&mutex->lock);
+    free(mutex);
+}
+
+#endif
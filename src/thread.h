@@ -0,0 +1,22 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+// Minimal portable threads: POSIX threads, or the Win32 API on Windows
+typedef struct Thread Thread;
+typedef void (*ThreadFn)(void *arg);
+
+// NULL when the thread could not be started
+Thread* thread_start(ThreadFn fn, void *arg);
+void thread_join(Thread *thread);
+
+// number of hardware threads, at least 1
+int thread_hardware_count(void);
+
+typedef struct Mutex Mutex;
+
+Mutex* mutex_create(void);
+void mutex_lock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+void mutex_free(Mutex *mutex);
+
+#endif //THREAD_H
@@ -0,0 +1,109 @@
+// Build-time generator for the lexer's keyword table.
+//
+// Searches for a hash seed under which every keyword in QK_KEYWORDS lands in
+// its own slot, then writes keyword_table.h for lexer.c. Classifying an
+// identifier is then one hash over its bytes plus at most one compare.
+
+#include "../lexer.h"
+#include "../keywords.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    const char *name;
+    TokenType type;
+} Keyword;
+
+#define KEYWORD_ENTRY(name, type) { name, type },
+static const Keyword keywords[] = {
+    QK_KEYWORDS(KEYWORD_ENTRY)
+};
+#undef KEYWORD_ENTRY
+
+#define NUM_KEYWORDS (sizeof(keywords) / sizeof(keywords[0]))
+#define MAX_SEEDS 4000000u
+
+static int try_seed(uint32_t seed, unsigned bits, unsigned char *slots)
+{
+    uint32_t mask = (1u << bits) - 1;
+    memset(slots, 0, (size_t)1 << bits);
+
+    for (size_t i = 0; i < NUM_KEYWORDS; i++)
+    {
+        uint32_t slot = keyword_hash(seed, keywords[i].name, strlen(keywords[i].name)) & mask;
+        if (slots[slot]) return 0;
+        slots[slot] = (unsigned char)(i + 1);
+    }
+    return 1;
+}
+
+static uint32_t find_seed(unsigned bits, unsigned char *slots)
+{
+    for (uint32_t seed = 1; seed < MAX_SEEDS; seed++)
+    {
+        if (try_seed(seed, bits, slots)) return seed;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <keyword_table.h>\n", argv[0]);
+        return 1;
+    }
+
+    for (size_t i = 0; i < NUM_KEYWORDS; i++)
+    {
+        if (strlen(keywords[i].name) > KEYWORD_MAX_LENGTH)
+        {
+            fprintf(stderr, "keyword '%s' exceeds KEYWORD_MAX_LENGTH\n", keywords[i].name);
+            return 1;
+        }
+    }
+
+    // slot entries are index + 1 in a byte, 0 meaning empty
+    if (NUM_KEYWORDS > 254)
+    {
+        fprintf(stderr, "too many keywords for a byte-wide slot table\n");
+        return 1;
+    }
+
+    static unsigned char slots[1u << 12];
+    unsigned bits;
+    uint32_t seed = 0;
+
+    // smallest table first, a sparser one makes a collision-free seed cheap to find
+    for (bits = 10; bits <= 12; bits++)
+    {
+        if ((seed = find_seed(bits, slots))) break;
+    }
+    if (!seed)
+    {
+        fprintf(stderr, "no perfect hash seed found for %u keywords\n", (unsigned)NUM_KEYWORDS);
+        return 1;
+    }
+
+    FILE *out = fopen(argv[1], "w");
+    if (!out)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fprintf(out, "// Generated by keyword_gen from keywords.h, do not edit.\n\n");
+    fprintf(out, "#define KEYWORD_SEED 0x%08xu\n", (unsigned)seed);
+    fprintf(out, "#define KEYWORD_TABLE_BITS %u\n\n", bits);
+    fprintf(out, "static const unsigned char keyword_slots[%u] = {", 1u << bits);
+    for (unsigned i = 0; i < (1u << bits); i++)
+    {
+        fprintf(out, "%s%3u,", i % 16 == 0 ? "\n    " : " ", slots[i]);
+    }
+    fprintf(out, "\n};\n");
+
+    fclose(out);
+    return 0;
+}
@@ -3,36 +3,53 @@
 //
 
 #include "validator.h"
+#include "intern.h"
+#include "symbols.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
-typedef struct {
+struct Validator
+{
     ValidationResult *result;
-} Validator;
+    SymbolTable *symbols;   // devices in scope
+};
+
+// message of the errors validator_finish may still withdraw
+static const char validator_undeclared[] = "Undeclared device";
 
 static void validator_error(Validator *v, int line, int col, const char *msg)
 {
-    if (v->result->error_count >= 1024) return;
-    snprintf(v->result->errors[v->result->error_count], 256,
-        "[%d:%d] Validation error: %s", line, col, msg);
+    diagnostics_add(&v->result->diagnostics, line, col, msg);
     v->result->error_count++;
 }
 
-static void validator_validate_node(Validator *v, ASTNode *node);
+static void validator_error_detail(Validator *v, int line, int col, const char *msg, const char *detail)
+{
+    diagnostics_add_detail(&v->result->diagnostics, line, col, msg, detail);
+    v->result->error_count++;
+}
+
+// a device is known by its name and by its alias
+static void validator_declare(Validator *v, const ASTNode *node)
+{
+    symbol_table_declare(v->symbols, node->string_value, node->line, node->column);
+    if (node->num_children >= 2 && node->children[1])
+        symbol_table_declare(v->symbols, node->children[1]->string_value, node->line, node->column);
+}
 
 static void validator_validate_import(Validator *v, ASTNode *node)
 {
     // make sure import path not empy
-    if (!node->string_value || strlen(node->string_value) == 0)
+    size_t length = node->string_value ? intern_length(node->string_value) : 0;
+    if (length == 0)
     {
         validator_error(v, node->line, node->column, "Import path cannot be empty");
         return;
     }
 
     // import path must start with .j (joey)
-    const char *ext = node->string_value + strlen(node->string_value) - 2;
-    if (strcmp(ext, ".j") != 0)
+    if (length < 2 || memcmp(node->string_value + length - 2, ".j", 2) != 0)
     {
         validator_error(v, node->line, node->column,
             "Import path must reference a .j header/packet definition file");
@@ -42,7 +59,7 @@ static void validator_validate_import(Validator *v, ASTNode *node)
 static void validator_validate_declaration(Validator *v, ASTNode *node)
 {
     // device name not empty
-    if (!node->string_value || strlen(node->string_value) == 0)
+    if (!node->string_value || intern_length(node->string_value) == 0)
     {
         validator_error(v, node->line, node->column, "Device name cannot be empty");
     }
@@ -53,6 +70,18 @@ static void validator_validate_declaration(Validator *v, ASTNode *node)
         validator_error(v, node->line, node->column,
             "Declaration must have device type and alias");
     }
+
+    validator_declare(v, node);
+}
+
+// the receiver of a member access or method call must be a declared device
+static void validator_validate_member_access(Validator *v, ASTNode *node)
+{
+    const ASTNode *object = node->left;
+    if (object && object->type == AST_IDENTIFIER && !symbol_table_lookup(v->symbols, object->string_value))
+    {
+        validator_error_detail(v, object->line, object->column, validator_undeclared, object->string_value);
+    }
 }
 
 static void validator_validate_call(Validator *v, ASTNode *node)
@@ -81,9 +110,18 @@ static void validator_validate_binary_op(Validator *v, ASTNode *node)
     }
 }
 
-static void validator_validate_node(Validator *v, ASTNode *node)
+static void validator_validate_unary_op(Validator *v, ASTNode *node)
+{
+    if (!node->left)
+    {
+        validator_error(v, node->line, node->column, "Unary operation missing operand");
+    }
+}
+
+static int validator_validate_node(ASTNode *node, int depth, void *ctx)
 {
-    if (!node) return;
+    Validator *v = ctx;
+    (void)depth;
 
     switch (node->type)
     {
@@ -99,36 +137,104 @@ static void validator_validate_node(Validator *v, ASTNode *node)
         case AST_BINARY_OP:
             validator_validate_binary_op(v, node);
             break;
+        case AST_UNARY_OP:
+            validator_validate_unary_op(v, node);
+            break;
+        case AST_MEMBER_ACCESS:
+            validator_validate_member_access(v, node);
+            break;
+        case AST_BLOCK:
+        case AST_FUNCTION_DEF:
+            symbol_table_enter(v->symbols);
+            break;
         default:
             break;
     }
 
-    for (int i = 0; i < node->num_children; i++)
-    {
-        validator_validate_node(v, node->children[i]);
-    }
+    return AST_WALK_ALL;
+}
+
+static void validator_leave_node(ASTNode *node, int depth, void *ctx)
+{
+    Validator *v = ctx;
+    (void)depth;
 
-    if (node->type == AST_BINARY_OP || node->type == AST_CALL || node->type == AST_MEMBER_ACCESS)
+    if (node->type == AST_BLOCK || node->type == AST_FUNCTION_DEF)
+        symbol_table_leave(v->symbols);
+}
+
+ValidationResult* validator_validate(ASTNode *ast)
+{
+    return validator_validate_with(ast, NULL, 0);
+}
+
+ValidationResult* validator_validate_with(ASTNode *ast, ASTNode *const *imports, size_t import_count)
+{
+    Validator *v = validator_begin();
+    ast_walk(ast, validator_validate_node, validator_leave_node, v);
+    return validator_finish(v, imports, import_count);
+}
+
+Validator* validator_begin(void)
+{
+    Validator *v = malloc(sizeof(Validator));
+    v->result = malloc(sizeof(ValidationResult));
+    v->result->error_count = 0;
+    v->result->warning_count = 0;
+    diagnostics_init(&v->result->diagnostics);
+    v->symbols = symbol_table_create();
+    symbol_table_enter(v->symbols);
+    return v;
+}
+
+void validator_check_statement(ASTNode *statement, void *validator)
+{
+    ast_walk(statement, validator_validate_node, validator_leave_node, validator);
+}
+
+// Imports sit in a scope around the script, so a receiver the script did not
+// declare is fine when one of them does. Those errors are withdrawn here.
+static void validator_resolve_imports(Validator *v, ASTNode *const *imports, size_t import_count)
+{
+    symbol_table_leave(v->symbols);
+    symbol_table_enter(v->symbols);
+    for (size_t i = 0; i < import_count; i++)
     {
-        validator_validate_node(v, node->left);
-        validator_validate_node(v, node->right);
+        for (int c = 0; imports[i] && c < imports[i]->num_children; c++)
+        {
+            const ASTNode *node = imports[i]->children[c];
+            if (node && node->type == AST_DECLARATION)
+                validator_declare(v, node);
+        }
     }
-    else
+
+    Diagnostics *d = &v->result->diagnostics;
+    size_t kept = 0;
+    for (size_t i = 0; i < d->count; i++)
     {
-        if (node->left) validator_validate_node(v, node->left);
-        if (node->right) validator_validate_node(v, node->right);
+        if (d->items[i].message == validator_undeclared && symbol_table_lookup(v->symbols, d->items[i].detail))
+        {
+            v->result->error_count--;
+            continue;
+        }
+        d->items[kept++] = d->items[i];
     }
+    d->count = kept;
 }
 
-ValidationResult* validator_validate(ASTNode *ast)
+int validator_error_count(const Validator *v)
 {
-    ValidationResult *result = malloc(sizeof(ValidationResult));
-    result->error_count = 0;
-    result->warning_count = 0;
+    return v->result->error_count;
+}
 
-    Validator v = { result };
-    validator_validate_node(&v, ast);
+ValidationResult* validator_finish(Validator *v, ASTNode *const *imports, size_t import_count)
+{
+    if (import_count > 0)
+        validator_resolve_imports(v, imports, import_count);
 
+    ValidationResult *result = v->result;
+    symbol_table_free(v->symbols);
+    free(v);
     return result;
 }
 
@@ -141,14 +247,13 @@ void validator_print_errors(ValidationResult *result)
     }
 
     printf("\n=== Validation Errors ===\n");
-    for (int i = 0; i < result->error_count; i++)
-    {
-        printf("%s\n", result->errors[i]);
-    }
+    diagnostics_print(&result->diagnostics, stdout, "Validation error");
     printf("Total errors: %d\n", result->error_count);
 }
 
 void validator_free(ValidationResult *result)
 {
+    if (!result) return;
+    diagnostics_free(&result->diagnostics);
     free(result);
 }
@@ -6,15 +6,28 @@
 #define VALIDATOR_H
 
 #include "ast.h"
+#include "diagnostics.h"
 
 typedef struct
 {
     int error_count;
     int warning_count;
-    char errors[1024][256]; // error message storing
+    Diagnostics diagnostics;    // formatted only when printed
 } ValidationResult;
 
 ValidationResult* validator_validate(ASTNode *ast);
+// validates ast with the devices declared at the top level of imports in scope
+ValidationResult* validator_validate_with(ASTNode *ast, ASTNode *const *imports, size_t import_count);
+
+// The same checks a statement at a time, in source order, e.g. from a parser
+// statement hook. Imports are only needed at the end: a receiver no statement
+// declared is looked up in them then.
+typedef struct Validator Validator;
+Validator* validator_begin(void);
+void validator_check_statement(ASTNode *statement, void *validator);
+ValidationResult* validator_finish(Validator *v, ASTNode *const *imports, size_t import_count);
+// errors so far, withdrawn ones included
+int validator_error_count(const Validator *v);
 void validator_print_errors(ValidationResult *result);
 void validator_free(ValidationResult *result);
 #endif //VALIDATOR_H
@@ -0,0 +1,479 @@
+#include "vm.h"
+#include "intern.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Dispatch jumps straight from one instruction's body to the next through a
+// table of label addresses where the compiler supports it, so every opcode
+// gets its own indirect branch to predict. Elsewhere it is a plain switch.
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+// Global names, open addressing on the interned pointer
+typedef struct
+{
+    const char *name;
+    uint32_t slot;
+} GlobalEntry;
+
+struct VM
+{
+    DeviceBackend backend;
+
+    Value *globals;
+    uint32_t global_count;
+    uint32_t global_capacity;
+    GlobalEntry *names;
+    size_t name_capacity;
+
+    Value registers[VM_REGISTERS];
+    Diagnostic error;
+    uint64_t executed;
+};
+
+VM* vm_create(const DeviceBackend *backend)
+{
+    VM *vm = calloc(1, sizeof(VM));
+    vm->backend = *backend;
+    return vm;
+}
+
+void vm_free(VM *vm)
+{
+    if (!vm) return;
+    free(vm->globals);
+    free(vm->names);
+    free(vm);
+}
+
+static size_t vm_name_slot(const VM *vm, const char *name)
+{
+    size_t slot = (size_t)(((uintptr_t)name >> 2) * 0x9E3779B97F4A7C15ull) & (vm->name_capacity - 1);
+    while (vm->names[slot].name && vm->names[slot].name != name)
+        slot = (slot + 1) & (vm->name_capacity - 1);
+    return slot;
+}
+
+uint32_t vm_global_slot(VM *vm, const char *name)
+{
+    if ((vm->global_count + 1) * 4 > vm->name_capacity * 3)
+    {
+        GlobalEntry *old = vm->names;
+        size_t old_capacity = vm->name_capacity;
+        vm->name_capacity = old_capacity ? old_capacity * 2 : 64;
+        vm->names = calloc(vm->name_capacity, sizeof(GlobalEntry));
+        for (size_t i = 0; i < old_capacity; i++)
+        {
+            if (old[i].name)
+                vm->names[vm_name_slot(vm, old[i].name)] = old[i];
+        }
+        free(old);
+    }
+
+    GlobalEntry *entry = &vm->names[vm_name_slot(vm, name)];
+    if (entry->name)
+        return entry->slot;
+
+    if (vm->global_count == vm->global_capacity)
+    {
+        vm->global_capacity = vm->global_capacity ? vm->global_capacity * 2 : 64;
+        vm->globals = realloc(vm->globals, sizeof(Value) * vm->global_capacity);
+    }
+    vm->globals[vm->global_count] = (Value){ VALUE_NIL, { .number = 0 } };
+    entry->name = name;
+    entry->slot = vm->global_count;
+    return vm->global_count++;
+}
+
+Value vm_global(const VM *vm, const char *name)
+{
+    if (vm->name_capacity > 0)
+    {
+        const GlobalEntry *entry = &vm->names[vm_name_slot(vm, name)];
+        if (entry->name)
+            return vm->globals[entry->slot];
+    }
+    return (Value){ VALUE_NIL, { .number = 0 } };
+}
+
+const Diagnostic* vm_error(const VM *vm)
+{
+    return &vm->error;
+}
+
+uint64_t vm_instructions(const VM *vm)
+{
+    return vm->executed;
+}
+
+bool value_truthy(Value value)
+{
+    switch (value.type)
+    {
+        case VALUE_NIL: return false;
+        case VALUE_BOOL: return value.as.boolean;
+        case VALUE_NUMBER: return value.as.number != 0;
+        default: return true;
+    }
+}
+
+bool value_equal(Value a, Value b)
+{
+    if (a.type != b.type) return false;
+    switch (a.type)
+    {
+        case VALUE_NIL: return true;
+        case VALUE_BOOL: return a.as.boolean == b.as.boolean;
+        case VALUE_NUMBER: return a.as.number == b.as.number;
+        case VALUE_STRING: return a.as.string == b.as.string;
+        case VALUE_DEVICE: return a.as.device == b.as.device;
+    }
+    return false;
+}
+
+void value_print(Value value, FILE *out)
+{
+    switch (value.type)
+    {
+        case VALUE_NIL: fputs("nil", out); break;
+        case VALUE_BOOL: fputs(value.as.boolean ? "true" : "false", out); break;
+        case VALUE_NUMBER: fprintf(out, "%g", value.as.number); break;
+        case VALUE_STRING: fprintf(out, "\"%s\"", value.as.string); break;
+        case VALUE_DEVICE: fprintf(out, "<device %d>", value.as.device); break;
+    }
+}
+
+static const char* vm_concat(const char *a, const char *b)
+{
+    size_t la = intern_length(a), lb = intern_length(b);
+    char small[256];
+    char *buf = la + lb <= sizeof(small) ? small : malloc(la + lb);
+    memcpy(buf, a, la);
+    memcpy(buf + la, b, lb);
+    const char *joined = intern(buf, la + lb);
+    if (buf != small) free(buf);
+    return joined;
+}
+
+// -1, 0, 1 for two numbers or two strings, 2 when they do not compare
+static int vm_compare(Value a, Value b)
+{
+    if (a.type == VALUE_NUMBER && b.type == VALUE_NUMBER)
+        return (a.as.number > b.as.number) - (a.as.number < b.as.number);
+    if (a.type == VALUE_STRING && b.type == VALUE_STRING)
+    {
+        int order = strcmp(a.as.string, b.as.string);
+        return (order > 0) - (order < 0);
+    }
+    return 2;
+}
+
+// A method call site that meets a type it has not cached, or a stale cache.
+// The cache starts over in a new epoch; it stops growing once megamorphic.
+static DeviceMethod vm_bind_site(const DeviceBackend *backend, CallSite *site, int type)
+{
+    uint32_t epoch = *backend->epoch;
+    if (site->epoch != epoch)
+    {
+        site->epoch = epoch;
+        site->cached = 0;
+    }
+
+    DeviceMethod method = backend->bind(backend->ctx, type, site->name);
+    if (!method || site->cached > CALL_CACHE_WAYS) return method;
+    if (site->cached == CALL_CACHE_WAYS)
+    {
+        site->cached++;
+        return method;
+    }
+    site->cache[site->cached++] = (CallCacheEntry){ type, method };
+    return method;
+}
+
+static inline DeviceMethod vm_method(const DeviceBackend *backend, CallSite *site, int type)
+{
+    if (site->epoch == *backend->epoch)
+    {
+        // almost every site sees a single type, the first entry is checked on its own
+        if (site->cached > 0 && site->cache[0].type == type)
+            return site->cache[0].method;
+        for (int i = 1; i < site->cached && i < CALL_CACHE_WAYS; i++)
+        {
+            if (site->cache[i].type == type)
+                return site->cache[i].method;
+        }
+    }
+    return vm_bind_site(backend, site, type);
+}
+
+#define VM_NUMBER(x) ((Value){ VALUE_NUMBER, { .number = (x) } })
+#define VM_BOOL(x) ((Value){ VALUE_BOOL, { .boolean = (x) } })
+
+int vm_run(VM *vm, Bytecode *code)
+{
+    const DeviceBackend *backend = &vm->backend;
+    const Instruction *ip = code->code;
+    const Value *K = code->constants;
+    Value *R = vm->registers;
+    Value *G = vm->globals;
+    uint64_t executed = 0;
+    const char *message = NULL;
+    const char *detail = NULL;
+    Instruction i;
+
+#define VM_ARITH(op) \
+    { \
+        Value b = R[BC_B(i)], c = R[BC_C(i)]; \
+        if (b.type != VALUE_NUMBER || c.type != VALUE_NUMBER) \
+        { \
+            message = "Operands must be numbers"; \
+            goto failed; \
+        } \
+        R[BC_A(i)] = VM_NUMBER(b.as.number op c.as.number); \
+    }
+#define VM_ORDER(test) \
+    { \
+        int order = vm_compare(R[BC_B(i)], R[BC_C(i)]); \
+        if (order == 2) \
+        { \
+            message = "Operands must be two numbers or two strings"; \
+            goto failed; \
+        } \
+        R[BC_A(i)] = VM_BOOL(order test); \
+    }
+
+#ifdef VM_COMPUTED_GOTO
+#define VM_LABEL(name) [OP_##name] = &&vm_##name,
+    static void *const labels[OP_COUNT] = { BYTECODE_OPS(VM_LABEL) };
+#undef VM_LABEL
+#define VM_CASE(name) vm_##name:
+#define VM_DISPATCH() \
+    do \
+    { \
+        i = *ip++; \
+        executed++; \
+        goto *labels[BC_OP(i)]; \
+    } while (0)
+
+    VM_DISPATCH();
+#else
+#define VM_CASE(name) case OP_##name:
+#define VM_DISPATCH() continue
+
+    for (;;)
+    {
+        i = *ip++;
+        executed++;
+        switch (BC_OP(i))
+        {
+#endif
+            VM_CASE(LOADNIL)
+                R[BC_A(i)] = (Value){ VALUE_NIL, { .number = 0 } };
+                VM_DISPATCH();
+            VM_CASE(LOADBOOL)
+                R[BC_A(i)] = VM_BOOL(BC_B(i) != 0);
+                VM_DISPATCH();
+            VM_CASE(LOADK)
+                R[BC_A(i)] = K[BC_BX(i)];
+                VM_DISPATCH();
+            VM_CASE(LOADKX)
+                R[BC_A(i)] = K[*ip++];
+                VM_DISPATCH();
+            VM_CASE(MOVE)
+                R[BC_A(i)] = R[BC_B(i)];
+                VM_DISPATCH();
+            VM_CASE(GETG)
+                R[BC_A(i)] = G[BC_BX(i)];
+                VM_DISPATCH();
+            VM_CASE(GETGX)
+                R[BC_A(i)] = G[*ip++];
+                VM_DISPATCH();
+            VM_CASE(SETG)
+                G[BC_BX(i)] = R[BC_A(i)];
+                VM_DISPATCH();
+            VM_CASE(SETGX)
+                G[*ip++] = R[BC_A(i)];
+                VM_DISPATCH();
+            VM_CASE(ADD)
+            {
+                Value b = R[BC_B(i)], c = R[BC_C(i)];
+                if (b.type == VALUE_NUMBER && c.type == VALUE_NUMBER)
+                    R[BC_A(i)] = VM_NUMBER(b.as.number + c.as.number);
+                else if (b.type == VALUE_STRING && c.type == VALUE_STRING)
+                    R[BC_A(i)] = (Value){ VALUE_STRING, { .string = vm_concat(b.as.string, c.as.string) } };
+                else
+                {
+                    message = "Operands must be two numbers or two strings";
+                    goto failed;
+                }
+                VM_DISPATCH();
+            }
+            VM_CASE(SUB)
+                VM_ARITH(-)
+                VM_DISPATCH();
+            VM_CASE(MUL)
+                VM_ARITH(*)
+                VM_DISPATCH();
+            VM_CASE(DIV)
+                if (R[BC_C(i)].type == VALUE_NUMBER && R[BC_C(i)].as.number == 0)
+                {
+                    message = "Division by zero";
+                    goto failed;
+                }
+                VM_ARITH(/)
+                VM_DISPATCH();
+            VM_CASE(MOD)
+            {
+                Value b = R[BC_B(i)], c = R[BC_C(i)];
+                if (b.type != VALUE_NUMBER || c.type != VALUE_NUMBER)
+                {
+                    message = "Operands must be numbers";
+                    goto failed;
+                }
+                if (c.as.number == 0)
+                {
+                    message = "Division by zero";
+                    goto failed;
+                }
+                R[BC_A(i)] = VM_NUMBER(fmod(b.as.number, c.as.number));
+                VM_DISPATCH();
+            }
+            VM_CASE(EQ)
+                R[BC_A(i)] = VM_BOOL(value_equal(R[BC_B(i)], R[BC_C(i)]));
+                VM_DISPATCH();
+            VM_CASE(NE)
+                R[BC_A(i)] = VM_BOOL(!value_equal(R[BC_B(i)], R[BC_C(i)]));
+                VM_DISPATCH();
+            VM_CASE(LT)
+                VM_ORDER(< 0)
+                VM_DISPATCH();
+            VM_CASE(GT)
+                VM_ORDER(> 0)
+                VM_DISPATCH();
+            VM_CASE(LE)
+                VM_ORDER(<= 0)
+                VM_DISPATCH();
+            VM_CASE(GE)
+                VM_ORDER(>= 0)
+                VM_DISPATCH();
+            VM_CASE(XOR)
+                R[BC_A(i)] = VM_BOOL(value_truthy(R[BC_B(i)]) != value_truthy(R[BC_C(i)]));
+                VM_DISPATCH();
+            VM_CASE(XNOR)
+                R[BC_A(i)] = VM_BOOL(value_truthy(R[BC_B(i)]) == value_truthy(R[BC_C(i)]));
+                VM_DISPATCH();
+            VM_CASE(NOT)
+                R[BC_A(i)] = VM_BOOL(!value_truthy(R[BC_B(i)]));
+                VM_DISPATCH();
+            VM_CASE(NEG)
+                if (R[BC_B(i)].type != VALUE_NUMBER)
+                {
+                    message = "Operand must be a number";
+                    goto failed;
+                }
+                R[BC_A(i)] = VM_NUMBER(-R[BC_B(i)].as.number);
+                VM_DISPATCH();
+            VM_CASE(TRUTH)
+                R[BC_A(i)] = VM_BOOL(value_truthy(R[BC_B(i)]));
+                VM_DISPATCH();
+            VM_CASE(JMP)
+                ip += BC_SAX(i);
+                VM_DISPATCH();
+            VM_CASE(JMPF)
+            {
+                int32_t offset = (int32_t)*ip++;
+                if (!value_truthy(R[BC_A(i)]))
+                    ip += offset;
+                VM_DISPATCH();
+            }
+            VM_CASE(JMPT)
+            {
+                int32_t offset = (int32_t)*ip++;
+                if (value_truthy(R[BC_A(i)]))
+                    ip += offset;
+                VM_DISPATCH();
+            }
+            VM_CASE(NEW)
+            {
+                const DeclarationSite *site = &code->declarations[*ip++];
+                int device = backend->open(backend->ctx, site->type, site->name, site->alias);
+                if (device < 0)
+                {
+                    message = "Cannot open device";
+                    detail = site->name;
+                    goto failed;
+                }
+                R[BC_A(i)] = (Value){ VALUE_DEVICE, { .device = device } };
+                VM_DISPATCH();
+            }
+            VM_CASE(CALL)
+            {
+                CallSite *site = &code->calls[*ip++];
+                Value *base = &R[BC_A(i)];
+                if (base->type != VALUE_DEVICE)
+                {
+                    message = "Not a device";
+                    detail = site->name;
+                    goto failed;
+                }
+                Value result = { VALUE_NIL, { .number = 0 } };
+                const char *const *names = site->argc ? code->arg_names + site->first_name : NULL;
+                int device = base->as.device;
+                int refused;
+                if (backend->bind)
+                {
+                    DeviceMethod method = vm_method(backend, site, backend->type(backend->ctx, device));
+                    refused = !method || method(backend->ctx, device, base + 1, names, site->argc, &result) != 0;
+                } else
+                {
+                    refused = backend->call(backend->ctx, device, site->name, base + 1, names, site->argc, &result) != 0;
+                }
+                if (refused)
+                {
+                    message = "Device call failed";
+                    detail = site->name;
+                    goto failed;
+                }
+                *base = result;
+                VM_DISPATCH();
+            }
+            VM_CASE(CALLF)
+            {
+                const CallSite *site = &code->calls[*ip++];
+                Value *base = &R[BC_A(i)];
+                Value result = { VALUE_NIL, { .number = 0 } };
+                const char *const *names = site->argc ? code->arg_names + site->first_name : NULL;
+                if (!backend->function
+                    || backend->function(backend->ctx, site->name, base + 1, names, site->argc, &result) != 0)
+                {
+                    message = "Function call failed";
+                    detail = site->name;
+                    goto failed;
+                }
+                *base = result;
+                VM_DISPATCH();
+            }
+            VM_CASE(HALT)
+                vm->executed += executed;
+                return 0;
+#ifndef VM_COMPUTED_GOTO
+            default:
+                message = "Invalid instruction";
+                goto failed;
+        }
+    }
+#endif
+
+#undef VM_ARITH
+#undef VM_ORDER
+#undef VM_CASE
+#undef VM_DISPATCH
+
+failed:
+    vm->executed += executed;
+    // the line of the last word read, which belongs to the failing instruction
+    vm->error = (Diagnostic){ code->lines[ip - 1 - code->code], 0, message, detail };
+    return 1;
+}
@@ -0,0 +1,62 @@
+#ifndef VM_H
+#define VM_H
+
+#include "bytecode.h"
+#include "diagnostics.h"
+
+// What scripts run against: real hardware, a simulator, a test double. Method
+// and function names come interned, call arguments are passed in place, names[i] is NULL for a positional argument.
+// result starts out nil. A non-zero return fails the run.
+//
+// A backend that can bind methods ahead of the call sets type, bind and
+// epoch; method calls then go through the call site's inline cache and only
+// reach bind when the site meets a new device type. Whenever a method binding
+// changes the backend bumps *epoch, which empties every cache. A device moved
+// to another type needs no bump, caches are keyed by type. Without bind every
+// method call goes through call.
+typedef struct
+{
+    void *ctx;
+    // opens the device of a `new` declaration, returns its handle (>= 0) or -1
+    int (*open)(void *ctx, const char *type, const char *name, const char *alias);
+    // device.method(...)
+    int (*call)(void *ctx, int device, const char *method, const Value *args, const char *const *names,
+        int argc, Value *result);
+    // function(...) such as log
+    int (*function)(void *ctx, const char *name, const Value *args, const char *const *names,
+        int argc, Value *result);
+    // type of a device, devices of one type share their methods
+    int (*type)(void *ctx, int device);
+    // what method (interned) is bound to on a device type, NULL for nothing
+    DeviceMethod (*bind)(void *ctx, int type, const char *method);
+    const uint32_t *epoch;
+} DeviceBackend;
+
+// Registers available to one script
+#define VM_REGISTERS 256
+
+typedef struct VM VM;
+
+// Programs compiled for one VM share its globals, so a device declared by an
+// imported module is the same slot in every script that uses it
+VM* vm_create(const DeviceBackend *backend);
+void vm_free(VM *vm);
+
+// slot of the global name (interned), created on first use
+uint32_t vm_global_slot(VM *vm, const char *name);
+// value of a global, nil when it was never set
+Value vm_global(const VM *vm, const char *name);
+
+// Runs code from the start, filling the caches of its call sites. 0 on
+// success, otherwise vm_error says what failed.
+int vm_run(VM *vm, Bytecode *code);
+const Diagnostic* vm_error(const VM *vm);
+// instructions executed over the VM's lifetime
+uint64_t vm_instructions(const VM *vm);
+
+bool value_truthy(Value value);
+bool value_equal(Value a, Value b);
+// a value as a script would write it, strings quoted, into out
+void value_print(Value value, FILE *out);
+
+#endif //VM_H